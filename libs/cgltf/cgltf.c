@@ -848,6 +848,13 @@ void cgltf_free(cgltf_data* data)
         data->memory_free(data->memory_user_data, data->nodes[i].name);
         data->memory_free(data->memory_user_data, data->nodes[i].children);
         data->memory_free(data->memory_user_data, data->nodes[i].weights);
+
+        for (cgltf_size j = 0; j < data->nodes[i].mesh_gpu_instancing.attributes_count; ++j)
+        {
+            data->memory_free(data->memory_user_data, data->nodes[i].mesh_gpu_instancing.attributes[j].name);
+        }
+
+        data->memory_free(data->memory_user_data, data->nodes[i].mesh_gpu_instancing.attributes);
     }
 
     data->memory_free(data->memory_user_data, data->nodes);
@@ -3137,6 +3144,35 @@ static int cgltf_parse_json_node(cgltf_options* options, jsmntok_t const* tokens
                         }
                     }
                 }
+                else if (cgltf_json_strcmp(tokens+i, json_chunk, "EXT_mesh_gpu_instancing") == 0)
+                {
+                    out_node->has_mesh_gpu_instancing = 1;
+                    ++i;
+
+                    CGLTF_CHECK_TOKTYPE(tokens[i], JSMN_OBJECT);
+
+                    int data_size = tokens[i].size;
+                    ++i;
+
+                    for (int m = 0; m < data_size; ++m)
+                    {
+                        CGLTF_CHECK_KEY(tokens[i]);
+
+                        if (cgltf_json_strcmp(tokens + i, json_chunk, "attributes") == 0)
+                        {
+                            i = cgltf_parse_json_attribute_list(options, tokens, i + 1, json_chunk, &out_node->mesh_gpu_instancing.attributes, &out_node->mesh_gpu_instancing.attributes_count);
+                        }
+                        else
+                        {
+                            i = cgltf_skip_json(tokens, i + 1);
+                        }
+
+                        if (i < 0)
+                        {
+                            return i;
+                        }
+                    }
+                }
                 else
                 {
                     i = cgltf_skip_json(tokens, i+1);
@@ -3918,6 +3954,11 @@ static int cgltf_fixup_pointers(cgltf_data* data)
         CGLTF_PTRFIXUP(data->nodes[i].skin, data->skins, data->skins_count);
         CGLTF_PTRFIXUP(data->nodes[i].camera, data->cameras, data->cameras_count);
         CGLTF_PTRFIXUP(data->nodes[i].light, data->lights, data->lights_count);
+
+        for (cgltf_size j = 0; j < data->nodes[i].mesh_gpu_instancing.attributes_count; ++j)
+        {
+            CGLTF_PTRFIXUP_REQ(data->nodes[i].mesh_gpu_instancing.attributes[j].data, data->accessors, data->accessors_count);
+        }
     }
 
     for (cgltf_size i = 0; i < data->scenes_count; ++i)
@@ -389,6 +389,12 @@ typedef struct cgltf_mesh {
 
 typedef struct cgltf_node cgltf_node;
 
+/* EXT_mesh_gpu_instancing: the attributes (TRANSLATION, ROTATION, SCALE...) have one element per instance */
+typedef struct cgltf_mesh_gpu_instancing {
+	cgltf_attribute* attributes;
+	cgltf_size attributes_count;
+} cgltf_mesh_gpu_instancing;
+
 typedef struct cgltf_skin {
 	char* name;
 	cgltf_node** joints;
@@ -453,6 +459,8 @@ struct cgltf_node {
 	cgltf_float rotation[4];
 	cgltf_float scale[3];
 	cgltf_float matrix[16];
+	cgltf_bool has_mesh_gpu_instancing;
+	cgltf_mesh_gpu_instancing mesh_gpu_instancing;
 	cgltf_extras extras;
 };
 
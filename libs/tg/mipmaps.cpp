@@ -0,0 +1,290 @@
+#include "mipmaps.hpp"
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <glm/common.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define TG_MIPMAPS_SSE
+    #include <xmmintrin.h>
+#endif
+
+namespace tg
+{
+
+// --- 4 floats (one RGBA pixel) ------------------------------------------------------------------
+
+#ifdef TG_MIPMAPS_SSE
+typedef __m128 V4;
+static inline V4 v4Zero() { return _mm_setzero_ps(); }
+static inline V4 v4Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void v4Store(float* p, V4 v) { _mm_storeu_ps(p, v); }
+static inline V4 v4Add(V4 a, V4 b) { return _mm_add_ps(a, b); }
+static inline V4 v4MulAdd(V4 acc, V4 a, float s) { return _mm_add_ps(acc, _mm_mul_ps(a, _mm_set1_ps(s))); }
+static inline V4 v4Scale(V4 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+#else
+struct V4 { float x[4]; };
+static inline V4 v4Zero() { return {0, 0, 0, 0}; }
+static inline V4 v4Load(const float* p) { return {p[0], p[1], p[2], p[3]}; }
+static inline void v4Store(float* p, V4 v) { memcpy(p, v.x, sizeof(v.x)); }
+static inline V4 v4Add(V4 a, V4 b) { return {a.x[0]+b.x[0], a.x[1]+b.x[1], a.x[2]+b.x[2], a.x[3]+b.x[3]}; }
+static inline V4 v4MulAdd(V4 acc, V4 a, float s) { return {acc.x[0]+s*a.x[0], acc.x[1]+s*a.x[1], acc.x[2]+s*a.x[2], acc.x[3]+s*a.x[3]}; }
+static inline V4 v4Scale(V4 a, float s) { return {s*a.x[0], s*a.x[1], s*a.x[2], s*a.x[3]}; }
+#endif
+
+// --- color space conversion ---------------------------------------------------------------------
+
+static constexpr int LINEAR_TO_SRGB_TABLE_SIZE = 8*1024;
+
+struct ConversionTables {
+    float u8ToFloat[256];
+    float srgbToLinear[256];
+    u8 linearToSrgb[LINEAR_TO_SRGB_TABLE_SIZE];
+
+    ConversionTables()
+    {
+        for(int i = 0; i < 256; i++) {
+            const float c = i / 255.f;
+            u8ToFloat[i] = c;
+            srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for(int i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; i++) {
+            const float c = float(i) / (LINEAR_TO_SRGB_TABLE_SIZE - 1);
+            const float s = c <= 0.0031308f ? 12.92f * c : 1.055f * powf(c, 1 / 2.4f) - 0.055f;
+            linearToSrgb[i] = u8(255 * s + 0.5f);
+        }
+    }
+};
+static const ConversionTables s_tables;
+
+static void rowToFloat(float* out, const Color4u8* row, int w, bool srgb)
+{
+    const float* rgbTable = srgb ? s_tables.srgbToLinear : s_tables.u8ToFloat;
+    for(int x = 0; x < w; x++) {
+        out[4*x + 0] = rgbTable[row[x].r];
+        out[4*x + 1] = rgbTable[row[x].g];
+        out[4*x + 2] = rgbTable[row[x].b];
+        out[4*x + 3] = s_tables.u8ToFloat[row[x].a];
+    }
+}
+
+static inline u8 floatToU8(float c) {
+    return u8(255 * glm::clamp(c, 0.f, 1.f) + 0.5f);
+}
+static inline u8 linearToSrgbU8(float c) {
+    return s_tables.linearToSrgb[int((LINEAR_TO_SRGB_TABLE_SIZE - 1) * glm::clamp(c, 0.f, 1.f) + 0.5f)];
+}
+
+static void rowToU8(Color4u8* out, const float* row, int w, bool srgb)
+{
+    if(srgb) {
+        for(int x = 0; x < w; x++)
+            out[x] = {linearToSrgbU8(row[4*x]), linearToSrgbU8(row[4*x+1]), linearToSrgbU8(row[4*x+2]), floatToU8(row[4*x+3])};
+    }
+    else {
+        for(int x = 0; x < w; x++)
+            out[x] = {floatToU8(row[4*x]), floatToU8(row[4*x+1]), floatToU8(row[4*x+2]), floatToU8(row[4*x+3])};
+    }
+}
+
+// --- filters ------------------------------------------------------------------------------------
+
+// the previous level, in linear float. The level 0 is converted row by row when needed, to avoid allocating a float copy of the whole image
+struct SrcLevel {
+    int w, h;
+    const float* data; // null for the level 0
+    CImg4u8 img;
+    bool srgb;
+    float* tempRow; // room for w pixels
+
+    const float* row(int y)const
+    {
+        if(data)
+            return data + 4 * size_t(w) * y;
+        rowToFloat(tempRow, &img(0, y), w, srgb);
+        return tempRow;
+    }
+};
+
+static void boxDownsample(float* dst, int dw, int dh, const SrcLevel& src)
+{
+    float* rowsSum = dst; // we can accumulate in place because each destination row is written after reading its 2 source rows
+    for(int y = 0; y < dh; y++) {
+        float* dstRow = rowsSum + 4 * size_t(dw) * y;
+        const float* src0 = src.row(glm::min(2*y, src.h - 1));
+        if(src.w == 1) {
+            v4Store(dstRow, v4Load(src0));
+        }
+        else {
+            for(int x = 0; x < dw; x++)
+                v4Store(dstRow + 4*x, v4Add(v4Load(src0 + 8*x), v4Load(src0 + 8*x + 4)));
+        }
+        if(src.h == 1) {
+            for(int x = 0; x < dw; x++)
+                v4Store(dstRow + 4*x, v4Scale(v4Load(dstRow + 4*x), src.w == 1 ? 1.f : 0.5f));
+            continue;
+        }
+        const float* src1 = src.row(2*y + 1);
+        const float scale = src.w == 1 ? 0.5f : 0.25f;
+        for(int x = 0; x < dw; x++) {
+            V4 sum = v4Load(dstRow + 4*x);
+            if(src.w == 1)
+                sum = v4Add(sum, v4Load(src1));
+            else
+                sum = v4Add(sum, v4Add(v4Load(src1 + 8*x), v4Load(src1 + 8*x + 4)));
+            v4Store(dstRow + 4*x, v4Scale(sum, scale));
+        }
+    }
+}
+
+static constexpr int KAISER_TAPS = 8; // the taps are at distances 0.5, 1.5, 2.5, 3.5 (in source pixels) at both sides of the center
+static constexpr int KAISER_TAPS_BEFORE = KAISER_TAPS / 2 - 1;
+
+static float besselI0(float x)
+{
+    float sum = 1, term = 1;
+    for(int k = 1; k < 20; k++) {
+        const float t = x / (2 * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+struct KaiserWeights {
+    float w[KAISER_TAPS];
+
+    KaiserWeights()
+    {
+        constexpr float ALPHA = 4;
+        constexpr float PI = 3.14159265f;
+        float sum = 0;
+        for(int i = 0; i < KAISER_TAPS; i++) {
+            const float d = i - KAISER_TAPS_BEFORE - 0.5f; // distance to the center, in source pixels
+            const float x = PI * d / 2; // the cutoff frequency is half of the source sampling rate
+            const float sinc = sinf(x) / x;
+            const float t = d / (KAISER_TAPS / 2);
+            const float window = besselI0(ALPHA * sqrtf(1 - t*t)) / besselI0(ALPHA);
+            w[i] = sinc * window;
+            sum += w[i];
+        }
+        for(float& x : w)
+            x /= sum;
+    }
+};
+static const KaiserWeights s_kaiser;
+
+// separable filter: first horizontally into a ring of rows, then vertically
+static void kaiserDownsample(float* dst, int dw, int dh, const SrcLevel& src, float* ringRows)
+{
+    if(src.w == 1 || src.h == 1) {
+        // the kernel doesn't make sense for a dimension that is not being reduced
+        boxDownsample(dst, dw, dh, src);
+        return;
+    }
+
+    const size_t rowFloats = 4 * size_t(dw);
+    int ringRowInds[KAISER_TAPS];
+    for(int& i : ringRowInds)
+        i = -1;
+    auto hRow = [&](int y) -> const float*
+    {
+        y = glm::clamp(y, 0, src.h - 1);
+        const int slot = y % KAISER_TAPS;
+        float* out = ringRows + slot * rowFloats;
+        if(ringRowInds[slot] == y)
+            return out;
+        ringRowInds[slot] = y;
+        const float* s = src.row(y);
+        for(int x = 0; x < dw; x++) {
+            V4 acc = v4Zero();
+            for(int i = 0; i < KAISER_TAPS; i++) {
+                const int sx = glm::clamp(2*x - KAISER_TAPS_BEFORE + i, 0, src.w - 1);
+                acc = v4MulAdd(acc, v4Load(s + 4*sx), s_kaiser.w[i]);
+            }
+            v4Store(out + 4*x, acc);
+        }
+        return out;
+    };
+
+    for(int y = 0; y < dh; y++) {
+        const float* rows[KAISER_TAPS];
+        for(int i = 0; i < KAISER_TAPS; i++)
+            rows[i] = hRow(2*y - KAISER_TAPS_BEFORE + i);
+        float* dstRow = dst + rowFloats * y;
+        for(int x = 0; x < dw; x++) {
+            V4 acc = v4Zero();
+            for(int i = 0; i < KAISER_TAPS; i++)
+                acc = v4MulAdd(acc, v4Load(rows[i] + 4*x), s_kaiser.w[i]);
+            v4Store(dstRow + 4*x, acc);
+        }
+    }
+}
+
+// --- public -------------------------------------------------------------------------------------
+
+int calcNumMipLevels(int w, int h)
+{
+    int n = 1;
+    for(int size = glm::max(w, h); size > 1; size /= 2)
+        n++;
+    return n;
+}
+
+int calcMipLevelSize(int size, int level)
+{
+    return glm::max(1, size >> level);
+}
+
+size_t calcMipChainNumPixels(int w, int h)
+{
+    size_t n = 0;
+    const int numLevels = calcNumMipLevels(w, h);
+    for(int level = 1; level < numLevels; level++)
+        n += size_t(calcMipLevelSize(w, level)) * calcMipLevelSize(h, level);
+    return n;
+}
+
+void generateMipChain(Color4u8* out, CImg4u8 img, bool srgb, EMipFilter filter)
+{
+    const int w = img.width();
+    const int h = img.height();
+    const int numLevels = calcNumMipLevels(w, h);
+    if(numLevels <= 1)
+        return;
+
+    // the float levels are ping-ponged between two buffers. The first one has the size of the level 1, the second one of the level 2
+    const int w1 = calcMipLevelSize(w, 1), h1 = calcMipLevelSize(h, 1);
+    const size_t level1Floats = 4 * size_t(w1) * h1;
+    const size_t level2Floats = 4 * size_t(calcMipLevelSize(w, 2)) * calcMipLevelSize(h, 2);
+    const size_t tempRowFloats = 4 * size_t(w);
+    const size_t ringFloats = filter == EMipFilter::KAISER ? 4 * size_t(w1) * KAISER_TAPS : 0;
+    float* mem = (float*)malloc(sizeof(float) * (level1Floats + level2Floats + tempRowFloats + ringFloats));
+    float* levelBuffers[2] = {mem, mem + level1Floats};
+    float* tempRow = levelBuffers[1] + level2Floats;
+    float* ringRows = tempRow + tempRowFloats;
+
+    SrcLevel src = {w, h, nullptr, img, srgb, tempRow};
+    for(int level = 1; level < numLevels; level++)
+    {
+        const int dw = calcMipLevelSize(w, level);
+        const int dh = calcMipLevelSize(h, level);
+        float* dst = levelBuffers[(level - 1) % 2];
+        if(filter == EMipFilter::KAISER)
+            kaiserDownsample(dst, dw, dh, src, ringRows);
+        else
+            boxDownsample(dst, dw, dh, src);
+
+        for(int y = 0; y < dh; y++)
+            rowToU8(out + size_t(dw) * y, dst + 4 * size_t(dw) * y, dw, srgb);
+        out += size_t(dw) * dh;
+        src.w = dw;
+        src.h = dh;
+        src.data = dst;
+    }
+    free(mem);
+}
+
+}
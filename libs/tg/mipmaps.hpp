@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include "img.hpp"
+
+namespace tg
+{
+
+enum class EMipFilter {
+    BOX, // average of 2x2 pixels: fast
+    KAISER, // kaiser-windowed sinc, 8 taps per axis: sharper, with less aliasing
+};
+
+int calcNumMipLevels(int w, int h); // including the level 0
+int calcMipLevelSize(int size, int level); // size in pixels of one dimension
+size_t calcMipChainNumPixels(int w, int h); // total number of pixels of all the levels, excluding the level 0
+
+/* Generates the levels 1 to N of the mip chain of img, and writes them consecutively in "out" (with no padding between rows or levels).
+"out" must have room for calcMipChainNumPixels(img.width(), img.height()) pixels.
+When srgb is true, the RGB channels are filtered in linear space (alpha is always linear).
+The filtering is done in float, from the previous level, so the errors of quantization don't accumulate.
+For odd sizes, the last row/column of the previous level is ignored (like most GPU implementations do).
+This function doesn't touch any global state, so it can be called from several threads at the same time. */
+void generateMipChain(Color4u8* out, CImg4u8 img, bool srgb, EMipFilter filter = EMipFilter::BOX);
+
+}
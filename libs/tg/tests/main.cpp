@@ -10,6 +10,7 @@ bool test_downscale();
 bool test_generateGgxLut();
 bool test_iblPbr();
 bool test_glslRand();
+bool test_mipmaps();
 
 struct TestInfo {
     CStr name;
@@ -23,6 +24,7 @@ static TestInfo tests[] = {
     {"generateGgxLut", test_generateGgxLut},
     {"iblPbr", test_iblPbr},
     {"glslRand", test_glslRand},
+    {"mipmaps", test_mipmaps},
 };
 
 static char scratchStr[1024];
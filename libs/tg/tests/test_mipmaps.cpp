@@ -0,0 +1,66 @@
+#include <tg/mipmaps.hpp>
+#include <tl/basic.hpp>
+#include <tl/fmt.hpp>
+#include <stdlib.h>
+#include <chrono>
+
+using tg::Color4u8;
+using tg::EMipFilter;
+
+static const EMipFilter s_filters[] = {EMipFilter::BOX, EMipFilter::KAISER};
+
+// checks the pixels of the level that are not closer than "margin" to the border
+static bool checkUniformLevel(const Color4u8* pixels, int w, int h, int margin, u8 expectedColor, u8 expectedAlpha)
+{
+    for(int y = margin; y < h - margin; y++)
+    for(int x = margin; x < w - margin; x++) {
+        // the tables used for the conversions allow for an error of 1
+        const Color4u8 c = pixels[x + w*y];
+        if(abs(c.r - expectedColor) > 1 || abs(c.a - expectedAlpha) > 1)
+            return false;
+    }
+    return true;
+}
+
+bool test_mipmaps()
+{
+    bool ok = true;
+    // a checkerboard of black and white pixels must turn into the gray that has half of the light, which in sRGB is 188
+    constexpr int W = 32, H = 16;
+    Color4u8 checker[W * H];
+    for(int y = 0; y < H; y++)
+    for(int x = 0; x < W; x++) {
+        const u8 c = ((x + y) & 1) ? 255 : 0;
+        checker[x + W*y] = {c, c, c, c};
+    }
+    Color4u8 mips[W * H];
+    const int numLevels = tg::calcNumMipLevels(W, H);
+    ok &= numLevels == 6;
+    ok &= tg::calcMipChainNumPixels(W, H) == 16*8 + 8*4 + 4*2 + 2*1 + 1*1;
+    for(EMipFilter filter : s_filters)
+    {
+        // the kaiser filter clamps to the edge, so near the border the pattern doesn't cancel out
+        const int margin = filter == EMipFilter::KAISER ? 2 : 0;
+        tg::generateMipChain(mips, tg::CImg4u8(W, H, checker), true, filter);
+        ok &= checkUniformLevel(mips, W/2, H/2, margin, 188, 128);
+        tg::generateMipChain(mips, tg::CImg4u8(W, H, checker), false, filter);
+        ok &= checkUniformLevel(mips, W/2, H/2, margin, 128, 128);
+    }
+    tl::println("mip chain of a checkerboard: ", ok ? "OK" : "FAILED");
+
+    // timing of a big image
+    constexpr int BIG_SIZE = 2048;
+    Color4u8* big = new Color4u8[BIG_SIZE * BIG_SIZE];
+    Color4u8* bigMips = new Color4u8[tg::calcMipChainNumPixels(BIG_SIZE, BIG_SIZE)];
+    for(int i = 0; i < BIG_SIZE * BIG_SIZE; i++)
+        big[i] = {u8(i), u8(i >> 3), u8(i >> 7), 255};
+    for(EMipFilter filter : s_filters) {
+        const auto t0 = std::chrono::steady_clock::now();
+        tg::generateMipChain(bigMips, tg::CImg4u8(BIG_SIZE, BIG_SIZE, big), true, filter);
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - t0;
+        tl::println(filter == EMipFilter::BOX ? "box" : "kaiser", " filter, ", BIG_SIZE, "x", BIG_SIZE, ": ", elapsed.count(), "ms");
+    }
+    delete[] big;
+    delete[] bigMips;
+    return ok;
+}
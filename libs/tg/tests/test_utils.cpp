@@ -68,7 +68,9 @@ GLFWwindow* simpleInitGlfwGL()
         fprintf(stderr, "Failed to initialize OpenGL loader!\n");
         return nullptr;
     }
+#ifdef GLAD_DEBUG
     glad_set_post_callback(glErrorCallback);
+#endif
     return window;
 }
 
@@ -0,0 +1,279 @@
+#include "anim_compression.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <glm/common.hpp>
+
+static constexpr float QUAT_COMPONENT_MAX = 0.70710678f; // the 3 smallest components of a unit quaternion are in [-1/sqrt(2), 1/sqrt(2)]
+static constexpr float QUAT_QUANT_MAX = 32767; // 15 bits
+static constexpr float VEC3_QUANT_MAX = 65535; // 16 bits
+
+size_t CompressedChannels::memorySize()const
+{
+    return sizeof(Channel) * channels.size() + sizeof(u16) * (keyFrames.size() + keyValues.size());
+}
+
+static void getFrameValue(float v[4], const BakedChannels& baked, size_t channelInd, u32 frame)
+{
+    for(u32 c = 0; c < baked.numComponents; c++)
+        v[c] = baked.frames[c][frame * baked.stride + channelInd];
+}
+
+// lerp, or nlerp along the shortest path
+static void interpolate(float res[4], const float a[4], const float b[4], float alpha, u32 numComponents)
+{
+    float signB = 1;
+    if(numComponents == 4) {
+        const float d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+        signB = d < 0 ? -1.f : 1.f;
+    }
+    for(u32 c = 0; c < numComponents; c++)
+        res[c] = a[c] + alpha * (signB * b[c] - a[c]);
+    if(numComponents == 4) {
+        const float invLen = 1 / sqrtf(res[0]*res[0] + res[1]*res[1] + res[2]*res[2] + res[3]*res[3]);
+        for(u32 c = 0; c < 4; c++)
+            res[c] *= invLen;
+    }
+}
+
+// the difference between two values, taking into account that q and -q are the same rotation
+static float valueDistance(const float a[4], const float b[4], u32 numComponents)
+{
+    float d = 0, dNeg = 0;
+    for(u32 c = 0; c < numComponents; c++) {
+        d = glm::max(d, fabsf(a[c] - b[c]));
+        dNeg = glm::max(dNeg, fabsf(a[c] + b[c]));
+    }
+    return numComponents == 4 ? glm::min(d, dNeg) : d;
+}
+
+// true if all the frames between a and b are within the tolerance of the interpolation between a and b
+static bool segmentFits(const BakedChannels& baked, size_t channelInd, u32 frameA, u32 frameB, float tolerance)
+{
+    const u32 numComponents = baked.numComponents;
+    float a[4], b[4], v[4], interp[4];
+    getFrameValue(a, baked, channelInd, frameA);
+    getFrameValue(b, baked, channelInd, frameB);
+    for(u32 f = frameA + 1; f < frameB; f++) {
+        getFrameValue(v, baked, channelInd, f);
+        interpolate(interp, a, b, float(f - frameA) / (frameB - frameA), numComponents);
+        if(valueDistance(interp, v, numComponents) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+// the lines that start at the first frame of a segment and pass within the tolerance of all the frames after it, as a range of slopes per component
+// this makes extending the segment by one frame O(1), instead of checking all its frames again
+struct SlopeCone {
+    float a[4];
+    float minSlope[4], maxSlope[4];
+};
+
+// rotations are compared in the hemisphere of the first frame, like interpolate() does
+static void getAlignedFrameValue(float v[4], const BakedChannels& baked, size_t channelInd, u32 frame, const float a[4])
+{
+    getFrameValue(v, baked, channelInd, frame);
+    if(baked.numComponents == 4 && a[0]*v[0] + a[1]*v[1] + a[2]*v[2] + a[3]*v[3] < 0) {
+        for(u32 c = 0; c < 4; c++)
+            v[c] = -v[c];
+    }
+}
+
+static void initCone(SlopeCone& cone, const BakedChannels& baked, size_t channelInd, u32 frameA)
+{
+    getFrameValue(cone.a, baked, channelInd, frameA);
+    for(u32 c = 0; c < baked.numComponents; c++) {
+        cone.minSlope[c] = -INFINITY;
+        cone.maxSlope[c] = +INFINITY;
+    }
+}
+
+// the lerp from a towards v passes within the tolerance of all the frames added so far
+static bool coneContains(const SlopeCone& cone, const float v[4], u32 numFrames, u32 numComponents)
+{
+    for(u32 c = 0; c < numComponents; c++) {
+        const float slope = (v[c] - cone.a[c]) / numFrames;
+        if(slope < cone.minSlope[c] || slope > cone.maxSlope[c])
+            return false;
+    }
+    return true;
+}
+
+// the next lines must also pass within the tolerance of v, which is numFrames after a
+static void narrowCone(SlopeCone& cone, const float v[4], u32 numFrames, u32 numComponents, float tolerance)
+{
+    for(u32 c = 0; c < numComponents; c++) {
+        cone.minSlope[c] = glm::max(cone.minSlope[c], (v[c] - tolerance - cone.a[c]) / numFrames);
+        cone.maxSlope[c] = glm::min(cone.maxSlope[c], (v[c] + tolerance - cone.a[c]) / numFrames);
+    }
+}
+
+static u16 quantize(float v, float vMin, float extent, float quantMax)
+{
+    const float x = extent > 0 ? (v - vMin) / extent : 0;
+    return u16(glm::clamp(x, 0.f, 1.f) * quantMax + 0.5f);
+}
+
+static float dequantize(u16 q, float vMin, float extent, float quantMax)
+{
+    return vMin + extent * (q / quantMax);
+}
+
+// the index of the largest component goes in the top bits of the first two u16
+static void encodeQuat(u16 out[3], const float q[4])
+{
+    u32 largest = 0;
+    for(u32 c = 1; c < 4; c++)
+        if(fabsf(q[c]) > fabsf(q[largest]))
+            largest = c;
+    // the dropped component is recomputed as positive, so we store the quaternion that has it positive
+    const float sign = q[largest] < 0 ? -1.f : 1.f;
+    u32 j = 0;
+    for(u32 c = 0; c < 4; c++)
+        if(c != largest)
+            out[j++] = quantize(sign * q[c], -QUAT_COMPONENT_MAX, 2 * QUAT_COMPONENT_MAX, QUAT_QUANT_MAX);
+    out[0] |= (largest & 1) << 15;
+    out[1] |= (largest >> 1) << 15;
+}
+
+static void decodeQuat(float q[4], const u16 in[3])
+{
+    const u32 largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+    float sum = 0;
+    u32 j = 0;
+    for(u32 c = 0; c < 4; c++) {
+        if(c == largest)
+            continue;
+        q[c] = dequantize(in[j++] & 0x7fff, -QUAT_COMPONENT_MAX, 2 * QUAT_COMPONENT_MAX, QUAT_QUANT_MAX);
+        sum += q[c] * q[c];
+    }
+    q[largest] = sqrtf(glm::max(0.f, 1 - sum));
+}
+
+bool compressChannels(CompressedChannels& compressed, const BakedChannels& baked, float tolerance)
+{
+    if(baked.numFrames > 0x10000)
+        return false;
+    const u32 numComponents = baked.numComponents;
+    const size_t n = baked.size();
+    compressed.numComponents = numComponents;
+    compressed.rate = baked.rate;
+    compressed.numFrames = baked.numFrames;
+    compressed.channels.resize(n);
+    compressed.keyFrames.resize(0);
+    compressed.keyValues.resize(0);
+    compressed.curKeys.resize(n);
+    for(u32 c = 0; c < numComponents; c++)
+        compressed.out[c].resize(n);
+
+    for(size_t i = 0; i < n; i++) {
+        CompressedChannels::Channel& channel = compressed.channels[i];
+        channel.firstKey = compressed.keyFrames.size();
+        compressed.curKeys[i] = 0;
+
+        // greedy key reduction: each segment is extended while all the frames in it fit
+        // the cone is exact for the lerp of translations and scales. The nlerp of rotations can be a bit further, so the segment is checked at the end
+        const u32 lastFrame = baked.numFrames - 1;
+        u32 frameA = 0;
+        compressed.keyFrames.push_back(0);
+        while(frameA < lastFrame) {
+            SlopeCone cone;
+            initCone(cone, baked, i, frameA);
+            float v[4];
+            u32 frameB = frameA + 1;
+            getAlignedFrameValue(v, baked, i, frameB, cone.a);
+            narrowCone(cone, v, frameB - frameA, numComponents, tolerance);
+            while(frameB < lastFrame) {
+                getAlignedFrameValue(v, baked, i, frameB + 1, cone.a);
+                if(!coneContains(cone, v, frameB + 1 - frameA, numComponents))
+                    break;
+                frameB++;
+                narrowCone(cone, v, frameB - frameA, numComponents, tolerance);
+            }
+            if(numComponents == 4) {
+                while(!segmentFits(baked, i, frameA, frameB, tolerance))
+                    frameB--;
+            }
+            compressed.keyFrames.push_back(u16(frameB));
+            frameA = frameB;
+        }
+        channel.numKeys = compressed.keyFrames.size() - channel.firstKey;
+
+        float v[4];
+        if(numComponents == 4) {
+            for(u32 k = 0; k < channel.numKeys; k++) {
+                getFrameValue(v, baked, i, compressed.keyFrames[channel.firstKey + k]);
+                u16 q[3];
+                encodeQuat(q, v);
+                for(u16 x : q)
+                    compressed.keyValues.push_back(x);
+            }
+        }
+        else {
+            for(u32 c = 0; c < 3; c++) {
+                float vMin = +INFINITY, vMax = -INFINITY;
+                for(u32 k = 0; k < channel.numKeys; k++) {
+                    const float x = baked.frames[c][compressed.keyFrames[channel.firstKey + k] * baked.stride + i];
+                    vMin = glm::min(vMin, x);
+                    vMax = glm::max(vMax, x);
+                }
+                channel.rangeMin[c] = vMin;
+                channel.rangeExtent[c] = vMax - vMin;
+            }
+            for(u32 k = 0; k < channel.numKeys; k++) {
+                getFrameValue(v, baked, i, compressed.keyFrames[channel.firstKey + k]);
+                for(u32 c = 0; c < 3; c++)
+                    compressed.keyValues.push_back(quantize(v[c], channel.rangeMin[c], channel.rangeExtent[c], VEC3_QUANT_MAX));
+            }
+        }
+    }
+    return true;
+}
+
+static void decodeKey(float v[4], const CompressedChannels& compressed, const CompressedChannels::Channel& channel, u32 keyInd)
+{
+    const u16* q = &compressed.keyValues[3 * (channel.firstKey + keyInd)];
+    if(compressed.numComponents == 4)
+        decodeQuat(v, q);
+    else
+        for(u32 c = 0; c < 3; c++)
+            v[c] = dequantize(q[c], channel.rangeMin[c], channel.rangeExtent[c], VEC3_QUANT_MAX);
+}
+
+void evalCompressedChannels(CompressedChannels& compressed, float t)
+{
+    const u32 numComponents = compressed.numComponents;
+    if(compressed.numFrames == 0)
+        return;
+    const float ft = glm::clamp(t * compressed.rate, 0.f, float(compressed.numFrames - 1));
+    for(size_t i = 0; i < compressed.size(); i++) {
+        const CompressedChannels::Channel& channel = compressed.channels[i];
+        const u16* frames = &compressed.keyFrames[channel.firstKey];
+        // the key k is valid if frames[k] <= ft < frames[k+1]. During the playback it's usually the same key as before or the next one
+        u32& k = compressed.curKeys[i];
+        auto keyContains = [&](u32 k) {
+            return k < channel.numKeys && frames[k] <= ft && (k + 1 == channel.numKeys || ft < frames[k + 1]);
+        };
+        if(!keyContains(k)) {
+            if(keyContains(k + 1))
+                k++;
+            else
+                k = u32(std::upper_bound(frames, frames + channel.numKeys, ft, [](float x, u16 f) { return x < f; }) - frames) - 1;
+        }
+
+        float res[4];
+        if(k + 1 == channel.numKeys) {
+            decodeKey(res, compressed, channel, k);
+        }
+        else {
+            float a[4], b[4];
+            decodeKey(a, compressed, channel, k);
+            decodeKey(b, compressed, channel, k + 1);
+            interpolate(res, a, b, (ft - frames[k]) / (frames[k + 1] - frames[k]), numComponents);
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            compressed.out[c][i] = res[c];
+    }
+}
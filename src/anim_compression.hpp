@@ -0,0 +1,42 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "anim_eval.hpp"
+
+// animation channels stored compactly, and decompressed during the evaluation
+// it's built from channels baked at a fixed rate, so all the interpolation types are handled the same way:
+//  - key reduction: a frame is dropped if the line between the kept frames around it passes within the tolerance of it
+//  - the kept keys store their frame index in 16 bits
+//  - rotations: smallest three, the largest component is dropped (it's recomputed from the others) and the other 3 are quantized to 15 bits
+//  - translations and scales: 16 bits per component, quantized inside the range of values of the channel
+struct CompressedChannels {
+    struct Channel {
+        u32 firstKey; // inside keyFrames, and keyValues (3 u16 per key)
+        u32 numKeys;
+        float rangeMin[3], rangeExtent[3]; // only for translations and scales
+    };
+
+    u32 numComponents = 3; // 3 for translations and scales, 4 for rotations
+    float rate = 30; // frames per second
+    u32 numFrames = 0;
+    tl::Vector<Channel> channels;
+    tl::Vector<u16> keyFrames;
+    tl::Vector<u16> keyValues;
+    tl::Vector<u32> curKeys; // foreach channel, the key that was used in the last evaluation (relative to firstKey), so usually there is no search
+    tl::Vector<float> out[4];
+
+    size_t size()const { return channels.size(); }
+    size_t numKeys()const { return keyFrames.size(); }
+    size_t memorySize()const; // the bytes used by the compressed data
+    glm::vec3 getVec3(size_t i)const { return {out[0][i], out[1][i], out[2][i]}; }
+    glm::quat getQuat(size_t i)const { return {out[3][i], out[0][i], out[1][i], out[2][i]}; }
+};
+
+// tolerance is the maximum difference per component allowed by the key reduction. 0 only drops frames that are exactly on the line
+// returns false if the animation has too many frames for 16-bit frame indices
+bool compressChannels(CompressedChannels& compressed, const BakedChannels& baked, float tolerance);
+
+// out = the values of all the channels at time t
+void evalCompressedChannels(CompressedChannels& compressed, float t);
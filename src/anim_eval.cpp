@@ -0,0 +1,439 @@
+#include "anim_eval.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <glm/common.hpp>
+
+#if defined(__AVX__)
+    #define ANIM_EVAL_AVX
+    #include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define ANIM_EVAL_SSE
+    #include <xmmintrin.h>
+#endif
+
+static constexpr size_t BLOCK_SIZE = 64; // channels. A multiple of the SIMD width
+
+namespace
+{
+// the keys gathered for a block of channels. The tangents are already multiplied by the duration of the segment
+struct alignas(32) Block {
+    float s[BLOCK_SIZE]; // position inside the segment, in [0, 1]
+    float p0[4][BLOCK_SIZE], p1[4][BLOCK_SIZE];
+    float m0[4][BLOCK_SIZE], m1[4][BLOCK_SIZE];
+};
+}
+
+void ChannelsBatch::resize(size_t n)
+{
+    assert(numComponents == 3 || numComponents == 4);
+    channels.resize(n);
+    keyInds.resize(n);
+    hasCubic = false;
+    const size_t paddedSize = (n + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+    for(u32 c = 0; c < numComponents; c++)
+        out[c].resize(paddedSize);
+}
+
+void ChannelsBatch::setChannel(size_t i, const cgltf_animation_sampler& sampler)
+{
+    assert(sampler.input->component_type == cgltf_component_type_r_32f);
+    assert(sampler.output->component_type == cgltf_component_type_r_32f);
+    auto getData = [](const cgltf_accessor& a) {
+        return (const u8*)a.buffer_view->buffer->data + a.buffer_view->offset + a.offset;
+    };
+    Channel& channel = channels[i];
+    channel.times = getData(*sampler.input);
+    channel.values = getData(*sampler.output);
+    channel.timesStride = sampler.input->stride;
+    channel.valuesStride = sampler.output->stride;
+    channel.numKeys = sampler.input->count;
+    channel.interpolation = sampler.interpolation;
+    hasCubic = hasCubic || sampler.interpolation == cgltf_interpolation_type_cubic_spline;
+}
+
+// without hermite the tangents are not written, the block is only valid for LINEAR and STEP
+template <u32 numComponents, bool hermite>
+static void gatherKeys(Block& block, size_t j, const ChannelsBatch::Channel& channel, i32 keyInd, float t, bool normalize)
+{
+    const i32 numKeys = channel.numKeys;
+    const bool cubic = channel.interpolation == cgltf_interpolation_type_cubic_spline;
+    auto getElem = [&](i32 e) { return (const float*)(channel.values + e * channel.valuesStride); };
+    auto getValue = [&](i32 k) { return getElem(cubic ? 3*k + 1 : k); };
+    auto getTime = [&](i32 k) { return *(const float*)(channel.times + k * channel.timesStride); };
+
+    if(keyInd < 0 || keyInd >= numKeys-1 || channel.interpolation == cgltf_interpolation_type_step) {
+        const float* v = getValue(glm::clamp(keyInd, 0, numKeys-1));
+        block.s[j] = 0;
+        for(u32 c = 0; c < numComponents; c++) {
+            block.p0[c][j] = block.p1[c][j] = v[c];
+            if(hermite)
+                block.m0[c][j] = block.m1[c][j] = 0;
+        }
+        return;
+    }
+
+    const float timeA = getTime(keyInd);
+    const float segmentDuration = getTime(keyInd + 1) - timeA;
+    block.s[j] = segmentDuration > 0 ? glm::clamp((t - timeA) / segmentDuration, 0.f, 1.f) : 0.f;
+    const float* vA = getValue(keyInd);
+    const float* vB = getValue(keyInd + 1);
+    if(cubic) {
+        assert(hermite);
+        const float* outTangentA = getElem(3*keyInd + 2);
+        const float* inTangentB = getElem(3*(keyInd + 1));
+        for(u32 c = 0; c < numComponents; c++) {
+            block.p0[c][j] = vA[c];
+            block.p1[c][j] = vB[c];
+            block.m0[c][j] = segmentDuration * outTangentA[c];
+            block.m1[c][j] = segmentDuration * inTangentB[c];
+        }
+    }
+    else {
+        // q and -q are the same rotation, we take the one that gives the shortest path
+        float signB = 1;
+        if(normalize) {
+            float d = 0;
+            for(u32 c = 0; c < numComponents; c++)
+                d += vA[c] * vB[c];
+            signB = d < 0 ? -1.f : 1.f;
+        }
+        for(u32 c = 0; c < numComponents; c++) {
+            const float a = vA[c], b = signB * vB[c];
+            block.p0[c][j] = a;
+            block.p1[c][j] = b;
+            if(hermite)
+                block.m0[c][j] = block.m1[c][j] = b - a;
+        }
+    }
+}
+
+// the unused lanes of the last block get the identity, so the normalization doesn't divide by zero
+template <u32 numComponents>
+static void fillEmptyLanes(Block& block, size_t first)
+{
+    for(size_t j = first; j < BLOCK_SIZE; j++) {
+        block.s[j] = 0;
+        for(u32 c = 0; c < numComponents; c++) {
+            block.p0[c][j] = block.p1[c][j] = c == 3 ? 1.f : 0.f;
+            block.m0[c][j] = block.m1[c][j] = 0;
+        }
+    }
+}
+
+// Hermite basis: p(s) = (2s^3 - 3s^2 + 1) p0 + (s^3 - 2s^2 + s) m0 + (-2s^3 + 3s^2) p1 + (s^3 - s^2) m1
+// without hermite it's a lerp, which gives the same for LINEAR and STEP with less work
+template <u32 numComponents, bool hermite>
+static void interpolateBlock(const Block& block, float* const out[4], bool normalize)
+{
+    const size_t n = BLOCK_SIZE;
+#if defined(ANIM_EVAL_AVX)
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 two = _mm256_set1_ps(2);
+    const __m256 three = _mm256_set1_ps(3);
+    for(size_t i = 0; i < n; i += 8) {
+        const __m256 s = _mm256_loadu_ps(&block.s[i]);
+        const __m256 s2 = _mm256_mul_ps(s, s);
+        const __m256 s3 = _mm256_mul_ps(s2, s);
+        const __m256 h01 = _mm256_sub_ps(_mm256_mul_ps(three, s2), _mm256_mul_ps(two, s3));
+        const __m256 h00 = _mm256_sub_ps(one, h01);
+        const __m256 h11 = _mm256_sub_ps(s3, s2);
+        const __m256 h10 = _mm256_add_ps(_mm256_sub_ps(h11, s2), s);
+        __m256 res[4];
+        for(u32 c = 0; c < numComponents; c++) {
+            const __m256 p0 = _mm256_loadu_ps(&block.p0[c][i]);
+            const __m256 p1 = _mm256_loadu_ps(&block.p1[c][i]);
+            if(hermite) {
+                __m256 r = _mm256_mul_ps(h00, p0);
+                r = _mm256_add_ps(r, _mm256_mul_ps(h10, _mm256_loadu_ps(&block.m0[c][i])));
+                r = _mm256_add_ps(r, _mm256_mul_ps(h01, p1));
+                r = _mm256_add_ps(r, _mm256_mul_ps(h11, _mm256_loadu_ps(&block.m1[c][i])));
+                res[c] = r;
+            }
+            else
+                res[c] = _mm256_add_ps(p0, _mm256_mul_ps(s, _mm256_sub_ps(p1, p0)));
+        }
+        if(normalize) {
+            __m256 len2 = _mm256_mul_ps(res[0], res[0]);
+            for(u32 c = 1; c < numComponents; c++)
+                len2 = _mm256_add_ps(len2, _mm256_mul_ps(res[c], res[c]));
+            const __m256 invLen = _mm256_div_ps(one, _mm256_sqrt_ps(len2));
+            for(u32 c = 0; c < numComponents; c++)
+                res[c] = _mm256_mul_ps(res[c], invLen);
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            _mm256_storeu_ps(&out[c][i], res[c]);
+    }
+#elif defined(ANIM_EVAL_SSE)
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 two = _mm_set1_ps(2);
+    const __m128 three = _mm_set1_ps(3);
+    for(size_t i = 0; i < n; i += 4) {
+        const __m128 s = _mm_loadu_ps(&block.s[i]);
+        const __m128 s2 = _mm_mul_ps(s, s);
+        const __m128 s3 = _mm_mul_ps(s2, s);
+        const __m128 h01 = _mm_sub_ps(_mm_mul_ps(three, s2), _mm_mul_ps(two, s3));
+        const __m128 h00 = _mm_sub_ps(one, h01);
+        const __m128 h11 = _mm_sub_ps(s3, s2);
+        const __m128 h10 = _mm_add_ps(_mm_sub_ps(h11, s2), s);
+        __m128 res[4];
+        for(u32 c = 0; c < numComponents; c++) {
+            const __m128 p0 = _mm_loadu_ps(&block.p0[c][i]);
+            const __m128 p1 = _mm_loadu_ps(&block.p1[c][i]);
+            if(hermite) {
+                __m128 r = _mm_mul_ps(h00, p0);
+                r = _mm_add_ps(r, _mm_mul_ps(h10, _mm_loadu_ps(&block.m0[c][i])));
+                r = _mm_add_ps(r, _mm_mul_ps(h01, p1));
+                r = _mm_add_ps(r, _mm_mul_ps(h11, _mm_loadu_ps(&block.m1[c][i])));
+                res[c] = r;
+            }
+            else
+                res[c] = _mm_add_ps(p0, _mm_mul_ps(s, _mm_sub_ps(p1, p0)));
+        }
+        if(normalize) {
+            __m128 len2 = _mm_mul_ps(res[0], res[0]);
+            for(u32 c = 1; c < numComponents; c++)
+                len2 = _mm_add_ps(len2, _mm_mul_ps(res[c], res[c]));
+            const __m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(len2));
+            for(u32 c = 0; c < numComponents; c++)
+                res[c] = _mm_mul_ps(res[c], invLen);
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            _mm_storeu_ps(&out[c][i], res[c]);
+    }
+#else
+    for(size_t i = 0; i < n; i++) {
+        const float s = block.s[i];
+        const float s2 = s * s;
+        const float s3 = s2 * s;
+        const float h01 = 3 * s2 - 2 * s3;
+        const float h00 = 1 - h01;
+        const float h11 = s3 - s2;
+        const float h10 = h11 - s2 + s;
+        float res[4];
+        for(u32 c = 0; c < numComponents; c++) {
+            const float p0 = block.p0[c][i], p1 = block.p1[c][i];
+            res[c] = hermite ?
+                h00 * p0 + h10 * block.m0[c][i] + h01 * p1 + h11 * block.m1[c][i] :
+                p0 + s * (p1 - p0);
+        }
+        if(normalize) {
+            float len2 = 0;
+            for(u32 c = 0; c < numComponents; c++)
+                len2 += res[c] * res[c];
+            const float invLen = 1 / sqrtf(len2);
+            for(u32 c = 0; c < numComponents; c++)
+                res[c] *= invLen;
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            out[c][i] = res[c];
+    }
+#endif
+}
+
+// the template parameters let the compiler unroll the loops over the components, and remove the tangents when there are no CUBICSPLINE channels
+template <u32 numComponents, bool hermite>
+static void evalChannels(ChannelsBatch& batch, float t)
+{
+    const size_t n = batch.size();
+    Block block;
+    for(size_t first = 0; first < n; first += BLOCK_SIZE) {
+        const size_t count = glm::min(BLOCK_SIZE, n - first);
+        for(size_t j = 0; j < count; j++)
+            gatherKeys<numComponents, hermite>(block, j, batch.channels[first + j], batch.keyInds[first + j], t, batch.normalize);
+        if(count < BLOCK_SIZE)
+            fillEmptyLanes<numComponents>(block, count);
+        float* const out[4] = {
+            batch.out[0].begin() + first, batch.out[1].begin() + first, batch.out[2].begin() + first,
+            numComponents == 4 ? batch.out[3].begin() + first : nullptr,
+        };
+        interpolateBlock<numComponents, hermite>(block, out, batch.normalize);
+    }
+}
+
+// translations and scales are interpolated straight from the keys, see ChannelsBatch
+static void evalVec3Channels(ChannelsBatch& batch, float t)
+{
+    const size_t n = batch.size();
+    for(size_t i = 0; i < n; i++) {
+        const ChannelsBatch::Channel& channel = batch.channels[i];
+        const i32 keyInd = batch.keyInds[i];
+        const i32 numKeys = channel.numKeys;
+        const bool cubic = channel.interpolation == cgltf_interpolation_type_cubic_spline;
+        auto getElem = [&](i32 e) { return (const float*)(channel.values + e * channel.valuesStride); };
+        auto getValue = [&](i32 k) { return getElem(cubic ? 3*k + 1 : k); };
+        auto getTime = [&](i32 k) { return *(const float*)(channel.times + k * channel.timesStride); };
+
+        if(keyInd < 0 || keyInd >= numKeys-1 || channel.interpolation == cgltf_interpolation_type_step) {
+            const float* v = getValue(glm::clamp(keyInd, 0, numKeys-1));
+            for(u32 c = 0; c < 3; c++)
+                batch.out[c][i] = v[c];
+            continue;
+        }
+
+        const float timeA = getTime(keyInd);
+        const float segmentDuration = getTime(keyInd + 1) - timeA;
+        const float s = segmentDuration > 0 ? glm::clamp((t - timeA) / segmentDuration, 0.f, 1.f) : 0.f;
+        const float* vA = getValue(keyInd);
+        const float* vB = getValue(keyInd + 1);
+        if(cubic) {
+            const float* outTangentA = getElem(3*keyInd + 2);
+            const float* inTangentB = getElem(3*(keyInd + 1));
+            const float s2 = s * s;
+            const float s3 = s2 * s;
+            const float h01 = 3 * s2 - 2 * s3;
+            const float h00 = 1 - h01;
+            const float h11 = s3 - s2;
+            const float h10 = h11 - s2 + s;
+            for(u32 c = 0; c < 3; c++)
+                batch.out[c][i] = h00 * vA[c] + h10 * segmentDuration * outTangentA[c] + h01 * vB[c] + h11 * segmentDuration * inTangentB[c];
+        }
+        else {
+            for(u32 c = 0; c < 3; c++)
+                batch.out[c][i] = vA[c] + s * (vB[c] - vA[c]);
+        }
+    }
+}
+
+void evalChannels(ChannelsBatch& batch, float t)
+{
+    if(batch.numComponents == 4)
+        batch.hasCubic ? evalChannels<4, true>(batch, t) : evalChannels<4, false>(batch, t);
+    else
+        evalVec3Channels(batch, t);
+}
+
+static constexpr size_t BAKED_PADDING = 8;
+
+void bakeChannels(BakedChannels& baked, ChannelsBatch& batch, float duration, float rate)
+{
+    assert(rate > 0);
+    const size_t n = batch.size();
+    const u32 numComponents = batch.numComponents;
+    baked.numComponents = numComponents;
+    baked.normalize = batch.normalize;
+    baked.numFrames = u32(ceilf(duration * rate)) + 1;
+    // the rate is raised a bit so the last frame is exactly at the end, and the frame f is always at the time f / baked.rate
+    baked.rate = baked.numFrames > 1 ? (baked.numFrames - 1) / duration : rate;
+    baked.numChannels = n;
+    baked.stride = (n + BAKED_PADDING - 1) & ~(BAKED_PADDING - 1);
+    for(u32 c = 0; c < numComponents; c++) {
+        baked.frames[c].resize(baked.numFrames * baked.stride);
+        baked.out[c].resize(baked.stride);
+    }
+    if(n == 0)
+        return;
+
+    for(size_t i = 0; i < n; i++)
+        batch.keyInds[i] = -1;
+    for(u32 f = 0; f < baked.numFrames; f++) {
+        const float t = glm::min(f / baked.rate, duration);
+        // the time only goes forward, so the keys can be found by stepping
+        for(size_t i = 0; i < n; i++) {
+            const ChannelsBatch::Channel& channel = batch.channels[i];
+            i32& keyInd = batch.keyInds[i];
+            while(keyInd + 1 < channel.numKeys && *(const float*)(channel.times + (keyInd + 1) * channel.timesStride) <= t)
+                keyInd++;
+        }
+        evalChannels(batch, t);
+
+        const size_t frameOffset = f * baked.stride;
+        for(u32 c = 0; c < numComponents; c++) {
+            float* frame = &baked.frames[c][frameOffset];
+            for(size_t i = 0; i < n; i++)
+                frame[i] = batch.out[c][i];
+            // unit quaternions in the padding, so the normalization doesn't divide by zero
+            for(size_t i = n; i < baked.stride; i++)
+                frame[i] = c == 3 ? 1.f : 0.f;
+        }
+        // q and -q are the same rotation. We keep consecutive frames in the same hemisphere, so the nlerp doesn't need to check it
+        if(baked.normalize && f > 0) {
+            for(size_t i = 0; i < n; i++) {
+                float d = 0;
+                for(u32 c = 0; c < numComponents; c++)
+                    d += baked.frames[c][frameOffset + i] * baked.frames[c][frameOffset - baked.stride + i];
+                if(d < 0)
+                    for(u32 c = 0; c < numComponents; c++)
+                        baked.frames[c][frameOffset + i] = -baked.frames[c][frameOffset + i];
+            }
+        }
+    }
+}
+
+void evalBakedChannels(BakedChannels& baked, float t)
+{
+    const u32 numComponents = baked.numComponents;
+    const size_t n = baked.size();
+    if(n == 0 || baked.numFrames == 0)
+        return;
+    const float ft = glm::clamp(t * baked.rate, 0.f, float(baked.numFrames - 1));
+    const u32 f0 = glm::min(u32(ft), baked.numFrames - 1);
+    const u32 f1 = glm::min(f0 + 1, baked.numFrames - 1);
+    const float a = ft - f0;
+    const float* frame0[4];
+    const float* frame1[4];
+    for(u32 c = 0; c < numComponents; c++) {
+        frame0[c] = &baked.frames[c][f0 * baked.stride];
+        frame1[c] = &baked.frames[c][f1 * baked.stride];
+    }
+
+#if defined(ANIM_EVAL_AVX)
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 va = _mm256_set1_ps(a);
+    for(size_t i = 0; i < n; i += 8) {
+        __m256 res[4];
+        for(u32 c = 0; c < numComponents; c++) {
+            const __m256 p0 = _mm256_loadu_ps(frame0[c] + i);
+            const __m256 p1 = _mm256_loadu_ps(frame1[c] + i);
+            res[c] = _mm256_add_ps(p0, _mm256_mul_ps(va, _mm256_sub_ps(p1, p0)));
+        }
+        if(baked.normalize) {
+            __m256 len2 = _mm256_mul_ps(res[0], res[0]);
+            for(u32 c = 1; c < numComponents; c++)
+                len2 = _mm256_add_ps(len2, _mm256_mul_ps(res[c], res[c]));
+            const __m256 invLen = _mm256_div_ps(one, _mm256_sqrt_ps(len2));
+            for(u32 c = 0; c < numComponents; c++)
+                res[c] = _mm256_mul_ps(res[c], invLen);
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            _mm256_storeu_ps(&baked.out[c][i], res[c]);
+    }
+#elif defined(ANIM_EVAL_SSE)
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 va = _mm_set1_ps(a);
+    for(size_t i = 0; i < n; i += 4) {
+        __m128 res[4];
+        for(u32 c = 0; c < numComponents; c++) {
+            const __m128 p0 = _mm_loadu_ps(frame0[c] + i);
+            const __m128 p1 = _mm_loadu_ps(frame1[c] + i);
+            res[c] = _mm_add_ps(p0, _mm_mul_ps(va, _mm_sub_ps(p1, p0)));
+        }
+        if(baked.normalize) {
+            __m128 len2 = _mm_mul_ps(res[0], res[0]);
+            for(u32 c = 1; c < numComponents; c++)
+                len2 = _mm_add_ps(len2, _mm_mul_ps(res[c], res[c]));
+            const __m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(len2));
+            for(u32 c = 0; c < numComponents; c++)
+                res[c] = _mm_mul_ps(res[c], invLen);
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            _mm_storeu_ps(&baked.out[c][i], res[c]);
+    }
+#else
+    for(size_t i = 0; i < n; i++) {
+        float res[4];
+        for(u32 c = 0; c < numComponents; c++)
+            res[c] = frame0[c][i] + a * (frame1[c][i] - frame0[c][i]);
+        if(baked.normalize) {
+            float len2 = 0;
+            for(u32 c = 0; c < numComponents; c++)
+                len2 += res[c] * res[c];
+            const float invLen = 1 / sqrtf(len2);
+            for(u32 c = 0; c < numComponents; c++)
+                res[c] *= invLen;
+        }
+        for(u32 c = 0; c < numComponents; c++)
+            baked.out[c][i] = res[c];
+    }
+#endif
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "utils.hpp"
+
+// animation channels that are interpolated all at once with SIMD
+// the channels are processed in small blocks: the keys of the segment that contains the current time are gathered to SoA arrays that stay in the L1 cache, and then interpolated
+// every interpolation type is done with the cubic Hermite formula of CUBICSPLINE:
+//   LINEAR is the case where both tangents are the difference of the values, and STEP (or being out of the keys range) the case where both ends are the same value
+// translations and scales skip the blocks and are interpolated one channel at a time: without the normalization, the gathering costs more than the SIMD saves
+struct ChannelsBatch {
+    // the accessors of the sampler, resolved once so the gathering doesn't go through the cgltf structures
+    struct Channel {
+        const u8* times;
+        const u8* values; // floats. With CUBICSPLINE each key has 3 elements: in-tangent, value, out-tangent
+        u32 timesStride, valuesStride;
+        i32 numKeys;
+        cgltf_interpolation_type interpolation;
+    };
+
+    u32 numComponents = 3; // 3 for translations and scales, 4 for rotations
+    bool normalize = false; // rotations are normalized after the interpolation, so LINEAR becomes nlerp
+    bool hasCubic = false; // without CUBICSPLINE channels, the interpolation is a simple lerp
+    tl::Vector<Channel> channels;
+    tl::Vector<i32> keyInds; // foreach channel, the last key at or before the time, -1 if the time is before the first key (like anims::curKeyInds)
+    tl::Vector<float> out[4]; // the interpolated values in SoA layout, padded to a multiple of the block size
+
+    size_t size()const { return channels.size(); }
+    void resize(size_t n);
+    void setChannel(size_t i, const cgltf_animation_sampler& sampler); // the output accessor must be float
+    glm::vec3 getVec3(size_t i)const { return {out[0][i], out[1][i], out[2][i]}; }
+    glm::quat getQuat(size_t i)const { return {out[3][i], out[0][i], out[1][i], out[2][i]}; }
+};
+
+// interpolates all the channels at time t, using the current keyInds
+void evalChannels(ChannelsBatch& batch, float t);
+
+// channels resampled at a fixed rate, so evaluating them doesn't depend on the keys: it's a lerp between two consecutive frames (nlerp for rotations)
+// the frames are stored one after another, with the channels of each frame contiguous and padded to a multiple of 8
+// STEP channels get blurred over one frame, and CUBICSPLINE ones become piecewise linear
+struct BakedChannels {
+    u32 numComponents = 3;
+    bool normalize = false;
+    float rate = 30; // frames per second. At least the requested one, adjusted so the last frame is at the duration
+    u32 numFrames = 0;
+    size_t numChannels = 0;
+    size_t stride = 0; // floats between frames
+    tl::Vector<float> frames[4]; // component c of the channel i in the frame f is frames[c][f * stride + i]
+    tl::Vector<float> out[4];
+
+    size_t size()const { return numChannels; }
+    glm::vec3 getVec3(size_t i)const { return {out[0][i], out[1][i], out[2][i]}; }
+    glm::quat getQuat(size_t i)const { return {out[3][i], out[0][i], out[1][i], out[2][i]}; }
+};
+
+// samples the channels of the batch in [0, duration], at the given rate or a slightly higher one. The keyInds and outputs of the batch are overwritten
+void bakeChannels(BakedChannels& baked, ChannelsBatch& batch, float duration, float rate);
+
+// out = the values of all the channels at time t
+void evalBakedChannels(BakedChannels& baked, float t);
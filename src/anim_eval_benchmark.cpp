@@ -0,0 +1,206 @@
+#include "benchmark.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <glm/common.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "anim_eval.hpp"
+
+static constexpr u32 NUM_KEYS = 64;
+static constexpr float KEY_DURATION = 1.f / 30;
+static constexpr float BAKE_RATE = 30;
+
+namespace
+{
+// one sampler per channel, all of them sharing the input accessor like it's usual in exported files
+struct SyntheticChannels {
+    tl::Vector<float> data; // the key times, followed by the outputs of the samplers
+    cgltf_buffer buffer;
+    cgltf_buffer_view view;
+    cgltf_accessor input;
+    tl::Vector<cgltf_accessor> outputs;
+    tl::Vector<cgltf_animation_sampler> samplers;
+};
+}
+
+// the values of each channel do a random walk, so consecutive keys are close like in real animations
+static void makeSyntheticChannels(SyntheticChannels& s, u32 numChannels, u32 numComponents, cgltf_interpolation_type interp,
+    u32 numKeys = NUM_KEYS, float keyDuration = KEY_DURATION)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1, 1);
+    const bool cubic = interp == cgltf_interpolation_type_cubic_spline;
+    const u32 elemsPerKey = cubic ? 3 : 1;
+    const u32 floatsPerSampler = numKeys * elemsPerKey * numComponents;
+    s.data.resize(numKeys + numChannels * floatsPerSampler);
+    for(u32 k = 0; k < numKeys; k++)
+        s.data[k] = k * keyDuration;
+    for(u32 i = 0; i < numChannels; i++) {
+        float* out = &s.data[numKeys + i * floatsPerSampler];
+        float v[4] = {0, 0, 0, 1};
+        for(u32 k = 0; k < numKeys; k++) {
+            float len2 = 0;
+            for(u32 c = 0; c < numComponents; c++) {
+                v[c] += 0.1f * dist(rng);
+                len2 += v[c] * v[c];
+            }
+            if(numComponents == 4) // unit quaternions
+                for(u32 c = 0; c < 4; c++)
+                    v[c] /= sqrtf(len2);
+            for(u32 e = 0; e < elemsPerKey; e++)
+                for(u32 c = 0; c < numComponents; c++)
+                    out[(k * elemsPerKey + e) * numComponents + c] = cubic && e != 1 ? dist(rng) : v[c];
+        }
+    }
+
+    memset(&s.buffer, 0, sizeof(s.buffer));
+    s.buffer.data = s.data.begin();
+    s.buffer.size = s.data.size() * sizeof(float);
+    memset(&s.view, 0, sizeof(s.view));
+    s.view.buffer = &s.buffer;
+    s.view.size = s.buffer.size;
+    memset(&s.input, 0, sizeof(s.input));
+    s.input.component_type = cgltf_component_type_r_32f;
+    s.input.type = cgltf_type_scalar;
+    s.input.count = numKeys;
+    s.input.stride = sizeof(float);
+    s.input.buffer_view = &s.view;
+    s.outputs.resize(numChannels);
+    s.samplers.resize(numChannels);
+    for(u32 i = 0; i < numChannels; i++) {
+        cgltf_accessor& output = s.outputs[i];
+        memset(&output, 0, sizeof(output));
+        output.component_type = cgltf_component_type_r_32f;
+        output.type = numComponents == 4 ? cgltf_type_vec4 : cgltf_type_vec3;
+        output.offset = (numKeys + i * floatsPerSampler) * sizeof(float);
+        output.count = numKeys * elemsPerKey;
+        output.stride = numComponents * sizeof(float);
+        output.buffer_view = &s.view;
+        cgltf_animation_sampler& sampler = s.samplers[i];
+        memset(&sampler, 0, sizeof(sampler));
+        sampler.input = &s.input;
+        sampler.output = &output;
+        sampler.interpolation = interp;
+    }
+}
+
+// one channel at a time, reading the accessors like the viewer did before ChannelsBatch (slerp for LINEAR rotations)
+static glm::vec4 evalChannelScalar(const cgltf_animation_sampler& sampler, u32 numComponents, i32 keyInd, float t)
+{
+    const bool cubic = sampler.interpolation == cgltf_interpolation_type_cubic_spline;
+    auto getElem = [&](i32 i) {
+        const float* p = (const float*)cgltfAccessAccessor(*sampler.output, i);
+        return glm::vec4(p[0], p[1], p[2], numComponents == 4 ? p[3] : 0);
+    };
+    const float timeA = *(const float*)cgltfAccessAccessor(*sampler.input, keyInd);
+    const float timeB = *(const float*)cgltfAccessAccessor(*sampler.input, keyInd + 1);
+    const float td = timeB - timeA;
+    const float s = (t - timeA) / td;
+    if(cubic) {
+        const float s2 = s * s, s3 = s2 * s;
+        glm::vec4 r =
+            (2*s3 - 3*s2 + 1) * getElem(3*keyInd + 1) + td * (s3 - 2*s2 + s) * getElem(3*keyInd + 2) +
+            (-2*s3 + 3*s2) * getElem(3*keyInd + 4) + td * (s3 - s2) * getElem(3*keyInd + 3);
+        return numComponents == 4 ? glm::normalize(r) : r;
+    }
+    const glm::vec4 a = getElem(keyInd), b = getElem(keyInd + 1);
+    if(numComponents == 4) {
+        const glm::quat q = glm::slerp(glm::quat(a.w, a.x, a.y, a.z), glm::quat(b.w, b.x, b.y, b.z), s);
+        return {q.x, q.y, q.z, q.w};
+    }
+    return glm::mix(a, b, s);
+}
+
+int runAnimEvalBenchmark()
+{
+    printf("throughput in channels per microsecond\n");
+    printf("%12s %10s %10s %16s %10s %10s %10s %14s\n", "interp", "type", "channels", "one at a time", "batched", "speedup", "max diff", "baked 30 Hz");
+    SyntheticChannels s;
+    ChannelsBatch batch;
+    BakedChannels baked;
+    tl::Vector<glm::vec4> reference;
+    for(u32 numChannels : {1'000u, 100'000u}) {
+        const u32 numRuns = std::max(5u, 2'000'000 / numChannels);
+        reference.resize(numChannels);
+        for(cgltf_interpolation_type interp : {cgltf_interpolation_type_linear, cgltf_interpolation_type_cubic_spline}) {
+            for(u32 numComponents : {3u, 4u}) {
+                makeSyntheticChannels(s, numChannels, numComponents, interp);
+                // in the middle of a segment, so all the channels do the full interpolation
+                const i32 keyInd = NUM_KEYS / 2;
+                const float t = (keyInd + 0.37f) * KEY_DURATION;
+
+                const double scalarMs = measureMs(numRuns, [&] {
+                    for(u32 i = 0; i < numChannels; i++)
+                        reference[i] = evalChannelScalar(s.samplers[i], numComponents, keyInd, t);
+                });
+
+                // like in anims::initAnim()
+                batch.numComponents = numComponents;
+                batch.normalize = numComponents == 4;
+                batch.resize(numChannels);
+                for(u32 i = 0; i < numChannels; i++)
+                    batch.setChannel(i, s.samplers[i]);
+                const double batchedMs = measureMs(numRuns, [&] {
+                    for(u32 i = 0; i < numChannels; i++)
+                        batch.keyInds[i] = keyInd;
+                    evalChannels(batch, t);
+                });
+
+                float maxDiff = 0;
+                for(u32 i = 0; i < numChannels; i++)
+                    for(u32 c = 0; c < numComponents; c++)
+                        maxDiff = std::max(maxDiff, fabsf(batch.out[c][i] - reference[i][c]));
+
+                // it overwrites the outputs of the batch
+                bakeChannels(baked, batch, (NUM_KEYS - 1) * KEY_DURATION, BAKE_RATE);
+                const double bakedMs = measureMs(numRuns, [&] {
+                    evalBakedChannels(baked, t);
+                });
+
+                auto perUs = [&](double ms) { return numChannels / (ms * 1000); };
+                printf("%12s %10s %10u %16.1f %10.1f %9.2fx %10g %14.1f\n",
+                    interp == cgltf_interpolation_type_linear ? "LINEAR" : "CUBICSPLINE", numComponents == 4 ? "rotation" : "vec3",
+                    numChannels, perUs(scalarMs), perUs(batchedMs), scalarMs / batchedMs, maxDiff, perUs(bakedMs));
+            }
+        }
+    }
+    printf("LINEAR rotations: the batched path uses nlerp, the other one slerp\n");
+
+    // playing an animation from start to end, with more and more keys per second
+    const u32 numChannels = 1000;
+    const float duration = 4;
+    const u32 numPlaybackFrames = u32(duration * 60);
+    printf("\nplayback of %u LINEAR rotation channels during %g s at 60 fps, microseconds per frame\n", numChannels, duration);
+    printf("%16s %10s %10s\n", "keys per second", "keyed", "baked");
+    for(u32 keysPerSecond : {30u, 240u, 1920u}) {
+        makeSyntheticChannels(s, numChannels, 4, cgltf_interpolation_type_linear, u32(duration * keysPerSecond) + 1, 1.f / keysPerSecond);
+        batch.numComponents = 4;
+        batch.normalize = true;
+        batch.resize(numChannels);
+        for(u32 i = 0; i < numChannels; i++)
+            batch.setChannel(i, s.samplers[i]);
+        // the keys are found by stepping, like during the normal playback in anims::update()
+        const double keyedMs = measureMs(5, [&] {
+            for(u32 i = 0; i < numChannels; i++)
+                batch.keyInds[i] = -1;
+            for(u32 frame = 0; frame < numPlaybackFrames; frame++) {
+                const float t = frame / 60.f;
+                for(u32 i = 0; i < numChannels; i++) {
+                    const cgltf_accessor& input = *s.samplers[i].input;
+                    i32& keyInd = batch.keyInds[i];
+                    while(keyInd + 1 < (i32)input.count && *(const float*)cgltfAccessAccessor(input, keyInd + 1) <= t)
+                        keyInd++;
+                }
+                evalChannels(batch, t);
+            }
+        });
+        bakeChannels(baked, batch, duration, BAKE_RATE);
+        const double bakedMs = measureMs(5, [&] {
+            for(u32 frame = 0; frame < numPlaybackFrames; frame++)
+                evalBakedChannels(baked, frame / 60.f);
+        });
+        printf("%16u %10.2f %10.2f\n", keysPerSecond, 1000 * keyedMs / numPlaybackFrames, 1000 * bakedMs / numPlaybackFrames);
+    }
+    return 0;
+}
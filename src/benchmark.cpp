@@ -0,0 +1,178 @@
+#include "benchmark.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <tl/containers/vector.hpp>
+#include "scene.hpp"
+#include "gl_debug.hpp"
+
+static constexpr float FRAME_DT = 1.f / 60; // the animation advances this much every frame, no matter how long the frame took
+static constexpr u32 NUM_GPU_QUERIES = 4; // we read the timer of a frame this many frames later, so we don't stall waiting for the GPU
+
+struct Percentiles { float p50, p95, p99; };
+
+// nearest-rank percentiles. The samples get sorted
+static Percentiles calcPercentiles(tl::Vector<float>& samples)
+{
+    if(samples.size() == 0)
+        return {0, 0, 0};
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](float p) {
+        const size_t rank = (size_t)ceilf(p * samples.size());
+        return samples[std::min(samples.size(), std::max<size_t>(rank, 1)) - 1];
+    };
+    return {at(0.5f), at(0.95f), at(0.99f)};
+}
+
+static bool writeReportJson(const char* path, const BenchmarkOptions& options, const LoadReport& load,
+    const Percentiles& cpu, const Percentiles& gpu, u32 minDrawCalls, u32 maxDrawCalls, double avgDrawCalls,
+    double avgVisiblePrims, double avgCulledPrims)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+        return false;
+    fprintf(file, "{\n");
+    fprintf(file, "  \"frames\": %u,\n", options.numFrames);
+    fprintf(file, "  \"width\": %d,\n", options.width);
+    fprintf(file, "  \"height\": %d,\n", options.height);
+    fprintf(file, "  \"loadMs\": %.3f,\n", 1000. * load.totalSeconds);
+    fprintf(file, "  \"sceneReadyMs\": %.3f,\n", 1000. * load.sceneReadySeconds);
+    fprintf(file, "  \"cpuMs\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f},\n", cpu.p50, cpu.p95, cpu.p99);
+    fprintf(file, "  \"gpuMs\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f},\n", gpu.p50, gpu.p95, gpu.p99);
+    fprintf(file, "  \"drawCalls\": {\"min\": %u, \"max\": %u, \"avg\": %.2f},\n", minDrawCalls, maxDrawCalls, avgDrawCalls);
+    fprintf(file, "  \"primitives\": {\"avgVisible\": %.2f, \"avgCulled\": %.2f}\n", avgVisiblePrims, avgCulledPrims);
+    fprintf(file, "}\n");
+    return fclose(file) == 0;
+}
+
+int runBenchmark(const BenchmarkOptions& options)
+{
+    const int w = options.width;
+    const int h = options.height;
+    u32 fbo, rbos[2];
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(2, rbos);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbos[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbos[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbos[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbos[1]);
+    auto freeFramebuffer = [&] {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(2, rbos);
+    };
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "benchmark: couldn't create a %dx%d framebuffer\n", w, h);
+        freeFramebuffer();
+        return BENCHMARK_FRAMEBUFFER_FAILED;
+    }
+    glViewport(0, 0, w, h);
+    glScissor(0, 0, w, h);
+
+    // the loading is asynchronous. We wait until all the textures have been uploaded, so they don't disturb the measurements
+    loadGltf(options.gltfPath);
+    while(isLoadingGltf()) {
+        update(0);
+        gl_debug::endFrame();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const LoadReport* loadReport = getLastLoadReport();
+    if(loadReport == nullptr) {
+        fprintf(stderr, "benchmark: couldn't load %s\n", options.gltfPath);
+        freeFramebuffer();
+        return BENCHMARK_LOAD_FAILED;
+    }
+    const bool playingAnim = playAnimation(options.animInd);
+
+    u32 queries[NUM_GPU_QUERIES];
+    glGenQueries(NUM_GPU_QUERIES, queries);
+    tl::Vector<float> cpuMs, gpuMs;
+    cpuMs.reserve(options.numFrames);
+    gpuMs.reserve(options.numFrames);
+    u32 minDrawCalls = ~0u, maxDrawCalls = 0;
+    u64 sumDrawCalls = 0;
+    u64 sumVisiblePrims = 0, sumCulledPrims = 0;
+#ifdef GLAD_DEBUG
+    u64 sumGlCalls = 0;
+#endif
+    auto readGpuTime = [&](u32 frame) {
+        u64 ns;
+        glGetQueryObjectui64v(queries[frame % NUM_GPU_QUERIES], GL_QUERY_RESULT, &ns);
+        gpuMs.push_back(1e-6f * ns);
+    };
+
+    const u32 numFrames = options.numWarmupFrames + options.numFrames;
+    for(u32 frame = 0; frame < numFrames; frame++)
+    {
+        const bool measured = frame >= options.numWarmupFrames;
+        const u32 measuredFrame = frame - options.numWarmupFrames;
+        if(measured && measuredFrame >= NUM_GPU_QUERIES)
+            readGpuTime(measuredFrame - NUM_GPU_QUERIES); // also keeps the CPU from getting too far ahead of the GPU
+
+        setOrbitCameraPath(measured ? float(measuredFrame) / options.numFrames : 0.f);
+        const double t0 = glfwGetTime();
+        if(measured)
+            glBeginQuery(GL_TIME_ELAPSED, queries[measuredFrame % NUM_GPU_QUERIES]);
+        update(FRAME_DT);
+        drawScene(w, h);
+        if(measured)
+            glEndQuery(GL_TIME_ELAPSED);
+        glFlush();
+        const double t1 = glfwGetTime();
+        gl_debug::endFrame();
+
+        if(measured) {
+            cpuMs.push_back(float(1000 * (t1 - t0)));
+            const u32 drawCalls = getNumDrawCalls();
+            minDrawCalls = std::min(minDrawCalls, drawCalls);
+            maxDrawCalls = std::max(maxDrawCalls, drawCalls);
+            sumDrawCalls += drawCalls;
+            const CullingStats culling = getCullingStats();
+            sumVisiblePrims += culling.visiblePrims;
+            sumCulledPrims += culling.culledPrims;
+#ifdef GLAD_DEBUG
+            sumGlCalls += gl_debug::numCallsLastFrame();
+#endif
+        }
+    }
+    for(u32 frame = options.numFrames > NUM_GPU_QUERIES ? options.numFrames - NUM_GPU_QUERIES : 0; frame < options.numFrames; frame++)
+        readGpuTime(frame);
+    glDeleteQueries(NUM_GPU_QUERIES, queries);
+    freeFramebuffer();
+
+    const Percentiles cpu = calcPercentiles(cpuMs);
+    const Percentiles gpu = calcPercentiles(gpuMs);
+    if(options.numFrames == 0)
+        minDrawCalls = 0;
+    const double avgDrawCalls = options.numFrames ? double(sumDrawCalls) / options.numFrames : 0;
+    const double avgVisiblePrims = options.numFrames ? double(sumVisiblePrims) / options.numFrames : 0;
+    const double avgCulledPrims = options.numFrames ? double(sumCulledPrims) / options.numFrames : 0;
+    printf("benchmark: %s, %u frames at %dx%d, animation: %s\n", options.gltfPath, options.numFrames, w, h,
+        playingAnim ? "yes" : "no");
+    printf("load: %.1f ms (scene displayed after %.1f ms)\n", 1000. * loadReport->totalSeconds, 1000. * loadReport->sceneReadySeconds);
+    printf("cpu frame ms: p50 %.3f | p95 %.3f | p99 %.3f\n", cpu.p50, cpu.p95, cpu.p99);
+    printf("gpu frame ms: p50 %.3f | p95 %.3f | p99 %.3f\n", gpu.p50, gpu.p95, gpu.p99);
+    printf("draw calls per frame: min %u | max %u | avg %.1f\n", minDrawCalls, maxDrawCalls, avgDrawCalls);
+    printf("primitives per frame: visible %.1f | frustum culled %.1f\n", avgVisiblePrims, avgCulledPrims);
+#ifdef GLAD_DEBUG
+    printf("GL calls per frame: avg %.1f (GL debug mode: %s)\n", options.numFrames ? double(sumGlCalls) / options.numFrames : 0.,
+        gl_debug::toStr(gl_debug::mode()).c_str());
+#endif
+    if(options.reportPath) {
+        if(!writeReportJson(options.reportPath, options, *loadReport, cpu, gpu, minDrawCalls, maxDrawCalls, avgDrawCalls,
+            avgVisiblePrims, avgCulledPrims))
+        {
+            fprintf(stderr, "benchmark: couldn't write %s\n", options.reportPath);
+            return BENCHMARK_REPORT_FAILED;
+        }
+    }
+    return BENCHMARK_OK;
+}
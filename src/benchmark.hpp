@@ -0,0 +1,47 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#include <algorithm>
+#include <chrono>
+
+// headless benchmark: loads a scene and renders it offscreen, following a deterministic camera path and playing an animation
+// the OpenGL context must be current. Returns the exit code of the program
+struct BenchmarkOptions {
+    const char* gltfPath;
+    u32 numFrames = 1000;
+    u32 numWarmupFrames = 10; // rendered before the measured frames, not counted
+    int width = 1280, height = 720;
+    int animInd = 0; // the animation to play, -1 for none
+    const char* reportPath = nullptr; // if not null, the results are also written to this JSON file
+};
+
+enum EBenchmarkResult : int {
+    BENCHMARK_OK = 0,
+    BENCHMARK_LOAD_FAILED = 1,
+    BENCHMARK_FRAMEBUFFER_FAILED = 2,
+    BENCHMARK_REPORT_FAILED = 3,
+};
+
+int runBenchmark(const BenchmarkOptions& options);
+
+// microbenchmark of the node transforms: NodeHierarchy against the recursion over the cgltf nodes, with synthetic hierarchies of 10K to 1M nodes
+// doesn't need OpenGL. Returns the exit code of the program
+int runTransformsBenchmark();
+
+// microbenchmark of the animation channels: ChannelsBatch against evaluating one channel at a time, for LINEAR and CUBICSPLINE, and BakedChannels
+// doesn't need OpenGL. Returns the exit code of the program
+int runAnimEvalBenchmark();
+
+// the minimum of several runs, in milliseconds. Used by the microbenchmarks
+template <typename Fn>
+double measureMs(u32 numRuns, Fn&& fn)
+{
+    double best = 1e30;
+    for(u32 run = 0; run < numRuns; run++) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        const auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return best;
+}
@@ -0,0 +1,206 @@
+#include "bvh.hpp"
+
+#include <float.h>
+#include <assert.h>
+#include <algorithm>
+#include "thread_pool.hpp"
+
+static constexpr u32 NUM_BINS = 16;
+static constexpr u32 MAX_LEAF_PRIMS = 4;
+static constexpr float TRAVERSAL_COST = 1.f; // relative to the cost of intersecting a primitive
+static constexpr u32 MAX_SAH_DEPTH = 48; // deeper than this we split by the median, which guarantees log2(n) more levels at most
+static constexpr u32 MIN_PARALLEL_PRIMS = 16 * 1024; // bigger subtrees are built in a separate job
+
+namespace
+{
+struct BuildContext {
+    tl::CSpan<Aabb> primBoxes;
+    tl::Vector<glm::vec3> centroids;
+    tl::Span<u32> primInds;
+    ThreadPool* pool;
+};
+}
+
+static float surfaceArea(const Aabb& box)
+{
+    const glm::vec3 d = box.pMax - box.pMin;
+    return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static void setNodeBox(BvhNode& node, const Aabb& box)
+{
+    node.pMin = box.pMin;
+    node.pMax = box.pMax;
+}
+
+// splits the range by the median along the longest axis of the centroids
+static u32 medianSplit(BuildContext& ctx, u32 first, u32 count, const Aabb& centroidsBox)
+{
+    const glm::vec3 extent = centroidsBox.pMax - centroidsBox.pMin;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    u32* begin = ctx.primInds.begin() + first;
+    std::nth_element(begin, begin + count / 2, begin + count, [&ctx, axis](u32 a, u32 b) {
+        return ctx.centroids[a][axis] < ctx.centroids[b][axis];
+    });
+    return first + count / 2;
+}
+
+// returns the first primitive of the right child, or "first" if it's better to make a leaf
+static u32 sahSplit(BuildContext& ctx, u32 first, u32 count, const Aabb& box, const Aabb& centroidsBox)
+{
+    struct Bin { Aabb box; u32 count; };
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    u32 bestBin = 0;
+    for(int axis = 0; axis < 3; axis++)
+    {
+        const float minC = centroidsBox.pMin[axis];
+        const float extent = centroidsBox.pMax[axis] - minC;
+        if(extent <= 0)
+            continue;
+        const float scale = NUM_BINS / extent;
+        Bin bins[NUM_BINS];
+        for(Bin& bin : bins)
+            bin = {Aabb::UNDEF(), 0};
+        for(u32 i = first; i < first + count; i++) {
+            const u32 primInd = ctx.primInds[i];
+            const u32 binInd = glm::min(NUM_BINS - 1, u32((ctx.centroids[primInd][axis] - minC) * scale));
+            bins[binInd].box = makeUnion(bins[binInd].box, ctx.primBoxes[primInd]);
+            bins[binInd].count++;
+        }
+        // sweep from the right to know the cost of the right side of each split, then from the left
+        float rightCosts[NUM_BINS - 1];
+        Aabb accumBox = Aabb::UNDEF();
+        u32 accumCount = 0;
+        for(u32 i = NUM_BINS - 1; i > 0; i--) {
+            accumBox = makeUnion(accumBox, bins[i].box);
+            accumCount += bins[i].count;
+            rightCosts[i - 1] = accumCount ? accumCount * surfaceArea(accumBox) : 0;
+        }
+        accumBox = Aabb::UNDEF();
+        accumCount = 0;
+        for(u32 i = 0; i < NUM_BINS - 1; i++) {
+            accumBox = makeUnion(accumBox, bins[i].box);
+            accumCount += bins[i].count;
+            if(accumCount == 0 || accumCount == count)
+                continue;
+            const float cost = accumCount * surfaceArea(accumBox) + rightCosts[i];
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = i;
+            }
+        }
+    }
+
+    if(bestAxis == -1) // all the centroids are in the same place
+        return count <= MAX_LEAF_PRIMS ? first : medianSplit(ctx, first, count, centroidsBox);
+    const float area = surfaceArea(box);
+    const float splitCost = TRAVERSAL_COST * area + bestCost;
+    const float leafCost = count * area;
+    if(count <= MAX_LEAF_PRIMS && leafCost <= splitCost)
+        return first;
+
+    const float minC = centroidsBox.pMin[bestAxis];
+    const float scale = NUM_BINS / (centroidsBox.pMax[bestAxis] - minC);
+    u32* begin = ctx.primInds.begin() + first;
+    u32* mid = std::partition(begin, begin + count, [&](u32 primInd) {
+        return glm::min(NUM_BINS - 1, u32((ctx.centroids[primInd][bestAxis] - minC) * scale)) <= bestBin;
+    });
+    return first + u32(mid - begin);
+}
+
+// builds the subtree of the primitives [first, first + count), with its root at nodes[rootInd]
+static void buildSubtree(BuildContext& ctx, tl::Vector<BvhNode>& nodes, u32 rootInd, u32 first, u32 count, u32 depth)
+{
+    Aabb box = Aabb::UNDEF();
+    Aabb centroidsBox = Aabb::UNDEF();
+    for(u32 i = first; i < first + count; i++) {
+        const u32 primInd = ctx.primInds[i];
+        box = makeUnion(box, ctx.primBoxes[primInd]);
+        centroidsBox.pMin = glm::min(centroidsBox.pMin, ctx.centroids[primInd]);
+        centroidsBox.pMax = glm::max(centroidsBox.pMax, ctx.centroids[primInd]);
+    }
+    setNodeBox(nodes[rootInd], box);
+
+    u32 mid = first;
+    if(count > 1)
+        mid = depth < MAX_SAH_DEPTH ? sahSplit(ctx, first, count, box, centroidsBox) : medianSplit(ctx, first, count, centroidsBox);
+    if(mid == first) {
+        nodes[rootInd].firstOrLeft = first;
+        nodes[rootInd].count = count;
+        return;
+    }
+
+    const u32 leftInd = nodes.size();
+    nodes[rootInd].firstOrLeft = leftInd;
+    nodes[rootInd].count = 0;
+    nodes.resize(leftInd + 2);
+    const u32 rightFirst = mid;
+    const u32 rightCount = first + count - mid;
+    if(ctx.pool == nullptr || rightCount < MIN_PARALLEL_PRIMS) {
+        buildSubtree(ctx, nodes, leftInd, first, mid - first, depth + 1);
+        buildSubtree(ctx, nodes, leftInd + 1, rightFirst, rightCount, depth + 1);
+        return;
+    }
+
+    // the right subtree is built by another thread into its own array, and then appended to ours
+    tl::Vector<BvhNode> rightNodes;
+    rightNodes.resize(1);
+    JobCounter counter;
+    ctx.pool->push([&ctx, &rightNodes, rightFirst, rightCount, depth] {
+        buildSubtree(ctx, rightNodes, 0, rightFirst, rightCount, depth + 1);
+    }, &counter);
+    buildSubtree(ctx, nodes, leftInd, first, mid - first, depth + 1);
+    ctx.pool->wait(counter);
+
+    // the root of rightNodes goes to the slot we reserved, the rest to the end
+    const u32 offset = nodes.size() - 1;
+    const u32 numRightNodes = rightNodes.size();
+    for(BvhNode& node : rightNodes)
+        if(!node.isLeaf())
+            node.firstOrLeft += offset;
+    nodes[leftInd + 1] = rightNodes[0];
+    nodes.resize(offset + numRightNodes);
+    for(u32 i = 1; i < numRightNodes; i++)
+        nodes[offset + i] = rightNodes[i];
+}
+
+void buildBvh(Bvh& bvh, tl::CSpan<Aabb> primBoxes, ThreadPool* pool)
+{
+    const u32 numPrims = primBoxes.size();
+    bvh.nodes.resize(0);
+    bvh.primInds.resize(numPrims);
+    if(numPrims == 0)
+        return;
+    BuildContext ctx;
+    ctx.primBoxes = primBoxes;
+    ctx.centroids.resize(numPrims);
+    for(u32 i = 0; i < numPrims; i++) {
+        ctx.centroids[i] = 0.5f * (primBoxes[i].pMin + primBoxes[i].pMax);
+        bvh.primInds[i] = i;
+    }
+    ctx.primInds = bvh.primInds;
+    ctx.pool = pool;
+    bvh.nodes.reserve(2 * (numPrims / MAX_LEAF_PRIMS) + 1);
+    bvh.nodes.resize(1);
+    buildSubtree(ctx, bvh.nodes, 0, 0, numPrims, 0);
+}
+
+void refitBvh(Bvh& bvh, tl::CSpan<Aabb> primBoxes)
+{
+    // the children are always after their parent, so going backwards we have them updated when we reach the parent
+    for(size_t nodeInd = bvh.nodes.size(); nodeInd-- > 0; )
+    {
+        BvhNode& node = bvh.nodes[nodeInd];
+        Aabb box = Aabb::UNDEF();
+        if(node.isLeaf()) {
+            for(u32 i = node.firstOrLeft; i < node.firstOrLeft + node.count; i++)
+                box = makeUnion(box, primBoxes[bvh.primInds[i]]);
+        }
+        else {
+            box = makeUnion(bvh.nodes[node.firstOrLeft].box(), bvh.nodes[node.firstOrLeft + 1].box());
+        }
+        setNodeBox(node, box);
+    }
+}
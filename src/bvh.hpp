@@ -0,0 +1,122 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+#include <tl/span.hpp>
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include "utils.hpp"
+
+class ThreadPool;
+
+// node of a bounding volume hierarchy
+// the children of a node are always stored after it, and the two children of an internal node are next to each other
+struct BvhNode {
+    glm::vec3 pMin;
+    u32 firstOrLeft; // leaf: first element of its range in Bvh::primInds. Internal: index of the left child, the right one is the next
+    glm::vec3 pMax;
+    u32 count; // of primitives of a leaf, 0 for the internal nodes
+
+    bool isLeaf()const { return count != 0; }
+    Aabb box()const { return Aabb(pMin, pMax); }
+};
+
+// BVH over generic primitives, which are only known by their bounding boxes
+struct Bvh {
+    tl::Vector<BvhNode> nodes; // the root is the first one. Empty if there are no primitives
+    tl::Vector<u32> primInds; // the leaves point to ranges of this
+
+    Aabb rootBox()const { return nodes.size() ? nodes[0].box() : Aabb::UNDEF(); }
+};
+
+// binned SAH build. If a thread pool is given, the subtrees of the big nodes are built in parallel
+void buildBvh(Bvh& bvh, tl::CSpan<Aabb> primBoxes, ThreadPool* pool = nullptr);
+
+// recomputes the boxes of the nodes, keeping the structure. It's much cheaper than a rebuild,
+// but the quality gets worse as the primitives move away from where they were when the BVH was built
+void refitBvh(Bvh& bvh, tl::CSpan<Aabb> primBoxes);
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 dir; // doesn't need to be normalized, the distances along the ray are in units of dir
+};
+
+// returns the distance at which the ray enters the box, or a negative value if it doesn't hit it before tMax
+inline float intersectRayAabb(const glm::vec3& origin, const glm::vec3& invDir, const glm::vec3& pMin, const glm::vec3& pMax, float tMax)
+{
+    const glm::vec3 t0 = (pMin - origin) * invDir;
+    const glm::vec3 t1 = (pMax - origin) * invDir;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    const float tEnter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+    const float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+    return tEnter <= tExit ? tEnter : -1.f;
+}
+
+// Möller-Trumbore. Both faces are hit
+inline bool intersectRayTriangle(const Ray& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& t)
+{
+    const glm::vec3 e1 = v1 - v0;
+    const glm::vec3 e2 = v2 - v0;
+    const glm::vec3 p = glm::cross(ray.dir, e2);
+    const float det = glm::dot(e1, p);
+    if(det == 0)
+        return false; // parallel or degenerate
+    const float invDet = 1.f / det;
+    const glm::vec3 s = ray.origin - v0;
+    const float u = invDet * glm::dot(s, p);
+    if(u < 0 || u > 1)
+        return false;
+    const glm::vec3 q = glm::cross(s, e1);
+    const float v = invDet * glm::dot(ray.dir, q);
+    if(v < 0 || u + v > 1)
+        return false;
+    t = invDet * glm::dot(e2, q);
+    return t >= 0;
+}
+
+constexpr u32 BVH_MAX_DEPTH = 96; // the build switches to median splits when it gets deep, so the traversal stack can't overflow
+
+// calls "intersectPrim(primInd, tMax)" for the primitives of the leaves that the ray hits before tMax, nearest leaves first
+// intersectPrim must lower tMax when it finds a hit, so the farther nodes can be skipped
+template <typename IntersectPrimFn>
+void traverseBvh(const Bvh& bvh, const Ray& ray, float& tMax, IntersectPrimFn&& intersectPrim)
+{
+    if(bvh.nodes.size() == 0)
+        return;
+    const glm::vec3 invDir = 1.f / ray.dir;
+    struct StackEntry { u32 nodeInd; float tEnter; };
+    StackEntry stack[BVH_MAX_DEPTH];
+    u32 stackSize = 0;
+    const BvhNode& root = bvh.nodes[0];
+    const float tRoot = intersectRayAabb(ray.origin, invDir, root.pMin, root.pMax, tMax);
+    if(tRoot < 0)
+        return;
+    stack[stackSize++] = {0, tRoot};
+    while(stackSize) {
+        const StackEntry entry = stack[--stackSize];
+        if(entry.tEnter > tMax)
+            continue; // we found a closer hit after pushing this one
+        const BvhNode& node = bvh.nodes[entry.nodeInd];
+        if(node.isLeaf()) {
+            for(u32 i = node.firstOrLeft; i < node.firstOrLeft + node.count; i++)
+                intersectPrim(bvh.primInds[i], tMax);
+            continue;
+        }
+        const u32 leftInd = node.firstOrLeft;
+        const BvhNode& left = bvh.nodes[leftInd];
+        const BvhNode& right = bvh.nodes[leftInd + 1];
+        const float tLeft = intersectRayAabb(ray.origin, invDir, left.pMin, left.pMax, tMax);
+        const float tRight = intersectRayAabb(ray.origin, invDir, right.pMin, right.pMax, tMax);
+        // the nearest child is pushed last, so it's visited first
+        if(tLeft >= 0 && tRight >= 0) {
+            const bool leftFirst = tLeft <= tRight;
+            stack[stackSize++] = leftFirst ? StackEntry{leftInd + 1, tRight} : StackEntry{leftInd, tLeft};
+            stack[stackSize++] = leftFirst ? StackEntry{leftInd, tLeft} : StackEntry{leftInd + 1, tRight};
+        }
+        else if(tLeft >= 0)
+            stack[stackSize++] = {leftInd, tLeft};
+        else if(tRight >= 0)
+            stack[stackSize++] = {leftInd + 1, tRight};
+    }
+}
@@ -0,0 +1,130 @@
+#include "culling.hpp"
+
+#include <float.h>
+#include <assert.h>
+#include <glm/common.hpp>
+
+#if defined(__AVX__)
+    #define CULLING_AVX
+    #include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define CULLING_SSE
+    #include <xmmintrin.h>
+#endif
+
+static constexpr size_t PADDING = 8;
+
+void AabbsSoa::resize(size_t n)
+{
+    numBoxes = n;
+    const size_t paddedSize = (n + PADDING - 1) & ~(PADDING - 1);
+    for(tl::Vector<float>* v : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+        v->resize(paddedSize);
+    for(size_t i = 0; i < paddedSize; i++) {
+        minX[i] = minY[i] = minZ[i] = +FLT_MAX;
+        maxX[i] = maxY[i] = maxZ[i] = -FLT_MAX;
+    }
+}
+
+void AabbsSoa::set(size_t i, const Aabb& box)
+{
+    assert(i < numBoxes);
+    minX[i] = box.pMin.x; minY[i] = box.pMin.y; minZ[i] = box.pMin.z;
+    maxX[i] = box.pMax.x; maxY[i] = box.pMax.y; maxZ[i] = box.pMax.z;
+}
+
+Aabb AabbsSoa::get(size_t i)const
+{
+    assert(i < numBoxes);
+    return Aabb({minX[i], minY[i], minZ[i]}, {maxX[i], maxY[i], maxZ[i]});
+}
+
+void AabbsSoa::setInfinite(size_t i)
+{
+    set(i, Aabb(glm::vec3(-FLT_MAX), glm::vec3(+FLT_MAX)));
+}
+
+Frustum extractFrustum(const glm::mat4& m)
+{
+    // Gribb-Hartmann: the planes are sums and differences of the rows of the matrix (glm matrices are column-major)
+    const glm::vec4 row0 = {m[0][0], m[1][0], m[2][0], m[3][0]};
+    const glm::vec4 row1 = {m[0][1], m[1][1], m[2][1], m[3][1]};
+    const glm::vec4 row2 = {m[0][2], m[1][2], m[2][2], m[3][2]};
+    const glm::vec4 row3 = {m[0][3], m[1][3], m[2][3], m[3][3]};
+    return {{row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2}};
+}
+
+Aabb transformAabb(const Aabb& box, const glm::mat4& mtx)
+{
+    if(!box.isValid())
+        return box;
+    // Arvo: transform the center, and the extents with the absolute value of the matrix
+    const glm::vec3 center = 0.5f * (box.pMin + box.pMax);
+    const glm::vec3 extents = 0.5f * (box.pMax - box.pMin);
+    const glm::vec3 newCenter = glm::vec3(mtx * glm::vec4(center, 1));
+    const glm::vec3 newExtents =
+        glm::abs(glm::vec3(mtx[0])) * extents.x +
+        glm::abs(glm::vec3(mtx[1])) * extents.y +
+        glm::abs(glm::vec3(mtx[2])) * extents.z;
+    return Aabb(newCenter - newExtents, newCenter + newExtents);
+}
+
+void cullAabbs(tl::Span<u8> visible, const AabbsSoa& boxes, const Frustum& frustum)
+{
+    assert(visible.size() == boxes.size());
+    const size_t n = boxes.size();
+    // for each plane we only test the corner of the box that is furthest along the normal (the "positive vertex")
+    // which corner that is only depends on the signs of the normal, so we can choose the arrays once per plane
+    struct PlaneArrays { const float *x, *y, *z; };
+    PlaneArrays planeArrays[6];
+    for(int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        planeArrays[p].x = plane.x >= 0 ? boxes.maxX.begin() : boxes.minX.begin();
+        planeArrays[p].y = plane.y >= 0 ? boxes.maxY.begin() : boxes.minY.begin();
+        planeArrays[p].z = plane.z >= 0 ? boxes.maxZ.begin() : boxes.minZ.begin();
+    }
+
+#if defined(CULLING_AVX)
+    for(size_t i = 0; i < n; i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            __m256 d = _mm256_set1_ps(plane.w);
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(planeArrays[p].x + i), _mm256_set1_ps(plane.x)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(planeArrays[p].y + i), _mm256_set1_ps(plane.y)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(planeArrays[p].z + i), _mm256_set1_ps(plane.z)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        const int mask = _mm256_movemask_ps(inside);
+        const size_t count = glm::min<size_t>(8, n - i);
+        for(size_t j = 0; j < count; j++)
+            visible[i + j] = (mask >> j) & 1;
+    }
+#elif defined(CULLING_SSE)
+    for(size_t i = 0; i < n; i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            __m128 d = _mm_set1_ps(plane.w);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(planeArrays[p].x + i), _mm_set1_ps(plane.x)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(planeArrays[p].y + i), _mm_set1_ps(plane.y)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(planeArrays[p].z + i), _mm_set1_ps(plane.z)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        const int mask = _mm_movemask_ps(inside);
+        const size_t count = glm::min<size_t>(4, n - i);
+        for(size_t j = 0; j < count; j++)
+            visible[i + j] = (mask >> j) & 1;
+    }
+#else
+    for(size_t i = 0; i < n; i++) {
+        bool inside = true;
+        for(int p = 0; p < 6; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            const float d = plane.x * planeArrays[p].x[i] + plane.y * planeArrays[p].y[i] + plane.z * planeArrays[p].z[i] + plane.w;
+            inside = inside && d >= 0;
+        }
+        visible[i] = inside ? 1 : 0;
+    }
+#endif
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include "utils.hpp"
+
+// AABBs in SoA layout, so several of them can be tested at once against the frustum
+// the arrays are padded to a multiple of 8 boxes, so the SIMD loops don't need special code for the last boxes
+struct AabbsSoa {
+    tl::Vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    size_t numBoxes = 0;
+
+    size_t size()const { return numBoxes; }
+    void resize(size_t n); // all the boxes become empty, which are never visible
+    void set(size_t i, const Aabb& box);
+    void setInfinite(size_t i); // always visible
+    Aabb get(size_t i)const;
+};
+
+// a point is inside the frustum if dot(plane, vec4(p, 1)) >= 0 for all the planes
+struct Frustum {
+    glm::vec4 planes[6];
+};
+Frustum extractFrustum(const glm::mat4& viewProj);
+
+// the AABB of the transformed box
+Aabb transformAabb(const Aabb& box, const glm::mat4& mtx);
+
+// visible[i] = 1 if the box i might intersect the frustum, 0 if it's surely outside. "visible" must have boxes.size() elements
+void cullAabbs(tl::Span<u8> visible, const AabbsSoa& boxes, const Frustum& frustum);
@@ -0,0 +1,188 @@
+#include "gl_debug.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// the loader was generated for GL 3.3, so the KHR_debug entry points and enums are not there
+#ifndef GL_DEBUG_OUTPUT
+    #define GL_DEBUG_OUTPUT 0x92E0
+#endif
+#ifndef GL_DEBUG_SEVERITY_HIGH
+    #define GL_DEBUG_SEVERITY_HIGH 0x9146
+    #define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+    #define GL_DEBUG_SEVERITY_LOW 0x9148
+    #define GL_DEBUG_SEVERITY_NOTIFICATION 0x826B
+#endif
+#ifndef GL_DEBUG_TYPE_ERROR
+    #define GL_DEBUG_TYPE_ERROR 0x824C
+#endif
+
+typedef void (APIENTRYP DebugMessageCallbackFn)(GLDEBUGPROC callback, const void* userParam);
+typedef void (APIENTRYP DebugMessageControlFn)(GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint* ids, GLboolean enabled);
+
+namespace gl_debug
+{
+
+static EMode s_mode = EMode::OFF;
+static DebugMessageCallbackFn debugMessageCallback = nullptr;
+static DebugMessageControlFn debugMessageControl = nullptr;
+#ifdef GLAD_DEBUG
+static u32 s_numCalls = 0;
+static u32 s_numCallsLastFrame = 0;
+#endif
+
+CStr toStr(EMode mode)
+{
+    switch(mode) {
+    case EMode::OFF: return "off";
+    case EMode::MESSAGES: return "messages";
+    case EMode::SYNC_CHECK: return "sync";
+    default: return "";
+    }
+}
+
+bool parseMode(EMode& mode, const char* str)
+{
+    for(int i = 0; i < (int)EMode::COUNT; i++)
+        if(strcmp(str, toStr((EMode)i).c_str()) == 0) {
+            mode = (EMode)i;
+            return true;
+        }
+    return false;
+}
+
+static const char* getGlErrStr(GLenum const err)
+{
+    switch (err) {
+    case GL_NO_ERROR: return "GL_NO_ERROR";
+    case GL_INVALID_ENUM: return "GL_INVALID_ENUM";
+    case GL_INVALID_VALUE: return "GL_INVALID_VALUE";
+    case GL_INVALID_OPERATION: return "GL_INVALID_OPERATION";
+    case GL_INVALID_FRAMEBUFFER_OPERATION: return "GL_INVALID_FRAMEBUFFER_OPERATION";
+    case GL_OUT_OF_MEMORY: return "GL_OUT_OF_MEMORY";
+#ifdef GL_STACK_UNDERFLOW
+    case GL_STACK_UNDERFLOW: return "GL_STACK_UNDERFLOW";
+#endif
+#ifdef GL_STACK_OVERFLOW
+    case GL_STACK_OVERFLOW: return "GL_STACK_OVERFLOW";
+#endif
+    default:
+        assert(!"unknown error");
+        return nullptr;
+    }
+}
+
+static const char* getSeverityStr(GLenum severity)
+{
+    switch(severity) {
+    case GL_DEBUG_SEVERITY_HIGH: return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW: return "low";
+    default: return "notification";
+    }
+}
+
+// might be called from a driver thread, so we don't do anything else than printing
+static void APIENTRY onDebugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+{
+    fprintf(stderr, "GL %s (severity %s): %s\n", type == GL_DEBUG_TYPE_ERROR ? "error" : "message", getSeverityStr(severity), message);
+}
+
+#ifdef GLAD_DEBUG
+static void countCall(const char* name, void* funcptr, int len_args, ...)
+{
+    s_numCalls++;
+}
+
+static void checkErrorAfterCall(const char* name, void* funcptr, int len_args, ...)
+{
+    const GLenum error = glad_glGetError();
+    if(error != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR %s in %s\n", getGlErrStr(error), name);
+        assert(false);
+    }
+}
+
+static void ignoreCall(const char* name, void* funcptr, int len_args, ...) {}
+#endif
+
+EMode defaultMode()
+{
+#ifdef GLAD_DEBUG
+    return EMode::MESSAGES;
+#else
+    return EMode::OFF;
+#endif
+}
+
+bool hasDebugOutput()
+{
+    return debugMessageCallback != nullptr;
+}
+
+void init(EMode mode)
+{
+    if(GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3) || glfwExtensionSupported("GL_KHR_debug")) {
+        debugMessageCallback = (DebugMessageCallbackFn)glfwGetProcAddress("glDebugMessageCallback");
+        debugMessageControl = (DebugMessageControlFn)glfwGetProcAddress("glDebugMessageControl");
+        if(debugMessageControl == nullptr)
+            debugMessageCallback = nullptr;
+    }
+#ifdef GLAD_DEBUG
+    glad_set_pre_callback(countCall);
+#endif
+    setMode(mode);
+}
+
+void setMode(EMode mode)
+{
+    s_mode = mode;
+#ifdef GLAD_DEBUG
+    // the default post callback of glad calls glGetError, so it must be replaced even when we don't want the checks
+    glad_set_post_callback(mode == EMode::SYNC_CHECK ? checkErrorAfterCall : ignoreCall);
+#endif
+    if(debugMessageCallback) {
+        if(mode == EMode::MESSAGES) {
+            debugMessageCallback(onDebugMessage, nullptr);
+            // the notifications are too verbose (some drivers report every buffer allocation)
+            debugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+            glEnable(GL_DEBUG_OUTPUT);
+        }
+        else {
+            glDisable(GL_DEBUG_OUTPUT);
+            debugMessageCallback(nullptr, nullptr);
+        }
+    }
+}
+
+EMode mode()
+{
+    return s_mode;
+}
+
+void endFrame()
+{
+#ifdef GLAD_DEBUG
+    s_numCallsLastFrame = s_numCalls;
+    s_numCalls = 0;
+#else
+    if(s_mode == EMode::SYNC_CHECK) {
+        // without the hooks, the best we can do is telling that something failed during the frame
+        const GLenum error = glad_glGetError();
+        if(error != GL_NO_ERROR)
+            fprintf(stderr, "ERROR %s during the frame\n", getGlErrStr(error));
+    }
+#endif
+}
+
+#ifdef GLAD_DEBUG
+u32 numCallsLastFrame()
+{
+    return s_numCallsLastFrame;
+}
+#endif
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#include <tl/str.hpp>
+#include <glad/glad.h>
+
+// validation of the GL calls
+// the per-call hooks only exist with the debug glad loader, which defines GLAD_DEBUG (debug builds, or GL_CALL_HOOKS=ON). Otherwise the calls go straight to the driver
+namespace gl_debug
+{
+
+enum class EMode : u8 {
+    OFF,
+    MESSAGES, // KHR_debug message callback: the driver reports the problems asynchronously, without stalling
+    SYNC_CHECK, // glGetError after every call: tells exactly which call failed, but forces a synchronization each time
+    COUNT
+};
+CStr toStr(EMode mode);
+bool parseMode(EMode& mode, const char* str); // "off", "messages" or "sync"
+
+EMode defaultMode(); // MESSAGES in builds with the hooks, OFF in release builds
+bool hasDebugOutput(); // KHR_debug is available (GL 4.3 or the extension). Only valid after init
+
+void init(EMode mode); // after loading the GL functions
+void setMode(EMode mode); // if KHR_debug is not available, MESSAGES behaves like OFF
+EMode mode();
+
+// call at the end of each frame. Without the hooks, SYNC_CHECK checks for errors only here
+void endFrame();
+#ifdef GLAD_DEBUG
+u32 numCallsLastFrame(); // counted by the hooks, so it only exists with them
+#endif
+
+}
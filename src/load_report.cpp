@@ -0,0 +1,80 @@
+#include "load_report.hpp"
+
+#include <stdio.h>
+#include <GLFW/glfw3.h>
+
+CStr toStr(ELoadStage stage)
+{
+    switch(stage) {
+    case ELoadStage::PARSE: return "parse";
+    case ELoadStage::LOAD_BUFFERS: return "load_buffers";
+    case ELoadStage::HASH_FILES: return "hash_files";
+    case ELoadStage::READ_CACHE: return "read_cache";
+    case ELoadStage::DECODE_IMAGES: return "decode_images";
+    case ELoadStage::GENERATE_MIPMAPS: return "generate_mipmaps";
+    case ELoadStage::TANGENT_FRAMES: return "tangent_frames";
+    case ELoadStage::MESH_AABBS: return "mesh_aabbs";
+    case ELoadStage::MESH_BVHS: return "mesh_bvhs";
+    case ELoadStage::MORPH_TARGETS: return "morph_targets";
+    case ELoadStage::GPU_INSTANCES: return "gpu_instances";
+    case ELoadStage::WRITE_CACHE: return "write_cache";
+    case ELoadStage::UPLOAD_BUFFERS: return "upload_buffers";
+    case ELoadStage::CREATE_VAOS: return "create_vaos";
+    case ELoadStage::LOAD_MATERIALS: return "load_materials";
+    case ELoadStage::SETUP_CAMERA: return "setup_camera";
+    case ELoadStage::UPLOAD_TEXTURES: return "upload_textures";
+    default: return "";
+    }
+}
+
+LoadStageTimer::LoadStageTimer(LoadReport& report, ELoadStage stage)
+    : stats(report[stage])
+    , startTime(glfwGetTime())
+{}
+
+LoadStageTimer::~LoadStageTimer()
+{
+    stats.seconds += glfwGetTime() - startTime;
+}
+
+static void writeJsonStr(FILE* file, const char* str)
+{
+    fputc('"', file);
+    for(const char* c = str; *c; c++) {
+        if(*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if((u8)*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+bool writeLoadReportJson(const LoadReport& report, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+        return false;
+    fprintf(file, "{\n  \"path\": ");
+    writeJsonStr(file, report.path.c_str());
+    fprintf(file, ",\n");
+    fprintf(file, "  \"mappedFiles\": %s,\n", report.mappedFiles ? "true" : "false");
+    fprintf(file, "  \"cacheHit\": %s,\n", report.cacheHit ? "true" : "false");
+    fprintf(file, "  \"cacheStored\": %s,\n", report.cacheStored ? "true" : "false");
+    fprintf(file, "  \"loaderThreads\": %u,\n", report.loaderThreads);
+    fprintf(file, "  \"sceneReadyMs\": %.3f,\n", 1000. * report.sceneReadySeconds);
+    fprintf(file, "  \"totalMs\": %.3f,\n", 1000. * report.totalSeconds);
+    fprintf(file, "  \"imagesDecodeWallMs\": %.3f,\n", 1000. * report.imagesDecodeWallSeconds);
+    fprintf(file, "  \"residentBytesDelta\": %lld,\n", (long long)report.residentBytesDelta);
+    fprintf(file, "  \"anonymousBytesDelta\": %lld,\n", (long long)report.anonymousBytesDelta);
+    fprintf(file, "  \"stages\": [\n");
+    for(int i = 0; i < (int)ELoadStage::COUNT; i++) {
+        const LoadStageStats& stats = report.stages[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ms\": %.3f, \"bytes\": %llu, \"items\": %u}%s\n",
+            toStr((ELoadStage)i).c_str(), 1000. * stats.seconds, (unsigned long long)stats.bytes, stats.items,
+            i + 1 < (int)ELoadStage::COUNT ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
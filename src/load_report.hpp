@@ -0,0 +1,61 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#include <tl/str.hpp>
+
+// the stages of loading a scene that we measure
+enum class ELoadStage : u8 {
+    PARSE, // parsing the glTF JSON (or the GLB chunks)
+    LOAD_BUFFERS, // cgltf_load_buffers, and mapping the external .bin files
+    HASH_FILES, // computing the key of the scene cache
+    READ_CACHE,
+    DECODE_IMAGES, // sum of the times of all the loader threads
+    GENERATE_MIPMAPS, // sum of the times of all the loader threads
+    TANGENT_FRAMES,
+    MESH_AABBS,
+    MESH_BVHS,
+    MORPH_TARGETS,
+    GPU_INSTANCES,
+    WRITE_CACHE,
+    UPLOAD_BUFFERS,
+    CREATE_VAOS,
+    LOAD_MATERIALS,
+    SETUP_CAMERA,
+    UPLOAD_TEXTURES, // accumulated over the frames in which we stream textures
+    COUNT
+};
+CStr toStr(ELoadStage stage);
+
+struct LoadStageStats {
+    double seconds;
+    u64 bytes;
+    u32 items; // what an item is depends on the stage: images, buffers, primitives...
+};
+
+struct LoadReport {
+    Str path;
+    bool mappedFiles;
+    bool cacheHit;
+    bool cacheStored; // the scene was written to the cache during this load
+    u32 loaderThreads;
+    float sceneReadySeconds; // from the start until the new scene is displayed (without all the textures)
+    float totalSeconds;
+    float imagesDecodeWallSeconds;
+    i64 residentBytesDelta; // change in resident memory caused by parsing and loading the buffers
+    i64 anonymousBytesDelta; // the same, but not counting file-backed pages
+    LoadStageStats stages[(int)ELoadStage::COUNT];
+
+    LoadStageStats& operator[](ELoadStage stage) { return stages[(int)stage]; }
+    const LoadStageStats& operator[](ELoadStage stage)const { return stages[(int)stage]; }
+};
+
+// adds the time until the end of the scope to the stage
+struct LoadStageTimer {
+    LoadStageTimer(LoadReport& report, ELoadStage stage);
+    ~LoadStageTimer();
+
+    LoadStageStats& stats;
+    double startTime;
+};
+
+bool writeLoadReportJson(const LoadReport& report, const char* path);
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <tl/fmt.hpp>
@@ -10,41 +12,71 @@
 #include <implot.h>
 #include "utils.hpp"
 #include "shaders.hpp"
+#include "benchmark.hpp"
+#include "gl_debug.hpp"
 
 GLFWwindow* window;
 
-static const char* getGlErrStr(GLenum const err)
+static void printUsage()
 {
-    switch (err) {
-    case GL_NO_ERROR: return "GL_NO_ERROR";
-    case GL_INVALID_ENUM: return "GL_INVALID_ENUM";
-    case GL_INVALID_VALUE: return "GL_INVALID_VALUE";
-    case GL_INVALID_OPERATION: return "GL_INVALID_OPERATION";
-    case GL_INVALID_FRAMEBUFFER_OPERATION: return "GL_INVALID_FRAMEBUFFER_OPERATION";
-    case GL_OUT_OF_MEMORY: return "GL_OUT_OF_MEMORY";
-#ifdef GL_STACK_UNDERFLOW
-    case GL_STACK_UNDERFLOW: return "GL_STACK_UNDERFLOW";
-#endif
-#ifdef GL_STACK_OVERFLOW
-    case GL_STACK_OVERFLOW: return "GL_STACK_OVERFLOW";
-#endif
-    default:
-        assert(!"unknown error");
-        return nullptr;
-    }
-}
-
-void glErrorCallback(const char *name, void *funcptr, int len_args, ...) {
-    GLenum error_code;
-    error_code = glad_glGetError();
-    if (error_code != GL_NO_ERROR) {
-        fprintf(stderr, "ERROR %s in %s\n", getGlErrStr(error_code), name);
-        assert(false);
-    }
+    fprintf(stderr,
+        "usage: gltf_viewer [file.gltf] [--load-report report.json] [--gl-debug off|messages|sync]\n"
+        "       gltf_viewer --bench file.gltf [--frames N] [--warmup N] [--size WxH] [--anim index] [--bench-report report.json] [--egl]\n"
+        "       gltf_viewer --bench-transforms\n"
+        "       gltf_viewer --bench-anims\n");
 }
 
 int main(int argc, char* argv[])
 {
+    const char* gltfPath = nullptr;
+    const char* loadReportPath = nullptr;
+    bool bench = false;
+    bool useEgl = false;
+    BenchmarkOptions benchOptions;
+    gl_debug::EMode glDebugMode = gl_debug::defaultMode();
+    for(int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if(strcmp(arg, "--load-report") == 0 && hasValue)
+            loadReportPath = argv[++i];
+        else if(strcmp(arg, "--bench") == 0 && hasValue) {
+            bench = true;
+            gltfPath = argv[++i];
+        }
+        else if(strcmp(arg, "--frames") == 0 && hasValue)
+            benchOptions.numFrames = (u32)atoi(argv[++i]);
+        else if(strcmp(arg, "--warmup") == 0 && hasValue)
+            benchOptions.numWarmupFrames = (u32)atoi(argv[++i]);
+        else if(strcmp(arg, "--size") == 0 && hasValue) {
+            if(sscanf(argv[++i], "%dx%d", &benchOptions.width, &benchOptions.height) != 2 || benchOptions.width <= 0 || benchOptions.height <= 0) {
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(arg, "--anim") == 0 && hasValue)
+            benchOptions.animInd = atoi(argv[++i]);
+        else if(strcmp(arg, "--bench-report") == 0 && hasValue)
+            benchOptions.reportPath = argv[++i];
+        else if(strcmp(arg, "--gl-debug") == 0 && hasValue) {
+            if(!gl_debug::parseMode(glDebugMode, argv[++i])) {
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(arg, "--egl") == 0)
+            useEgl = true;
+        else if(strcmp(arg, "--bench-transforms") == 0)
+            return runTransformsBenchmark();
+        else if(strcmp(arg, "--bench-anims") == 0)
+            return runAnimEvalBenchmark();
+        else if(arg[0] == '-' || gltfPath) {
+            printUsage();
+            return 1;
+        }
+        else
+            gltfPath = arg;
+    }
+
     glfwSetErrorCallback(+[](int error, const char* description) {
         fprintf(stderr, "Glfw Error %d: %s\n", error, description);
     });
@@ -54,7 +86,17 @@ int main(int argc, char* argv[])
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_MAXIMIZED, GLFW_TRUE);
+    if(glDebugMode != gl_debug::EMode::OFF) // some drivers only report debug messages in debug contexts
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+    if(bench) {
+        // we render to a framebuffer object, the window is only needed for having a context
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        if(useEgl) // useful with Mesa on machines without a display server
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
+    else {
+        glfwWindowHint(GLFW_MAXIMIZED, GLFW_TRUE);
+    }
 
     window = glfwCreateWindow(1280, 720, "test", nullptr, nullptr);
     if (window == nullptr)
@@ -67,7 +109,7 @@ int main(int argc, char* argv[])
         fprintf(stderr, "Failed to initialize OpenGL loader!\n");
         return 1;
     }
-    glad_set_post_callback(glErrorCallback);
+    gl_debug::init(glDebugMode);
 
     ImGui::CreateContext();
     ImPlot::CreateContext();
@@ -126,16 +168,28 @@ int main(int argc, char* argv[])
 
     gpu::buildShaders();
     createBasicTextures();
+    initTextureUploads();
+    createInstancesBuffer();
+    createUniformBuffers();
+    createJointsTexture();
+    createMorphTexture();
     createAxesMesh();
     createFloorGridMesh();
     createCrosshairMesh();
+    if(loadReportPath)
+        setLoadReportPath(loadReportPath);
+
+    if(bench) {
+        benchOptions.gltfPath = gltfPath;
+        return runBenchmark(benchOptions);
+    }
 
     glfwSetMouseButtonCallback(window, mouse_handling::onMouseButton);
     glfwSetCursorPosCallback(window, mouse_handling::onMouseMove);
     glfwSetScrollCallback(window, mouse_handling::onMouseWheel);
     glfwSetDropCallback(window, onFileDroped);
-    if(argc > 1) {
-        loadGltf(argv[1]);
+    if(gltfPath) {
+        loadGltf(gltfPath);
     }
 
     double t = glfwGetTime();
@@ -155,7 +209,7 @@ int main(int argc, char* argv[])
         glfwGetFramebufferSize(window, &w, &h);
         glViewport(0, 0, w, h);
         glScissor(0, 0, w, h);
-        drawScene();
+        drawScene(w, h);
 
         // draw gui
         ImGui_ImplOpenGL3_NewFrame();
@@ -168,6 +222,7 @@ int main(int argc, char* argv[])
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwSwapBuffers(window);
+        gl_debug::endFrame();
         glfwWaitEventsTimeout(0.01);
     }
 }
@@ -0,0 +1,140 @@
+#include "morph_targets.hpp"
+
+#include <assert.h>
+#include <string.h>
+#include <glm/common.hpp>
+
+size_t MorphTargets::memorySize()const
+{
+    return sizeof(u32) * meshesFirstPrim.size() + sizeof(Prim) * prims.size() + sizeof(Attrib) * attribs.size() +
+        sizeof(glm::vec3) * deltas.size() + sizeof(u32) * vertInds.size();
+}
+
+static u32 componentSize(cgltf_component_type type)
+{
+    switch(type) {
+    case cgltf_component_type_r_8:
+    case cgltf_component_type_r_8u:
+        return 1;
+    case cgltf_component_type_r_16:
+    case cgltf_component_type_r_16u:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+static void readAttrib(MorphTargets& morphs, MorphTargets::Attrib& attrib, const cgltf_accessor& accessor, u32 numVerts)
+{
+    attrib.firstDelta = morphs.deltas.size();
+    attrib.firstVertInd = ~0u;
+    if(accessor.is_sparse && accessor.buffer_view == nullptr) {
+        // the elements that are not in the sparse part are 0, so only the sparse part is stored
+        const cgltf_accessor_sparse& sparse = accessor.sparse;
+        cgltf_accessor values = accessor;
+        values.is_sparse = false;
+        values.buffer_view = sparse.values_buffer_view;
+        values.offset = sparse.values_byte_offset;
+        values.count = sparse.count;
+        cgltf_accessor indices = {};
+        indices.component_type = sparse.indices_component_type;
+        indices.type = cgltf_type_scalar;
+        indices.offset = sparse.indices_byte_offset;
+        indices.count = sparse.count;
+        indices.stride = componentSize(sparse.indices_component_type);
+        indices.buffer_view = sparse.indices_buffer_view;
+
+        attrib.firstVertInd = morphs.vertInds.size();
+        morphs.deltas.resize(attrib.firstDelta + sparse.count);
+        morphs.vertInds.resize(attrib.firstVertInd + sparse.count);
+        u32 numDeltas = 0;
+        for(size_t i = 0; i < sparse.count; i++) {
+            const u32 vertInd = cgltf_accessor_read_index(&indices, i);
+            if(vertInd >= numVerts) // invalid file
+                continue;
+            morphs.vertInds[attrib.firstVertInd + numDeltas] = vertInd;
+            cgltf_accessor_read_float(&values, i, &morphs.deltas[attrib.firstDelta + numDeltas][0], 3);
+            numDeltas++;
+        }
+        attrib.numDeltas = numDeltas;
+        morphs.deltas.resize(attrib.firstDelta + numDeltas);
+        morphs.vertInds.resize(attrib.firstVertInd + numDeltas);
+        morphs.numSparseAttribs++;
+    }
+    else {
+        // dense, or sparse on top of a base bufferView: a delta foreach vertex
+        attrib.numDeltas = numVerts;
+        morphs.deltas.resize(attrib.firstDelta + numVerts);
+        if(cgltf_accessor_unpack_floats(&accessor, &morphs.deltas[attrib.firstDelta][0], 3 * numVerts) != 3 * numVerts) {
+            attrib.numDeltas = 0;
+            morphs.deltas.resize(attrib.firstDelta);
+        }
+    }
+}
+
+void computeMorphTargets(MorphTargets& morphs, const cgltf_data& data)
+{
+    morphs.meshesFirstPrim.resize(data.meshes_count);
+    morphs.prims.resize(0);
+    morphs.attribs.resize(0);
+    morphs.deltas.resize(0);
+    morphs.vertInds.resize(0);
+    morphs.numSparseAttribs = 0;
+    for(size_t meshInd = 0; meshInd < data.meshes_count; meshInd++) {
+        const cgltf_mesh& mesh = data.meshes[meshInd];
+        morphs.meshesFirstPrim[meshInd] = morphs.prims.size();
+        for(size_t primInd = 0; primInd < mesh.primitives_count; primInd++) {
+            const cgltf_primitive& prim = mesh.primitives[primInd];
+            MorphTargets::Prim morphPrim;
+            morphPrim.firstTarget = morphs.attribs.size() / MorphTargets::NUM_ATTRIBS;
+            morphPrim.numTargets = prim.targets_count;
+            morphPrim.numVerts = prim.attributes_count ? prim.attributes[0].data->count : 0;
+            for(size_t targetInd = 0; targetInd < prim.targets_count; targetInd++) {
+                const cgltf_morph_target& target = prim.targets[targetInd];
+                const size_t firstAttrib = morphs.attribs.size();
+                morphs.attribs.resize(firstAttrib + MorphTargets::NUM_ATTRIBS);
+                for(u32 a = 0; a < MorphTargets::NUM_ATTRIBS; a++)
+                    morphs.attribs[firstAttrib + a] = {0, 0, ~0u};
+                for(size_t attribInd = 0; attribInd < target.attributes_count; attribInd++) {
+                    const cgltf_attribute& attrib = target.attributes[attribInd];
+                    // the deltas of the other attributes (TANGENT, TEXCOORD_n, COLOR_n) are ignored
+                    if(attrib.index != 0 || attrib.data->type != cgltf_type_vec3 || attrib.data->count != morphPrim.numVerts)
+                        continue;
+                    if(attrib.type == cgltf_attribute_type_position)
+                        readAttrib(morphs, morphs.attribs[firstAttrib + 0], *attrib.data, morphPrim.numVerts);
+                    else if(attrib.type == cgltf_attribute_type_normal)
+                        readAttrib(morphs, morphs.attribs[firstAttrib + 1], *attrib.data, morphPrim.numVerts);
+                }
+            }
+            morphs.prims.push_back(morphPrim);
+        }
+    }
+}
+
+u32 blendMorphTargets(glm::vec4* out, const MorphTargets& morphs, const MorphTargets::Prim& prim, tl::CSpan<float> weights)
+{
+    memset(out, 0, sizeof(glm::vec4) * 2 * prim.numVerts);
+    const u32 numTargets = glm::min(prim.numTargets, u32(weights.size()));
+    u32 numActive = 0;
+    for(u32 targetInd = 0; targetInd < numTargets; targetInd++) {
+        const float w = weights[targetInd];
+        if(w == 0)
+            continue;
+        numActive++;
+        for(u32 a = 0; a < MorphTargets::NUM_ATTRIBS; a++) {
+            const MorphTargets::Attrib& attrib = morphs.getAttrib(prim, targetInd, a);
+            const glm::vec3* deltas = morphs.deltas.data() + attrib.firstDelta;
+            glm::vec4* dst = out + a;
+            if(attrib.firstVertInd == ~0u) {
+                for(u32 i = 0; i < attrib.numDeltas; i++)
+                    dst[2 * i] += glm::vec4(w * deltas[i], 0);
+            }
+            else {
+                const u32* vertInds = morphs.vertInds.data() + attrib.firstVertInd;
+                for(u32 i = 0; i < attrib.numDeltas; i++)
+                    dst[2 * vertInds[i]] += glm::vec4(w * deltas[i], 0);
+            }
+        }
+    }
+    return numActive;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+#include <tl/span.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "utils.hpp"
+
+// the morph targets of all the primitives of the scene, kept in the CPU, where they are blended with the current weights
+// only the POSITION and NORMAL deltas are used
+// the targets with sparse accessors (and without a base bufferView) stay sparse: we store the vertex index of each delta, so the memory
+// and the blending cost depend on the vertices that the target moves, not on the vertices of the primitive
+struct MorphTargets {
+    static constexpr u32 NUM_ATTRIBS = 2; // per target: POSITION, NORMAL
+    struct Attrib {
+        u32 firstDelta; // inside deltas
+        u32 numDeltas; // 0 if the target doesn't have the attribute
+        u32 firstVertInd; // inside vertInds for the sparse ones. ~0u if it's dense: there is a delta foreach vertex
+    };
+    struct Prim {
+        u32 firstTarget; // the attributes of the target t are at attribs[NUM_ATTRIBS * (firstTarget + t)]
+        u32 numTargets;
+        u32 numVerts;
+    };
+
+    tl::Vector<u32> meshesFirstPrim; // foreach mesh, its first primitive inside prims. All the primitives are there, also the ones without targets
+    tl::Vector<Prim> prims;
+    tl::Vector<Attrib> attribs;
+    tl::Vector<glm::vec3> deltas;
+    tl::Vector<u32> vertInds;
+    u32 numSparseAttribs = 0; // of the ones that have deltas
+
+    const Prim& getPrim(size_t meshInd, size_t primInd)const { return prims[meshesFirstPrim[meshInd] + primInd]; }
+    const Attrib& getAttrib(const Prim& prim, u32 targetInd, u32 attribInd)const { return attribs[NUM_ATTRIBS * (prim.firstTarget + targetInd) + attribInd]; }
+    size_t memorySize()const;
+};
+
+void computeMorphTargets(MorphTargets& morphs, const cgltf_data& data);
+
+// out[2*v] and out[2*v+1] = the weighted sum of the position and normal deltas of the vertex v. The targets with a 0 weight are skipped
+// out must have 2 elements foreach vertex of the primitive, they are overwritten
+// returns the number of targets that contributed
+u32 blendMorphTargets(glm::vec4* out, const MorphTargets& morphs, const MorphTargets::Prim& prim, tl::CSpan<float> weights);
@@ -12,6 +12,9 @@
 #include <tl/fmt.hpp>
 #include <tl/containers/fvector.hpp>
 #include <tl/containers/vector.hpp>
+#include <tl/hash/hash.hpp>
+#include <vector>
+#include <algorithm>
 #include <stbi.h>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -20,7 +23,18 @@
 #include <glm/gtx/quaternion.hpp>
 #include "utils.hpp"
 #include "shaders.hpp"
+#include "thread_pool.hpp"
+#include "scene_cache.hpp"
+#include "load_report.hpp"
+#include "gl_debug.hpp"
+#include "culling.hpp"
+#include "bvh.hpp"
+#include "transforms.hpp"
+#include "anim_eval.hpp"
+#include "anim_compression.hpp"
+#include "morph_targets.hpp"
 #include <tg/cameras.hpp>
+#include <tg/mipmaps.hpp>
 
 using tl::FVector;
 using tl::Span;
@@ -30,18 +44,39 @@ using glm::vec4;
 
 extern GLFWwindow* window;
 
+// the triangles of a mesh in local space, with a BVH over them, for the ray queries
+struct MeshBvh {
+    Bvh bvh;
+    tl::Vector<vec3> triVerts; // 3 per triangle
+    tl::Vector<u32> primsFirstTri; // for each primitive of the mesh, its first triangle. The triangles of a primitive are contiguous
+    u32 numTris()const { return triVerts.size() / 3; }
+};
+
+// EXT_mesh_gpu_instancing: a node with it draws its mesh once per instance, with the instance transform relative to the node
+struct GpuInstances {
+    struct NodeInstances {
+        u32 firstInstance; // inside matrices
+        u32 numInstances;
+        Aabb localBox; // of the mesh of all the instances, in the space of the node
+    };
+    tl::Vector<i32> nodesInstances; // for each node, its index in "nodes", or -1 if the node doesn't use the extension
+    tl::Vector<NodeInstances> nodes;
+    tl::Vector<glm::mat4> matrices;
+};
+
 static Str openedFilePath = "";
 static cgltf_data* parsedData = nullptr;
+static tl::Vector<MappedFile> parsedDataMappedFiles; // when loading with memory mapping, the buffers of parsedData point to these
+static tl::Vector<Aabb> parsedDataMeshAabbs; // for each mesh of parsedData, in local space
+static std::vector<MeshBvh> parsedDataMeshBvhs; // for each mesh of parsedData. Not a tl::Vector, it would relocate the vectors inside with memcpy
+static GpuInstances parsedDataGpuInstances;
+static MorphTargets parsedDataMorphTargets;
 static cgltf_node* selectedNode = nullptr;
 static i32 selectedCamera = -1; // -1 is the default orbit camera, indices >=0 are indices of the gltf camera
 static struct OrbitCameraInfo{ vec3 center; float heading, pitch, distance; } orbitCam;
 static CameraProjectionInfo camProjInfo = {glm::radians(50.f), 0.02f, 1000.f};
+static u32 numDrawCalls = 0; // of the scene (not counting the axes, grid...) in the last call to drawScene
 
-constexpr size_t MAX_BUFFER_OBJS = 256;
-constexpr size_t MAX_VERT_ARRAYS = 128;
-constexpr size_t MAX_TEXTURES = 128;
-constexpr size_t MAX_MATERIALS = 128;
-constexpr size_t MAX_TOTAL_PRIMITIVES = 1023;
 constexpr u32 FLOOR_GRID_RESOLUTION = 50;
 constexpr u32 FLOOR_GRID_SUBDIVS = 8;
 static const glm::vec4 BG_COLOR = {0.1f, 0.2f, 0.1f, 1.0f};
@@ -58,11 +93,37 @@ namespace gpu
 static u32 basicSampler;
 static u32 whiteTexture;
 static u32 blueTexture;
-static FVector<u32, MAX_BUFFER_OBJS> bos;
-static FVector<u32, MAX_VERT_ARRAYS> vaos;
-static FVector<u32, MAX_TOTAL_PRIMITIVES+1> meshPrimsVaos; // for mesh i, we can find here, at index i, the beginning of the vaos range, and at i+1 the end of that range
-static FVector<u32, MAX_TEXTURES> textures;
-static glm::ivec2 textureSizes[MAX_TEXTURES];
+static u32 uploadPbo; // pixel buffer used for streaming the textures
+static u32 instancesBo; // model matrices of the instanced draws, rewritten every frame. The instance attributes of all the vaos point here
+static u32 frameUbo; // FrameUniforms
+static u32 drawUbo; // ring of DrawUniforms. Each frame appends its ones after the previous frame's, and the buffer is orphaned when it's full
+static size_t drawUboSize, drawUboCursor;
+static u32 uboAlignment; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, the offsets of the bound ranges must be multiples of it
+static u32 jointsBo; // joint matrices of the skins, rewritten every frame
+static u32 jointsTexture; // texture buffer view of jointsBo, for the skinning shader
+static u32 morphBo; // blended morph target deltas of the visible primitives, rewritten every frame
+static u32 morphTexture; // texture buffer view of morphBo
+typedef void (APIENTRYP TexStorage2DFn)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+static TexStorage2DFn texStorage2D = nullptr; // null when immutable storage is not available (GL 4.2 or ARB_texture_storage)
+struct SceneResources {
+    tl::Vector<u32> bos;
+    // only the bufferViews used for vertex attributes or indices are uploaded, packed in two buffer objects
+    tl::Vector<u32> bufferViewsBo; // for each bufferView, the buffer object that contains it (0 if not uploaded)
+    tl::Vector<size_t> bufferViewsOffset; // for each bufferView, the offset inside its buffer object
+    size_t vertexBytes, indexBytes; // size of the packed buffer objects
+    size_t unusedBufferBytes; // bytes of the cgltf buffers that were not uploaded
+    tl::Vector<u32> vaos;
+    tl::Vector<u32> meshPrimsVaos; // for mesh i, we can find here, at index i, the beginning of the vaos range, and at i+1 the end of that range
+    tl::Vector<u32> textures; // one for each image
+    tl::Vector<glm::ivec2> textureSizes;
+    tl::Vector<bool> texturesReady; // false until all the pixels of the texture have been uploaded, we draw with a fallback texture meanwhile
+    tl::Vector<bool> imagesNeedMipmaps; // true if any texture using the image has a mipmap filter
+    tl::Vector<u32> samplers; // deduplicated sampler objects
+    tl::Vector<u32> texturesSampler; // the sampler object for each cgltf_texture
+    u32 gpuInstancesBo; // the matrices of GpuInstances, 0 if the scene doesn't use EXT_mesh_gpu_instancing. It's also in bos
+    u32 materialsUbo; // MaterialUniforms of each material, and the default material at the end. It's also in bos
+};
+static SceneResources scene; // resources of the scene that is being displayed
 static u32 crosshairVao;
 static u32 axesVao;
 static u32 floorGridVao[2]; // two grids: one bigger and thicker, one smaller and thinner
@@ -73,15 +134,100 @@ const float DEFAULT_IMGUI_IMG_HEIGHT = 128.f;
 
 namespace imgui_state
 {
-static float textureHeights[MAX_TEXTURES];
+static tl::Vector<float> textureHeights;
 struct MaterialTexturesHeights { float color; float metallicRoughness; };
-static MaterialTexturesHeights materialTexturesHeights[MAX_MATERIALS];
+static tl::Vector<MaterialTexturesHeights> materialTexturesHeights;
 static u64 lightEnableBits = -1;
 static i32 selectedSceneInd = 0;
 static bool showAxes = true;
 static bool showFloorGrid = true;
 static float crosshairScale = 0.01f;
 static bool showCrosshair = true;
+static i32 numLoaderThreads = (i32)ThreadPool::defaultNumThreads();
+static bool mapFiles = true;
+static i32 textureUploadBudgetMB = 8; // per frame
+static bool cpuMipmaps = true; // generate the mip chains in the loader threads, instead of using glGenerateMipmap
+static i32 mipFilter = (i32)tg::EMipFilter::BOX;
+static bool useSceneCache = true;
+static i32 sceneCacheMaxMB = 2048;
+static bool frustumCulling = true;
+static bool autoInstancing = true;
+}
+
+// timings of the last scene load
+namespace load_stats
+{
+static tl::Vector<float> imageDecodeSeconds; // per image, as measured in the worker that decoded it
+static float imagesDecodeWallSeconds = 0;
+static u32 imagesDecodeThreads = 0;
+static float totalSeconds = 0;
+
+// we keep the reports of the recent loads so it's easy to compare loading modes. The last one is the most recent
+// std::vector because the reports own their path: tl::Vector relocates its elements with memcpy
+static std::vector<LoadReport> history;
+constexpr size_t MAX_HISTORY = 16;
+static Str reportPath; // if not empty, the report of each load is written to this JSON file
+}
+
+struct LoadedImage {
+    u8* data;
+    int w, h;
+    u8* mips; // the levels 1 to N, generated by the workers. Null if we use glGenerateMipmap or the image doesn't need mipmaps
+};
+
+// tangents (only for the primitives that don't have them) and cotangents, computed by the loader threads or read from the cache
+struct TangentFrames {
+    tl::Vector<u8> storage; // not used when the data comes from the cache
+    const u8* data = nullptr;
+    tl::Vector<u64> primsOffset; // for each primitive (in the order of the meshes) where its data begins, plus the end of the last one
+};
+
+// state of the scene that is being loaded in the background
+// the current scene keeps being displayed until the new one is ready
+namespace loading
+{
+enum class EStage : u8 {
+    NONE, // not loading anything
+    PARSING, // parsing the glTF and loading the buffers (worker thread)
+    DECODING_IMAGES, // (worker threads)
+    UPLOADING_BUFFERS, // (main thread) the images keep being decoded in the background
+    CREATING_VAOS, // (main thread) after this the new scene replaces the current one
+    UPLOADING_TEXTURES, // (main thread) the pixels are streamed a few MB per frame, while the new scene is displayed
+};
+static std::atomic<EStage> stage {EStage::NONE};
+static Str path;
+static Str pendingPath; // a file that was dropped while we were busy loading another one
+static JobCounter jobs;
+static cgltf_data* data = nullptr;
+static std::atomic<bool> parseFailed {false};
+static bool mapFiles;
+static tl::Vector<MappedFile> mappedFiles;
+static tl::Vector<LoadedImage> images;
+static tl::Vector<float> imageDecodeSeconds;
+static tl::Vector<float> imageMipsSeconds; // part of imageDecodeSeconds spent generating the mip chain
+static std::vector<std::atomic<bool>> imagesDecoded;
+static std::atomic<u32> numDecodedImages {0};
+static u32 numUploadedTextures = 0;
+static u32 numUploadedLevels = 0; // mip levels of the texture numUploadedTextures that have already been uploaded
+static u32 numUploadedRows = 0; // rows of the current level that have already been uploaded
+static bool cpuMipmaps;
+static tg::EMipFilter mipFilter;
+static tl::Vector<bool> imagesNeedMipmaps;
+static tl::Vector<bool> imagesSrgb;
+static TangentFrames tangentFrames;
+static tl::Vector<Aabb> meshAabbs;
+static std::vector<MeshBvh> meshBvhs;
+static GpuInstances gpuInstances;
+static MorphTargets morphTargets;
+static bool useCache;
+static u64 cacheKey;
+static bool cacheHit;
+static MappedFile cacheFile; // on a cache hit, the images and the tangent frames point inside this
+static double startTime;
+static double decodeStartTime;
+static float imagesDecodeWallSeconds;
+static LoadReport report; // the workers only write to the stages that the main thread doesn't touch
+static gpu::SceneResources gpuRes;
 }
 
 namespace anims
@@ -93,16 +239,90 @@ namespace anims
     static float time = 0.f;
     static float duration = 0.f;
 
-    struct NodeData {
-        vec3* position;
-        glm::quat* rotation;
-        vec3* scale;
-    };
-    static tl::Vector<NodeData> nodesData;
+    static NodeHierarchy hierarchy; // the animations write the local transforms here
     static tl::Vector<glm::mat4> nodesMatrices; // world transformation matrices for every node after animating
-    static tl::Vector<float> animData;
+    static AabbsSoa nodesAabbs; // world space bounding box of the mesh of every node, updated along with nodesMatrices
+    static tl::Vector<u32> updatedNodes; // the nodes whose world matrix was recomputed in the last update
     static tl::Vector<i32> curKeyInds; // the current key index foreach sampler, -1 means that we haven't reached the first frame yet
+
+    // for seeking to any time without going through all the keys: the time range of each sampler is divided in buckets of the same duration
+    // and for each bucket we store the last key at or before its start, so a seek only needs to search between two consecutive buckets
+    constexpr u32 KEYS_PER_BUCKET = 4; // on average
+    struct SamplerKeyBuckets {
+        float startTime, endTime; // times of the first and last keys
+        float invBucketDuration;
+        u32 firstBucket; // inside keyBuckets
+        u32 numBuckets;
+    };
+    static tl::Vector<SamplerKeyBuckets> samplersKeyBuckets; // foreach sampler of the current animation
+    static tl::Vector<i32> keyBuckets;
+
+    // the channels of the current animation are evaluated in two batches: translations and scales, and rotations
+    static tl::Vector<u32> vec3Channels, rotationChannels; // indices of the channels in each batch
+    static ChannelsBatch vec3Batch, rotationBatch;
+
+    // optionally, the batches are resampled at a fixed rate when the animation starts, so the playback doesn't depend on the keys
+    static bool bake = false;
+    static int bakeRate = 30; // frames per second
+    static BakedChannels vec3Baked, rotationBaked;
+
+    // optionally, the animation is compressed when it starts (from the channels resampled at bakeRate), and decompressed during the playback
+    static bool compress = false;
+    static float compressTolerance = 0.0005f; // for the key reduction
+    static CompressedChannels vec3Compressed, rotationCompressed;
+    struct CompressionReport {
+        bool ok = false; // false if the animation was too long to be compressed
+        size_t rawBytes = 0; // the samplers as float keys
+        size_t compressedBytes = 0;
+        u32 numFrames = 0; // the number of frames of all the channels before the key reduction
+        u32 numKeys = 0; // after the key reduction
+        float maxError = 0; // world space distance between the positions of the nodes with the raw and the compressed animation
+        tl::Vector<float> nodesMaxError;
+        tl::Vector<u32> nodesByError; // the nodes with some error, sorted from the largest error
+    };
+    static CompressionReport compressionReport;
+
+    // the morph target weights of the nodes whose mesh has targets: the ones of the node or the mesh, and the animations overwrite them
+    struct NodeMorphWeights {
+        u32 first; // inside morphWeights
+        u32 count; // 0 if the mesh of the node doesn't have morph targets
+    };
+    static tl::Vector<NodeMorphWeights> nodesMorphWeights;
+    static tl::Vector<float> morphWeights;
+    static tl::Vector<u32> weightsChannels; // the channels of the current animation that target the weights
+}
+
+// selecting nodes by clicking on them
+namespace picking
+{
+    constexpr float CLICK_MAX_MOVE = 3; // in pixels, more than this between pressing and releasing is a drag
+    constexpr double DOUBLE_CLICK_SECONDS = 0.3;
+
+    // top level BVH over the instances of the meshes (the nodes that have one). Skinned meshes are not included
+    struct TlasInstance {
+        u32 nodeInd;
+        u32 gpuInstanceInd; // inside GpuInstances::matrices, ~0u if the node doesn't have EXT_mesh_gpu_instancing
+    };
+    static Bvh tlas;
+    static tl::Vector<TlasInstance> tlasInstances; // of each primitive of tlas
+    static tl::Vector<Aabb> tlasBoxes; // world space box of each primitive of tlas
+    static bool tlasNeedsBuild = true;
+
+    struct Hit {
+        cgltf_node* node;
+        u32 gpuInstanceInd; // inside the EXT_mesh_gpu_instancing instances of the node, ~0u if it doesn't have them
+        u32 primInd; // inside the mesh of the node
+        u32 triInd; // inside the primitive
+        float distance;
+        vec3 point; // in world space
+    };
+    static bool lastHitValid = false;
+    static Hit lastHit;
+    static float lastQueryMicroseconds = 0;
+    static float pressX, pressY;
+    static double lastClickTime = -1;
 }
+static void pickAtCursor(GLFWwindow* window, float x, float y, bool recenter);
 
 namespace mouse_handling
 {
@@ -113,8 +333,19 @@ namespace mouse_handling
     {
         if(ImGui::GetIO().WantCaptureMouse)
             return; // the mouse is captured by imgui
-        if(button == GLFW_MOUSE_BUTTON_LEFT)
+        if(button == GLFW_MOUSE_BUTTON_LEFT) {
             pressed = action == GLFW_PRESS;
+            if(pressed) {
+                picking::pressX = prevX;
+                picking::pressY = prevY;
+            }
+            else if(glm::abs(prevX - picking::pressX) + glm::abs(prevY - picking::pressY) <= picking::CLICK_MAX_MOVE) {
+                const double t = glfwGetTime();
+                const bool doubleClick = t - picking::lastClickTime < picking::DOUBLE_CLICK_SECONDS;
+                picking::lastClickTime = doubleClick ? -1 : t;
+                pickAtCursor(window, prevX, prevY, doubleClick);
+            }
+        }
         if(button == GLFW_MOUSE_BUTTON_MIDDLE)
             middlePressed = action == GLFW_PRESS;
     }
@@ -163,16 +394,25 @@ namespace mouse_handling
     }
 }
 
-static void freeSceneGpuResources()
+static void freeSceneGpuResources(gpu::SceneResources& res)
 {
-    using namespace gpu;
-    glDeleteBuffers(bos.size(), bos.begin());
-    bos.resize(0);
-    glDeleteVertexArrays(vaos.size(), vaos.begin());
-    vaos.resize(0);
-    meshPrimsVaos.resize(0);
-    glDeleteTextures(textures.size(), textures.begin());
-    textures.resize(0);
+    glDeleteBuffers(res.bos.size(), res.bos.begin());
+    res.bos.resize(0);
+    res.gpuInstancesBo = 0;
+    res.materialsUbo = 0;
+    res.bufferViewsBo.resize(0);
+    res.bufferViewsOffset.resize(0);
+    glDeleteVertexArrays(res.vaos.size(), res.vaos.begin());
+    res.vaos.resize(0);
+    res.meshPrimsVaos.resize(0);
+    glDeleteTextures(res.textures.size(), res.textures.begin());
+    res.textures.resize(0);
+    res.textureSizes.resize(0);
+    res.texturesReady.resize(0);
+    res.imagesNeedMipmaps.resize(0);
+    glDeleteSamplers(res.samplers.size(), res.samplers.begin());
+    res.samplers.resize(0);
+    res.texturesSampler.resize(0);
 }
 
 void createBasicTextures()
@@ -192,6 +432,65 @@ void createBasicTextures()
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, blue);
 }
 
+void initTextureUploads()
+{
+    // glad is generated for GL 3.3, so we need to load glTexStorage2D ourselves
+    const bool gl42 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2);
+    if(gl42 || glfwExtensionSupported("GL_ARB_texture_storage"))
+        gpu::texStorage2D = (gpu::TexStorage2DFn)glfwGetProcAddress("glTexStorage2D");
+    glGenBuffers(1, &gpu::uploadPbo);
+}
+
+void createInstancesBuffer()
+{
+    glGenBuffers(1, &gpu::instancesBo);
+    glBindBuffer(GL_ARRAY_BUFFER, gpu::instancesBo);
+    // some storage from the beginning, because the attributes of the vaos point here even when they are not used
+    glBufferData(GL_ARRAY_BUFFER, 64 * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+}
+
+// the bound ranges of a uniform buffer must start at multiples of uboAlignment
+static size_t uboStride(size_t size)
+{
+    return (size + gpu::uboAlignment - 1) / gpu::uboAlignment * gpu::uboAlignment;
+}
+
+void createUniformBuffers()
+{
+    i32 alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    gpu::uboAlignment = alignment;
+    glGenBuffers(1, &gpu::frameUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, gpu::frameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_STREAM_DRAW);
+    glGenBuffers(1, &gpu::drawUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, gpu::drawUbo);
+    gpu::drawUboSize = 256 * 1024;
+    gpu::drawUboCursor = 0;
+    glBufferData(GL_UNIFORM_BUFFER, gpu::drawUboSize, nullptr, GL_STREAM_DRAW);
+}
+
+void createJointsTexture()
+{
+    glGenBuffers(1, &gpu::jointsBo);
+    glBindBuffer(GL_TEXTURE_BUFFER, gpu::jointsBo);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    // the texture refers to the buffer object, so it keeps working when the storage of the buffer is replaced
+    glGenTextures(1, &gpu::jointsTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, gpu::jointsTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, gpu::jointsBo);
+}
+
+void createMorphTexture()
+{
+    glGenBuffers(1, &gpu::morphBo);
+    glBindBuffer(GL_TEXTURE_BUFFER, gpu::morphBo);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    glGenTextures(1, &gpu::morphTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, gpu::morphTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, gpu::morphBo);
+}
+
 void createCrosshairMesh()
 {
     glGenVertexArrays(1, &gpu::crosshairVao);
@@ -365,118 +664,386 @@ static const char* getCameraName(int ind) {
     return scratchStr();
 }
 
-static void advanceAnimPathOffset(size_t& offset, cgltf_animation_path_type t)
+namespace anims
 {
-    switch(t) {
-        case cgltf_animation_path_type_translation:
-        case cgltf_animation_path_type_scale:
-            offset += 3;
-            break;
-        case cgltf_animation_path_type_rotation:
-            offset += 4;
-            break;
-        default:
-            assert(false);
+static float getKeyTime(const cgltf_animation_sampler& sampler, i32 keyInd)
+{
+    return *(const float*)cgltfAccessAccessor(*sampler.input, keyInd);
+}
+
+static void buildKeyBuckets(const cgltf_animation& anim)
+{
+    samplersKeyBuckets.resize(anim.samplers_count);
+    keyBuckets.resize(0);
+    for(size_t samplerInd = 0; samplerInd < anim.samplers_count; samplerInd++) {
+        const cgltf_animation_sampler& sampler = anim.samplers[samplerInd];
+        const i32 numKeys = sampler.input->count;
+        SamplerKeyBuckets& sb = samplersKeyBuckets[samplerInd];
+        sb.startTime = getKeyTime(sampler, 0);
+        sb.endTime = getKeyTime(sampler, numKeys - 1);
+        sb.firstBucket = keyBuckets.size();
+        sb.numBuckets = tl::max(1u, u32(numKeys) / KEYS_PER_BUCKET);
+        const float range = sb.endTime - sb.startTime;
+        sb.invBucketDuration = range > 0 ? sb.numBuckets / range : 0;
+        i32 keyInd = 0;
+        for(u32 b = 0; b < sb.numBuckets; b++) {
+            const float bucketStart = sb.startTime + range * b / sb.numBuckets;
+            while(keyInd + 1 < numKeys && getKeyTime(sampler, keyInd + 1) <= bucketStart)
+                keyInd++;
+            keyBuckets.push_back(keyInd);
+        }
     }
 }
 
-namespace anims
+// the weights of the node if it has them, otherwise the ones of the mesh, otherwise 0
+static void resetMorphWeights()
 {
-static void initAnim()
+    CSpan<cgltf_node> nodes = getNodes();
+    for(size_t nodeInd = 0; nodeInd < nodes.size(); nodeInd++) {
+        const cgltf_node& node = nodes[nodeInd];
+        const NodeMorphWeights nodeWeights = nodesMorphWeights[nodeInd];
+        if(nodeWeights.count == 0)
+            continue;
+        const float* defaults =
+            node.weights_count == nodeWeights.count ? node.weights :
+            node.mesh->weights_count == nodeWeights.count ? node.mesh->weights : nullptr;
+        for(u32 i = 0; i < nodeWeights.count; i++)
+            morphWeights[nodeWeights.first + i] = defaults ? defaults[i] : 0;
+    }
+}
+
+static void buildMorphWeights()
 {
-    nodesData.resize(parsedData->nodes_count);
-    memset(nodesData.data(), 0, sizeof(NodeData) * parsedData->nodes_count);
-    tl::CSpan<cgltf_animation> anims(parsedData->animations, parsedData->animations_count);
-    size_t requiredMem = 0;
-    if(playingInd > 0) {
-        const cgltf_animation& anim = anims[playingInd-1];
-        tl::CSpan<cgltf_animation_channel> channels(anim.channels, anim.channels_count);
-        for(const cgltf_animation_channel& channel : channels)
-            advanceAnimPathOffset(requiredMem, channel.target_path);
+    CSpan<cgltf_node> nodes = getNodes();
+    nodesMorphWeights.resize(nodes.size());
+    u32 numWeights = 0;
+    for(size_t nodeInd = 0; nodeInd < nodes.size(); nodeInd++) {
+        const cgltf_mesh* mesh = nodes[nodeInd].mesh;
+        u32 count = 0;
+        if(mesh) {
+            for(size_t primInd = 0; primInd < mesh->primitives_count; primInd++)
+                count = tl::max(count, u32(mesh->primitives[primInd].targets_count));
+        }
+        nodesMorphWeights[nodeInd] = {numWeights, count};
+        numWeights += count;
     }
-    animData.resize(requiredMem);
+    morphWeights.resize(numWeights);
+    resetMorphWeights();
+}
 
-    size_t offset = 0;
+static void compressAnim();
+
+// an animation doesn't need to have channels of both kinds, the empty batches are left without frames
+static void bakeBatch(BakedChannels& baked, ChannelsBatch& batch)
+{
+    if(batch.size()) {
+        bakeChannels(baked, batch, duration, float(bakeRate));
+    }
+    else {
+        baked.numChannels = 0;
+        baked.stride = 0;
+        baked.numFrames = 0;
+    }
+}
+
+// the batches of the current animation must be ready
+static void bakeAnim()
+{
+    bakeBatch(vec3Baked, vec3Batch);
+    bakeBatch(rotationBaked, rotationBatch);
+}
+
+static void initAnim()
+{
+    // the nodes of the previous animation have to go back to their rest transforms
+    resetToRestPose(hierarchy, getNodes());
+    resetMorphWeights();
     if(playingInd > 0) {
         const cgltf_animation& anim = parsedData->animations[playingInd-1];
         curKeyInds.resize(anim.samplers_count);
         for(i32& ind : curKeyInds)
             ind = -1;
-        
-        tl::CSpan<cgltf_animation_channel> channels(anim.channels, anim.channels_count);
-        for(const cgltf_animation_channel& channel : channels) {
-            const size_t nodeInd = getNodeInd(channel.target_node);
-            switch(channel.target_path) {
+
+        duration = 0;
+        tl::CSpan<cgltf_animation_sampler> samplers(anim.samplers, anim.samplers_count);
+        for(const cgltf_animation_sampler& sampler : samplers) {
+            assert(sampler.input->has_max);
+            duration = tl::max(duration, sampler.input->max[0]);
+        }
+        buildKeyBuckets(anim);
+
+        vec3Channels.resize(0);
+        rotationChannels.resize(0);
+        weightsChannels.resize(0);
+        for(u32 channelInd = 0; channelInd < anim.channels_count; channelInd++) {
+            switch(anim.channels[channelInd].target_path) {
                 case cgltf_animation_path_type_translation:
-                    nodesData[nodeInd].position = (vec3*)&animData[offset];
+                case cgltf_animation_path_type_scale:
+                    vec3Channels.push_back(channelInd);
                     break;
                 case cgltf_animation_path_type_rotation:
-                    nodesData[nodeInd].rotation = (glm::quat*)&animData[offset];
+                    rotationChannels.push_back(channelInd);
                     break;
-                case cgltf_animation_path_type_scale:
-                    nodesData[nodeInd].scale = (vec3*)&animData[offset];
+                case cgltf_animation_path_type_weights:
+                    weightsChannels.push_back(channelInd);
                     break;
                 default:
-                    assert(false);
+                    break;
             }
-            advanceAnimPathOffset(offset, channel.target_path);
         }
+        vec3Batch.numComponents = 3;
+        vec3Batch.resize(vec3Channels.size());
+        for(size_t i = 0; i < vec3Channels.size(); i++)
+            vec3Batch.setChannel(i, *anim.channels[vec3Channels[i]].sampler);
+        rotationBatch.numComponents = 4;
+        rotationBatch.normalize = true;
+        rotationBatch.resize(rotationChannels.size());
+        for(size_t i = 0; i < rotationChannels.size(); i++)
+            rotationBatch.setChannel(i, *anim.channels[rotationChannels[i]].sampler);
+        if(bake)
+            bakeAnim();
+        if(compress)
+            compressAnim();
+    }
+}
 
-        duration = 0;
-        tl::CSpan<cgltf_animation_sampler> samplers(anim.samplers, anim.samplers_count);
-        for(const cgltf_animation_sampler& sampler : samplers) {
-            assert(sampler.input->has_max);
-            duration = tl::max(duration, sampler.input->max[0]);
-        }
+// the last key in [lo, hi] whose time is <= t. The key lo must satisfy it (or be -1), and the key hi+1 must not
+static i32 searchKey(const cgltf_animation_sampler& sampler, float t, i32 lo, i32 hi)
+{
+    while(lo < hi) {
+        const i32 mid = lo + (hi - lo + 1) / 2;
+        if(getKeyTime(sampler, mid) <= t)
+            lo = mid;
+        else
+            hi = mid - 1;
     }
+    return lo;
 }
 
-template <typename T> static T interpolateAnimValue(const void* X, const void* Y, float a);
-template <> vec3 interpolateAnimValue(const void* X, const void* Y, float a) {
-    return glm::mix(*(const glm::vec3*)X, *(const glm::vec3*)Y, a);
+// the last key whose time is <= t, or -1 if t is before the first key. It doesn't depend on the current key, so it works for any jump in time
+static i32 seekKey(const cgltf_animation_sampler& sampler, size_t samplerInd, float t)
+{
+    const SamplerKeyBuckets& sb = samplersKeyBuckets[samplerInd];
+    const i32 numKeys = sampler.input->count;
+    if(t < sb.startTime)
+        return -1;
+    if(t >= sb.endTime)
+        return numKeys - 1;
+    const u32 b = tl::min(u32((t - sb.startTime) * sb.invBucketDuration), sb.numBuckets - 1);
+    i32 lo = keyBuckets[sb.firstBucket + b];
+    i32 hi = b + 1 < sb.numBuckets ? keyBuckets[sb.firstBucket + b + 1] : numKeys - 1;
+    // the rounding of the bucket computation could leave t just outside of the bucket
+    if(lo >= 0 && getKeyTime(sampler, lo) > t)
+        lo = -1;
+    if(hi + 1 < numKeys && getKeyTime(sampler, hi + 1) <= t)
+        hi = numKeys - 1;
+    return searchKey(sampler, t, lo, hi);
+}
+
+static bool keyContainsTime(const cgltf_animation_sampler& sampler, i32 keyInd, float t)
+{
+    const i32 numKeys = sampler.input->count;
+    return (keyInd < 0 || getKeyTime(sampler, keyInd) <= t) &&
+        (keyInd + 1 >= numKeys || t < getKeyTime(sampler, keyInd + 1));
 }
-template <> glm::quat interpolateAnimValue(const void* X, const void* Y, float a) {
-    const vec4& vx = *(const vec4*)X;
-    const vec4& vy = *(const vec4*)Y;
-    const glm::quat qx = {vx[3], vx[0], vx[1], vx[2]};
-    const glm::quat qy = {vy[3], vy[0], vy[1], vy[2]};
-    return glm::slerp(qx, qy, a);
+
+// during the normal playback the time only moves forward a little, so the current key is still valid or we just need to step to the next one
+// for any other jump (looping back to the start, scrubbing) we seek
+static void updateKeyInd(const cgltf_animation_sampler& sampler, size_t samplerInd)
+{
+    i32& ki = curKeyInds[samplerInd];
+    if(keyContainsTime(sampler, ki, time))
+        return;
+    // the last key has no next one: the time went back, so we seek
+    if(ki + 1 < i32(sampler.input->count) && keyContainsTime(sampler, ki + 1, time))
+        ki++;
+    else
+        ki = seekKey(sampler, samplerInd, time);
 }
 
-template <typename T>
-static T interpolateAnim(cgltf_interpolation_type t, const cgltf_animation_sampler& sampler, i32 curKeyInd, i32 numKeys)
+static void updateKeyInds(const cgltf_animation& anim)
 {
-    auto accessInput = [&](int i) {
-        return cgltfAccessAccessor(*sampler.input, i);
-    };
-    auto accessOutput = [&](int i) {
-        return cgltfAccessAccessor(*sampler.output, i);
-    };
-    switch(t) {
-        case cgltf_interpolation_type_step: {
-            const i32 i = glm::clamp(curKeyInd, 0, numKeys);
-            return *(T*)accessOutput(i);
-            break;
+    const size_t numSamplers = curKeyInds.size();
+    for(size_t i = 0; i < numSamplers; i++)
+        updateKeyInd(anim.samplers[i], i);
+}
+
+static void evalChannelsBatch(ChannelsBatch& batch, tl::CSpan<u32> channelInds, const cgltf_animation& anim)
+{
+    for(size_t i = 0; i < channelInds.size(); i++)
+        batch.keyInds[i] = curKeyInds[getAnimSamplerInd(anim, anim.channels[channelInds[i]].sampler)];
+    evalChannels(batch, time);
+}
+
+// Channels is ChannelsBatch or BakedChannels
+template <typename Channels>
+static void setNodesTransforms(NodeHierarchy& h, const cgltf_animation& anim, const Channels& vec3s, const Channels& rotations)
+{
+    for(size_t i = 0; i < vec3Channels.size(); i++) {
+        const cgltf_animation_channel& channel = anim.channels[vec3Channels[i]];
+        const size_t nodeInd = getNodeInd(channel.target_node);
+        if(channel.target_path == cgltf_animation_path_type_translation)
+            h.setTranslation(nodeInd, vec3s.getVec3(i));
+        else
+            h.setScale(nodeInd, vec3s.getVec3(i));
+    }
+    for(size_t i = 0; i < rotationChannels.size(); i++)
+        h.setRotation(getNodeInd(anim.channels[rotationChannels[i]].target_node), rotations.getQuat(i));
+}
+
+// each channel has all the weights of a node, so there are few channels and they are evaluated one by one
+// the keys are found like for the keyed batches, also when the other channels are baked or compressed
+static void applyWeightsChannels(const cgltf_animation& anim)
+{
+    for(u32 channelInd : weightsChannels) {
+        const cgltf_animation_channel& channel = anim.channels[channelInd];
+        const NodeMorphWeights nodeWeights = nodesMorphWeights[getNodeInd(channel.target_node)];
+        const cgltf_animation_sampler& sampler = *channel.sampler;
+        const i32 numKeys = sampler.input->count;
+        const bool cubic = sampler.interpolation == cgltf_interpolation_type_cubic_spline;
+        const u32 elemsPerKey = cubic ? 3 : 1; // in-tangent, value, out-tangent
+        const u32 numSamplerWeights = sampler.output->count / tl::max(1u, u32(numKeys) * elemsPerKey);
+        const u32 numWeights = tl::min(nodeWeights.count, numSamplerWeights);
+        if(numWeights == 0)
+            continue;
+        const size_t samplerInd = getAnimSamplerInd(anim, &sampler);
+        updateKeyInd(sampler, samplerInd);
+        const i32 keyInd = curKeyInds[samplerInd];
+        // the outputs can be normalized integers
+        auto getElem = [&](i32 key, u32 elem, u32 weightInd) {
+            float x = 0;
+            cgltf_accessor_read_float(sampler.output, (key * elemsPerKey + elem) * numSamplerWeights + weightInd, &x, 1);
+            return x;
+        };
+        float* weights = &morphWeights[nodeWeights.first];
+        const u32 valueElem = cubic ? 1 : 0;
+        if(keyInd < 0 || keyInd + 1 >= numKeys || sampler.interpolation == cgltf_interpolation_type_step) {
+            const i32 key = tl::max(keyInd, 0);
+            for(u32 i = 0; i < numWeights; i++)
+                weights[i] = getElem(key, valueElem, i);
+            continue;
+        }
+        const float timeA = getKeyTime(sampler, keyInd);
+        const float td = getKeyTime(sampler, keyInd + 1) - timeA;
+        const float s = td > 0 ? (time - timeA) / td : 0;
+        if(cubic) {
+            const float s2 = s * s, s3 = s2 * s;
+            for(u32 i = 0; i < numWeights; i++) {
+                weights[i] =
+                    (2*s3 - 3*s2 + 1) * getElem(keyInd, 1, i) + td * (s3 - 2*s2 + s) * getElem(keyInd, 2, i) +
+                    (-2*s3 + 3*s2) * getElem(keyInd + 1, 1, i) + td * (s3 - s2) * getElem(keyInd + 1, 0, i);
+            }
         }
-        case cgltf_interpolation_type_linear: {
-            if(curKeyInd == -1)
-                return *(T*)accessOutput(0);
-            else if(curKeyInd == numKeys-1)
-                return *(T*)accessOutput(numKeys-1);
-            const void* p0 = accessOutput(curKeyInd);
-            const void* p1 = accessOutput(curKeyInd + 1);
-            const float timeA = *(float*)accessInput(curKeyInd);
-            const float timeB = *(float*)accessInput(curKeyInd + 1);
-            const float a = (time - timeA) / (timeB - timeA);
-            return interpolateAnimValue<T>(p0, p1, a);
-            break;
+        else {
+            for(u32 i = 0; i < numWeights; i++)
+                weights[i] = glm::mix(getElem(keyInd, 0, i), getElem(keyInd + 1, 0, i), s);
+        }
+    }
+}
+
+static void applyChannels(const cgltf_animation& anim)
+{
+    if(compress && compressionReport.ok) {
+        evalCompressedChannels(vec3Compressed, time);
+        evalCompressedChannels(rotationCompressed, time);
+        setNodesTransforms(hierarchy, anim, vec3Compressed, rotationCompressed);
+    }
+    else if(bake) {
+        evalBakedChannels(vec3Baked, time);
+        evalBakedChannels(rotationBaked, time);
+        setNodesTransforms(hierarchy, anim, vec3Baked, rotationBaked);
+    }
+    else {
+        updateKeyInds(anim);
+        evalChannelsBatch(vec3Batch, vec3Channels, anim);
+        evalChannelsBatch(rotationBatch, rotationChannels, anim);
+        setNodesTransforms(hierarchy, anim, vec3Batch, rotationBatch);
+    }
+    applyWeightsChannels(anim);
+}
+
+// plays the animation with the raw channels and with the compressed ones, at twice the rate of the frames, and compares the world positions of the nodes
+static void measureCompressionError(const cgltf_animation& anim)
+{
+    static NodeHierarchy rawHierarchy, compressedHierarchy;
+    static tl::Vector<glm::mat4> rawWorlds, compressedWorlds;
+    static tl::Vector<u32> updatedNodes;
+    CSpan<cgltf_node> nodes = getNodes();
+    buildNodeHierarchy(rawHierarchy, nodes);
+    buildNodeHierarchy(compressedHierarchy, nodes);
+    rawWorlds.resize(nodes.size());
+    compressedWorlds.resize(nodes.size());
+    CompressionReport& report = compressionReport;
+    report.nodesMaxError.resize(nodes.size());
+    for(float& e : report.nodesMaxError)
+        e = 0;
+
+    const float savedTime = time;
+    // one of the batches can be empty, and then it has no frames
+    const CompressedChannels& frames = vec3Compressed.numFrames ? vec3Compressed : rotationCompressed;
+    const u32 numSamples = frames.numFrames ? 2 * frames.numFrames - 1 : 0;
+    for(u32 sampleInd = 0; sampleInd < numSamples; sampleInd++) {
+        time = glm::min(sampleInd / (2 * frames.rate), duration);
+        updateKeyInds(anim);
+        evalChannelsBatch(vec3Batch, vec3Channels, anim);
+        evalChannelsBatch(rotationBatch, rotationChannels, anim);
+        setNodesTransforms(rawHierarchy, anim, vec3Batch, rotationBatch);
+        evalCompressedChannels(vec3Compressed, time);
+        evalCompressedChannels(rotationCompressed, time);
+        setNodesTransforms(compressedHierarchy, anim, vec3Compressed, rotationCompressed);
+        updateNodeHierarchy(rawHierarchy, rawWorlds, updatedNodes);
+        updateNodeHierarchy(compressedHierarchy, compressedWorlds, updatedNodes);
+        for(size_t nodeInd = 0; nodeInd < nodes.size(); nodeInd++) {
+            const float e = glm::distance(vec3(rawWorlds[nodeInd][3]), vec3(compressedWorlds[nodeInd][3]));
+            report.nodesMaxError[nodeInd] = tl::max(report.nodesMaxError[nodeInd], e);
         }
-        case cgltf_interpolation_type_cubic_spline:
-        default: {
-            assert(false && "not implemented");
+    }
+    time = savedTime;
+
+    report.maxError = 0;
+    report.nodesByError.resize(0);
+    for(u32 nodeInd = 0; nodeInd < nodes.size(); nodeInd++) {
+        report.maxError = tl::max(report.maxError, report.nodesMaxError[nodeInd]);
+        if(report.nodesMaxError[nodeInd] > 0)
+            report.nodesByError.push_back(nodeInd);
+    }
+    std::sort(report.nodesByError.begin(), report.nodesByError.end(), [&](u32 a, u32 b) {
+        return report.nodesMaxError[a] > report.nodesMaxError[b];
+    });
+}
+
+// the batches of the current animation must be ready
+static void compressAnim()
+{
+    const cgltf_animation& anim = parsedData->animations[glm::abs(playingInd)-1];
+    static BakedChannels vec3Frames, rotationFrames;
+    // the empty batches get no frames, and compress to no keys
+    bakeBatch(vec3Frames, vec3Batch);
+    bakeBatch(rotationFrames, rotationBatch);
+    CompressionReport& report = compressionReport;
+    report.ok = compressChannels(vec3Compressed, vec3Frames, compressTolerance) &&
+        compressChannels(rotationCompressed, rotationFrames, compressTolerance);
+    if(!report.ok)
+        return;
+
+    // the accessors can be shared by several samplers, we count them once
+    tl::Vector<const cgltf_accessor*> accessors;
+    for(tl::CSpan<u32> channelInds : {tl::CSpan<u32>(vec3Channels), tl::CSpan<u32>(rotationChannels)}) {
+        for(u32 channelInd : channelInds) {
+            const cgltf_animation_sampler& sampler = *anim.channels[channelInd].sampler;
+            accessors.push_back(sampler.input);
+            accessors.push_back(sampler.output);
         }
     }
-    return {};
+    std::sort(accessors.begin(), accessors.end());
+    report.rawBytes = 0;
+    for(size_t i = 0; i < accessors.size(); i++)
+        if(i == 0 || accessors[i] != accessors[i-1])
+            report.rawBytes += accessors[i]->count * cgltfTypeNumComponents(accessors[i]->type) * sizeof(float);
+    report.compressedBytes = vec3Compressed.memorySize() + rotationCompressed.memorySize();
+    report.numFrames = vec3Compressed.numFrames * vec3Compressed.size() + rotationCompressed.numFrames * rotationCompressed.size();
+    report.numKeys = vec3Compressed.numKeys() + rotationCompressed.numKeys();
+    measureCompressionError(anim);
 }
 
 static void update(float dt)
@@ -484,123 +1051,162 @@ static void update(float dt)
     if(playingInd <= 0)
         return;
     const cgltf_animation& anim = parsedData->animations[playingInd-1];
-    const int numSamplers = curKeyInds.size();
-
     time += dt;
     time = fmodf(time, duration); // looping by default for now
     assert(time >= 0 && time < duration);
-    for(int i = 0; i < numSamplers; i++) {
-        auto& sampler = anim.samplers[i];
-        auto& ki = curKeyInds[i];
-        const int numKeys = sampler.input->count;
-        auto advanceKeyIfNeeded = [&]() -> bool
-        {
-            if(ki == -1) { // corner case at the beginning
-                const float timeB = *(float*)cgltfAccessAccessor(*sampler.input, ki + 1);
-                if(time < timeB)
-                    return false;
-                else {
-                    ki++;
-                    return true;
-                }
-            }
-            else if(ki == numKeys-1) { // corner case at the end
-                const float timeA = *(float*)cgltfAccessAccessor(*sampler.input, ki);
-                if(time >= timeA)
-                    return false;
-                else {
-                    ki = -1;
-                    return true;
-                }
-            }
+    applyChannels(anim);
+}
 
-            const float timeA = *(float*)cgltfAccessAccessor(*sampler.input, ki);
-            const float timeB = *(float*)cgltfAccessAccessor(*sampler.input, ki + 1);
+// jumps to any time of the current animation. It also works when the animation is paused
+static void seek(float t)
+{
+    if(playingInd == 0)
+        return;
+    const cgltf_animation& anim = parsedData->animations[glm::abs(playingInd)-1];
+    time = glm::clamp(t, 0.f, duration);
+    applyChannels(anim);
+}
+}
 
-            if(time < timeA)
-                ki = -1;
-            else if(time < timeB)
-                return false;
-            else
-                ki++;
+// recomputes the world matrices of the nodes whose transform changed, and their descendants. When nothing changed, it does nothing
+static void updateNodesMatrices()
+{
+    anims::nodesMatrices.resize(parsedData->nodes_count);
+    updateNodeHierarchy(anims::hierarchy, anims::nodesMatrices, anims::updatedNodes);
+}
 
-            return true;
-        };
-        
-        while(advanceKeyIfNeeded());
+// the box of the mesh of the node, in the space of the node. If the node has EXT_mesh_gpu_instancing, it includes all the instances
+static const Aabb& getNodeMeshLocalAabb(const cgltf_node& node)
+{
+    const i32 instancesInd = parsedDataGpuInstances.nodesInstances[getNodeInd(&node)];
+    if(instancesInd >= 0)
+        return parsedDataGpuInstances.nodes[instancesInd].localBox;
+    return parsedDataMeshAabbs[getMeshInd(node.mesh)];
+}
+
+// must be called after the matrices have been updated. Only the boxes of the nodes that moved are recomputed
+static void updateNodesAabbs()
+{
+    CSpan<cgltf_node> nodes = getNodes();
+    if(anims::nodesAabbs.size() != nodes.size())
+        anims::nodesAabbs.resize(nodes.size());
+    for(u32 nodeInd : anims::updatedNodes) {
+        const cgltf_node& node = nodes[nodeInd];
+        if(node.mesh == nullptr) // empty box, so it's always culled
+            anims::nodesAabbs.set(nodeInd, Aabb::UNDEF());
+        else if(node.skin || anims::nodesMorphWeights[nodeInd].count) // the joints and the morph targets move the vertices out of the box, so we don't cull them
+            anims::nodesAabbs.setInfinite(nodeInd);
+        else
+            anims::nodesAabbs.set(nodeInd, transformAabb(getNodeMeshLocalAabb(node), anims::nodesMatrices[nodeInd]));
     }
+}
 
-    tl::CSpan<cgltf_animation_channel> channels(anim.channels, anim.channels_count);
-    for(const cgltf_animation_channel& channel : channels) {
-        const size_t nodeInd = getNodeInd(channel.target_node);
-        const cgltf_animation_sampler* sampler = channel.sampler;
-        const size_t samplerInd = getAnimSamplerInd(anim, sampler);
-        const i32 curKeyInd = curKeyInds[samplerInd];
-        const i32 numKeys = sampler->input->count;
-
-        switch(channel.target_path) {
-            case cgltf_animation_path_type_translation: {
-                auto& pos = *nodesData[nodeInd].position;
-                assert(&pos);
-                pos = interpolateAnim<vec3>(sampler->interpolation, *sampler, curKeyInd, numKeys);
-                break;
-            }
-            case cgltf_animation_path_type_rotation: {
-                auto& rot = *nodesData[nodeInd].rotation;
-                assert(&rot);
-                rot = interpolateAnim<glm::quat>(sampler->interpolation, *sampler, curKeyInd, numKeys);
-                break;
-            }
-            case cgltf_animation_path_type_scale: {
-                auto& scale = *nodesData[nodeInd].scale;
-                assert(&scale);
-                scale = interpolateAnim<vec3>(sampler->interpolation, *sampler, curKeyInd, numKeys);
-                break;
+// must be called after updateNodesAabbs. The tlas is built once per scene, and refitted when the nodes move
+static void updatePickingTlas()
+{
+    using namespace picking;
+    if(!tlasNeedsBuild && anims::updatedNodes.size() == 0)
+        return;
+    if(tlasNeedsBuild) {
+        tlasInstances.resize(0);
+        CSpan<cgltf_node> nodes = getNodes();
+        for(u32 nodeInd = 0; nodeInd < nodes.size(); nodeInd++) {
+            if(nodes[nodeInd].mesh == nullptr || nodes[nodeInd].skin)
+                continue;
+            // each EXT_mesh_gpu_instancing instance gets its own primitive, so the rays don't have to test all of them
+            const i32 gpuInstancesInd = parsedDataGpuInstances.nodesInstances[nodeInd];
+            if(gpuInstancesInd < 0) {
+                tlasInstances.push_back({nodeInd, ~0u});
+                continue;
             }
-            default:
-                assert(false);
+            const GpuInstances::NodeInstances& nodeInstances = parsedDataGpuInstances.nodes[gpuInstancesInd];
+            for(u32 i = 0; i < nodeInstances.numInstances; i++)
+                tlasInstances.push_back({nodeInd, nodeInstances.firstInstance + i});
         }
     }
-}
+    tlasBoxes.resize(tlasInstances.size());
+    for(size_t i = 0; i < tlasInstances.size(); i++) {
+        const TlasInstance& instance = tlasInstances[i];
+        if(instance.gpuInstanceInd == ~0u) {
+            tlasBoxes[i] = anims::nodesAabbs.get(instance.nodeInd);
+        }
+        else {
+            const cgltf_node& node = parsedData->nodes[instance.nodeInd];
+            const glm::mat4 mtx = anims::nodesMatrices[instance.nodeInd] * parsedDataGpuInstances.matrices[instance.gpuInstanceInd];
+            tlasBoxes[i] = transformAabb(parsedDataMeshAabbs[getMeshInd(node.mesh)], mtx);
+        }
+    }
+    if(tlasNeedsBuild)
+        buildBvh(tlas, tlasBoxes);
+    else
+        refitBvh(tlas, tlasBoxes);
+    tlasNeedsBuild = false;
 }
 
-static void calcNodesMatricesRecursive(const cgltf_node& node, const glm::mat4& parentMat = glm::mat4(1.0))
+static bool raycastScene(picking::Hit& hit, const Ray& ray)
 {
-    const i32 nodeInd = getNodeInd(&node);
-    const auto animData = anims::playingInd ? &anims::nodesData[nodeInd] : nullptr;
-    glm::mat4& mtx = anims::nodesMatrices[nodeInd];
-    mtx = parentMat;
-    if(node.has_matrix)
-        mtx *= glm::make_mat4(node.matrix);
-
-    if(animData && animData->position)
-        mtx *= glm::translate(glm::mat4(1), *animData->position);
-    else if(node.has_translation)
-        mtx *= glm::translate(glm::mat4(1), {node.translation[0], node.translation[1], node.translation[2]});
-
-    if(animData && animData->rotation)
-        mtx *= glm::toMat4(*animData->rotation);
-    else if(node.has_rotation)
-        mtx *= glm::toMat4(glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]));
-
-    if(animData && animData->scale)
-        mtx *= glm::scale(glm::mat4(1), *animData->scale);
-    else if(node.has_scale)
-        mtx *= glm::scale(glm::mat4(1), vec3(node.scale[0], node.scale[1], node.scale[2]));
-
-    CSpan<cgltf_node*> children(node.children, node.children_count);
-    for(cgltf_node* child : children) {
-        assert(child);
-        calcNodesMatricesRecursive(*child, mtx);
+    using namespace picking;
+    float closestT = FLT_MAX;
+    traverseBvh(tlas, ray, closestT, [&](u32 instanceInd, float& tMax)
+    {
+        const TlasInstance& instance = tlasInstances[instanceInd];
+        cgltf_node& node = parsedData->nodes[instance.nodeInd];
+        const MeshBvh& meshBvh = parsedDataMeshBvhs[getMeshInd(node.mesh)];
+        glm::mat4 modelMtx = anims::nodesMatrices[instance.nodeInd];
+        if(instance.gpuInstanceInd != ~0u)
+            modelMtx *= parsedDataGpuInstances.matrices[instance.gpuInstanceInd];
+        // the direction is not normalized, so the distances along the ray are the same in both spaces
+        const glm::mat4 invModelMtx = glm::affineInverse(modelMtx);
+        const Ray localRay = {vec3(invModelMtx * vec4(ray.origin, 1)), vec3(invModelMtx * vec4(ray.dir, 0))};
+        traverseBvh(meshBvh.bvh, localRay, tMax, [&](u32 triInd, float& tMaxMesh)
+        {
+            const vec3* v = &meshBvh.triVerts[3 * triInd];
+            float t;
+            if(intersectRayTriangle(localRay, v[0], v[1], v[2], t) && t < tMaxMesh) {
+                tMaxMesh = t;
+                hit.node = &node;
+                hit.gpuInstanceInd = ~0u;
+                if(instance.gpuInstanceInd != ~0u) {
+                    const i32 gpuInstancesInd = parsedDataGpuInstances.nodesInstances[instance.nodeInd];
+                    hit.gpuInstanceInd = instance.gpuInstanceInd - parsedDataGpuInstances.nodes[gpuInstancesInd].firstInstance;
+                }
+                const u32* primEnd = std::upper_bound(meshBvh.primsFirstTri.begin(), meshBvh.primsFirstTri.end(), triInd);
+                hit.primInd = u32(primEnd - meshBvh.primsFirstTri.begin()) - 1;
+                hit.triInd = triInd - meshBvh.primsFirstTri[hit.primInd];
+            }
+        });
+    });
+    if(closestT == FLT_MAX)
+        return false;
+    hit.point = ray.origin + closestT * ray.dir;
+    hit.distance = closestT * glm::length(ray.dir);
+    return true;
+}
+
+// binds the texture of the image together with the sampler object of the cgltf_texture
+// the texture and sampler objects to use for a texture of a material. The fallback is used while the texture is not uploaded
+static void resolveTexture(u32& texture, u32& sampler, const cgltf_texture* tex, u32 fallbackTexture)
+{
+    if(tex && tex->image && gpu::scene.texturesReady[getImageInd(tex->image)]) {
+        texture = gpu::scene.textures[getImageInd(tex->image)];
+        sampler = gpu::scene.texturesSampler[getTextureInd(tex)];
+    }
+    else {
+        texture = fallbackTexture;
+        sampler = gpu::basicSampler;
     }
 }
 
 static void imguiTexture(size_t textureInd, float* height)
 {
     const size_t i = textureInd;
-    const float aspectRatio = (float)gpu::textureSizes[i].x / gpu::textureSizes->y;
-    ImGui::SliderFloat("Scale", height, MIN_IMGUI_IMG_HEIGHT, gpu::textureSizes[i].y, "%.0f");
-    ImGui::Image((void*)(u64)gpu::textures[i], {*height * aspectRatio, *height});
+    if(!gpu::scene.texturesReady[i]) {
+        ImGui::Text("(not uploaded)");
+        return;
+    }
+    const float aspectRatio = (float)gpu::scene.textureSizes[i].x / gpu::scene.textureSizes[i].y;
+    ImGui::SliderFloat("Scale", height, MIN_IMGUI_IMG_HEIGHT, gpu::scene.textureSizes[i].y, "%.0f");
+    ImGui::Image((void*)(u64)gpu::scene.textures[i], {*height * aspectRatio, *height});
 }
 
 static void imguiTextureView(const cgltf_texture_view& view, float* height)
@@ -615,7 +1221,8 @@ static void imguiTextureView(const cgltf_texture_view& view, float* height)
         ImGui::Text("Texcoord index: %d", tr.texcoord);
     }
     ImGui::Text("Texcoord index: %d", view.texcoord);
-    imguiTexture(getTextureInd(view.texture), height);
+    if(view.texture->image)
+        imguiTexture(getImageInd(view.texture->image), height);
 }
 
 static void imguiMaterial(const cgltf_material& material)
@@ -630,19 +1237,19 @@ static void imguiMaterial(const cgltf_material& material)
         ImGui::Text("Base color factor: {%g, %g, %g, %g}", colorFactor[0], colorFactor[1], colorFactor[2], colorFactor[3]);
         ImGui::Text("Metallic factor: %g", props.metallic_factor);
         ImGui::Text("Roughness factor: %g", props.roughness_factor);
-        if(props.base_color_texture.texture)
+        if(props.base_color_texture.texture && props.base_color_texture.texture->image)
         {
-            const size_t texInd = getTextureInd(props.base_color_texture.texture);
-            tl::toStringBuffer(scratchStr(), "Color texture: ", i, " - ", gpu::textureSizes[texInd].x, "x", gpu::textureSizes[texInd].y);
+            const size_t texInd = getImageInd(props.base_color_texture.texture->image);
+            tl::toStringBuffer(scratchStr(), "Color texture: ", i, " - ", gpu::scene.textureSizes[texInd].x, "x", gpu::scene.textureSizes[texInd].y);
             if(ImGui::TreeNode(scratchStr())) {
                 imguiTextureView(props.base_color_texture, &imgui_state::materialTexturesHeights[i].color);
                 ImGui::TreePop();
             }
         }
-        if(props.metallic_roughness_texture.texture)
+        if(props.metallic_roughness_texture.texture && props.metallic_roughness_texture.texture->image)
         {
-            const size_t texInd = getTextureInd(props.metallic_roughness_texture.texture);
-            tl::toStringBuffer(scratchStr(), "Metallic-roughness texture: ", i, " - ", gpu::textureSizes[texInd].x, "x", gpu::textureSizes[texInd].y);
+            const size_t texInd = getImageInd(props.metallic_roughness_texture.texture->image);
+            tl::toStringBuffer(scratchStr(), "Metallic-roughness texture: ", i, " - ", gpu::scene.textureSizes[texInd].x, "x", gpu::scene.textureSizes[texInd].y);
             if(ImGui::TreeNode(scratchStr())) {
                 imguiTextureView(props.metallic_roughness_texture, &imgui_state::materialTexturesHeights[i].metallicRoughness);
                 ImGui::TreePop();
@@ -802,134 +1409,417 @@ static const cgltf_material s_defaultMaterial =
     false, // unlit
 };
 
-static void drawSceneNodeRecursive(const cgltf_node& node, const glm::mat4& viewProj,
-    const glm::mat4& parentMat = glm::mat4(1.0))
+// the primitives of the scene are collected every frame into a flat list, which is sorted so the primitives that share state are drawn together
+namespace draw_list
 {
-    const i32 nodeInd = getNodeInd(&node);
-    const glm::mat4& modelMat = anims::nodesMatrices[nodeInd];
+constexpr int NUM_TEX_UNITS = 2; // albedo and normal, the shader doesn't use the other units yet
+
+struct DrawItem {
+    const ShaderData* shader;
+    u32 materialInd; // in SceneResources::materialsUbo, the last one is the default material
+    u32 nodeInd; // the transform is in anims::nodesMatrices
+    u32 vao;
+    u32 textures[NUM_TEX_UNITS];
+    u32 samplers[NUM_TEX_UNITS];
+    u32 firstJoint; // palette of the skin inside jointMatrices, ~0u without skinning
+    i32 morphOffset; // first texel of the blended deltas inside morphDeltas, -1 if no morph target has weight
+    GLenum primType;
+    GLenum indexType; // 0 if the primitive doesn't have indices
+    u32 count; // of indices or vertices
+    size_t indexOffset; // inside the indices buffer object
+    u32 firstInstance, numInstances; // in SceneResources::gpuInstancesBo, for the nodes with EXT_mesh_gpu_instancing. 0 instances otherwise
+};
 
-    if(node.mesh)
-    {
-        const int skinning = node.skin ? 1 : 0;
-        int numJoints = 0;
-        glm::mat4 jointMatrices[MAX_NUM_JOINTS];
-        if(node.skin) {
-            numJoints = node.skin->joints_count;
-            const glm::mat4 modelMatInv = glm::affineInverse(modelMat);
-            for(size_t i = 0; i < numJoints; i++) {
-                const cgltf_node& joint = *node.skin->joints[i];
-                const size_t jointNodeInd = getNodeInd(&joint);
-                const glm::mat4& invBindMtx = *(const glm::mat4*)cgltfAccessAccessor(*node.skin->inverse_bind_matrices, i);
-                jointMatrices[i] =
-                    modelMatInv *
-                    anims::nodesMatrices[jointNodeInd] *
-                    invBindMtx;
-            }
-        }
+// how many times each kind of state was set in the last frame
+struct Stats {
+    u32 visibleNodes, culledNodes; // only counting the nodes with a mesh
+    u32 culledPrims;
+    u32 items;
+    u32 programChanges;
+    u32 transformChanges;
+    u32 materialChanges;
+    u32 textureChanges; // counting the samplers
+    u32 vaoChanges;
+    u32 instancedDraws;
+    u32 instances; // items drawn by the instanced draws
+    u32 skinPalettes, joints;
+    u32 morphedPrims, morphTargets; // the targets with a non-zero weight that were blended for the morphed primitives
+};
 
-        const glm::mat3 modelMat3 = modelMat;
-        const glm::mat4 modelViewProj = viewProj * modelMat;
-        CSpan<cgltf_primitive> primitives(node.mesh->primitives, node.mesh->primitives_count);
-        const u32* vaos = gpu::vaos.begin() + gpu::meshPrimsVaos[getMeshInd(node.mesh)];
-        for(size_t i = 0; i < primitives.size(); i++)
-        {
-            const cgltf_primitive& prim = primitives[i];
-            const u32 vao = vaos[i];
-            const auto& material = prim.material ? *prim.material : s_defaultMaterial;
+// consecutive sorted items that can be drawn with one call. If there is more than one item, the draw is instanced
+struct Batch {
+    u32 firstKey;
+    u32 numItems;
+    u32 firstInstance; // inside instanceMatrices
+    u32 drawUniformsInd; // inside drawUniforms
+};
+constexpr u32 MIN_INSTANCES = 2;
+
+static tl::Vector<DrawItem> items;
+static tl::Vector<SortKey> keys, keysTemp;
+static tl::Vector<glm::mat4> jointMatrices; // palettes of the skins of the visible nodes, uploaded to gpu::jointsBo
+static tl::Vector<u32> skinsFirstJoint; // palette of each skin in jointMatrices, ~0u if it hasn't been needed in this frame
+static tl::Vector<glm::vec4> morphDeltas; // blended morph targets of the visible primitives, 2 texels per vertex (position, normal). Uploaded to gpu::morphBo
+static tl::Vector<u8> nodesVisible; // result of the frustum culling
+static tl::Vector<Batch> batches;
+static tl::Vector<glm::mat4> instanceMatrices;
+static tl::Vector<u8> drawUniforms; // DrawUniforms of the frame, with the stride that the UBO ranges need
+static size_t drawUniformsOffset; // where drawUniforms was written in gpu::drawUbo
+static Stats stats;
+
+// from the most significant bits: program (4), material (16), vao (24), node (20)
+// the key only decides the order, so if the indices don't fit we just get more state changes
+static u64 makeKey(u32 shaderInd, u32 materialInd, u32 vaoInd, u32 nodeInd)
+{
+    return (u64(shaderInd & 0xF) << 60) | (u64(materialInd & 0xFFFF) << 44) | (u64(vaoInd & 0xFFFFFF) << 20) | u64(nodeInd & 0xFFFFF);
+}
 
-            auto draw = [&]
-            {
-                glActiveTexture(GL_TEXTURE0 + (u32)ETexUnit::ALBEDO);
-                if(material.has_pbr_metallic_roughness) {
-                    glUniform4fv(gpu::shaderPbrMetallic(skinning).unifLocs.color,
-                                 1, material.pbr_metallic_roughness.base_color_factor);
-                    if(auto tex = material.pbr_metallic_roughness.base_color_texture.texture)
-                        glBindTexture(GL_TEXTURE_2D, gpu::textures[getTextureInd(tex)]);
-                    else
-                        glBindTexture(GL_TEXTURE_2D, gpu::whiteTexture);
-                }
-                else if(material.has_pbr_specular_glossiness) {
-                    assert("todo" && false);
-                }
+// the palette is computed the first time a skin is needed in the frame, the other nodes with the same skin share it
+// the joint matrices take the vertices directly to world space, the transform of the skinned node is ignored (as the spec says)
+static u32 getSkinPalette(const cgltf_skin& skin)
+{
+    u32& firstJoint = skinsFirstJoint[getSkinInd(&skin)];
+    if(firstJoint != ~0u)
+        return firstJoint;
+    firstJoint = jointMatrices.size();
+    const u32 numJoints = skin.joints_count;
+    jointMatrices.resize(firstJoint + numJoints);
+    for(u32 i = 0; i < numJoints; i++) {
+        const glm::mat4& jointMtx = anims::nodesMatrices[getNodeInd(skin.joints[i])];
+        if(skin.inverse_bind_matrices) {
+            const glm::mat4& invBindMtx = *(const glm::mat4*)cgltfAccessAccessor(*skin.inverse_bind_matrices, i);
+            jointMatrices[firstJoint + i] = jointMtx * invBindMtx;
+        }
+        else {
+            jointMatrices[firstJoint + i] = jointMtx;
+        }
+    }
+    stats.skinPalettes++;
+    stats.joints += numJoints;
+    return firstJoint;
+}
 
-                glActiveTexture(GL_TEXTURE0 + (u32)ETexUnit::NORMAL);
-                if(auto tex = material.normal_texture.texture)
-                    glBindTexture(GL_TEXTURE_2D, gpu::textures[getTextureInd(tex)]);
-                else
-                    glBindTexture(GL_TEXTURE_2D, gpu::blueTexture);
-
-                glBindVertexArray(vao);
-                if(prim.indices) {
-                    glDrawElements(
-                       cgltfPrimTypeToGl(prim.type),
-                       prim.indices->count,
-                       cgltfComponentTypeToGl(prim.indices->component_type),
-                       (void*)(prim.indices->buffer_view->offset + prim.indices->offset)
-                    );
-                }
-                else {
-                    glDrawArrays(cgltfPrimTypeToGl(prim.type), 0, prim.attributes->data->count);
+static void collect(const glm::mat4& viewProj)
+{
+    items.resize(0);
+    keys.resize(0);
+    jointMatrices.resize(0);
+    morphDeltas.resize(0);
+    skinsFirstJoint.resize(parsedData->skins_count);
+    for(u32& firstJoint : skinsFirstJoint)
+        firstJoint = ~0u;
+    stats = {};
+    CSpan<cgltf_node> nodes = getNodes();
+    nodesVisible.resize(nodes.size());
+    if(imgui_state::frustumCulling)
+        cullAabbs(nodesVisible, anims::nodesAabbs, extractFrustum(viewProj));
+    else
+        memset(nodesVisible.data(), 1, nodesVisible.size());
+    for(u32 nodeInd = 0; nodeInd < nodes.size(); nodeInd++)
+    {
+        const cgltf_node& node = nodes[nodeInd];
+        if(node.mesh == nullptr)
+            continue;
+        if(!nodesVisible[nodeInd]) {
+            stats.culledNodes++;
+            stats.culledPrims += node.mesh->primitives_count;
+            continue;
+        }
+        stats.visibleNodes++;
+        const i32 gpuInstancesInd = parsedDataGpuInstances.nodesInstances[nodeInd];
+        if(gpuInstancesInd >= 0 && parsedDataGpuInstances.nodes[gpuInstancesInd].numInstances == 0)
+            continue;
+        // the instanced nodes can't be skinned (the extension doesn't allow it)
+        const int shaderInd = gpuInstancesInd >= 0 ? 2 : node.skin ? 1 : 0;
+        const u32 firstJoint = shaderInd == 1 ? getSkinPalette(*node.skin) : ~0u;
+        // the targets are only blended when some weight is not 0, otherwise the mesh is drawn like one without targets
+        const anims::NodeMorphWeights nodeWeights = anims::nodesMorphWeights[nodeInd];
+        const CSpan<float> morphWeights(anims::morphWeights.data() + nodeWeights.first, nodeWeights.count);
+        bool morphed = false;
+        for(float w : morphWeights)
+            morphed |= w != 0;
+
+        const u32 vaoBeginInd = gpu::scene.meshPrimsVaos[getMeshInd(node.mesh)];
+        CSpan<cgltf_primitive> prims(node.mesh->primitives, node.mesh->primitives_count);
+        for(u32 primInd = 0; primInd < prims.size(); primInd++)
+        {
+            const cgltf_primitive& prim = prims[primInd];
+            const cgltf_material& material = prim.material ? *prim.material : s_defaultMaterial;
+            if(!material.has_pbr_metallic_roughness) {
+                assert(false && "type of material not supported");
+                continue;
+            }
+            DrawItem item;
+            item.shader = shaderInd == 2 ? &gpu::shaderPbrMetallicInstanced() : &gpu::shaderPbrMetallic(shaderInd);
+            item.materialInd = prim.material ? getMaterialInd(prim.material) : parsedData->materials_count;
+            item.nodeInd = nodeInd;
+            item.vao = gpu::scene.vaos[vaoBeginInd + primInd];
+            resolveTexture(item.textures[(int)ETexUnit::ALBEDO], item.samplers[(int)ETexUnit::ALBEDO],
+                material.pbr_metallic_roughness.base_color_texture.texture, gpu::whiteTexture);
+            resolveTexture(item.textures[(int)ETexUnit::NORMAL], item.samplers[(int)ETexUnit::NORMAL],
+                material.normal_texture.texture, gpu::blueTexture);
+            item.firstJoint = firstJoint;
+            item.morphOffset = -1;
+            if(morphed) {
+                const MorphTargets::Prim& morphPrim = parsedDataMorphTargets.getPrim(getMeshInd(node.mesh), primInd);
+                if(morphPrim.numTargets) {
+                    const u32 morphOffset = morphDeltas.size();
+                    morphDeltas.resize(morphOffset + 2 * morphPrim.numVerts);
+                    stats.morphTargets += blendMorphTargets(&morphDeltas[morphOffset], parsedDataMorphTargets, morphPrim, morphWeights);
+                    stats.morphedPrims++;
+                    item.morphOffset = morphOffset;
                 }
-            };
-            auto uploadCommonUniforms = [&](const ShaderData& shader)
-            {
-                glUniformMatrix4fv(shader.unifLocs.modelViewProj, 1, GL_FALSE, &modelViewProj[0][0]);
-                glUniformMatrix3fv(shader.unifLocs.modelMat3, 1, GL_FALSE, &modelMat3[0][0]);
-                if(skinning)
-                    glUniformMatrix4fv(shader.unifLocs.jointMatrices, numJoints, GL_FALSE, &jointMatrices[0][0][0]);
-            };
-
-            if(material.has_pbr_metallic_roughness)
-            {
-                auto& shader = gpu::shaderPbrMetallic(skinning);
-                glUseProgram(shader.prog);
-                uploadCommonUniforms(shader);
-                draw();
+            }
+            item.primType = cgltfPrimTypeToGl(prim.type);
+            if(prim.indices) {
+                item.indexType = cgltfComponentTypeToGl(prim.indices->component_type);
+                item.count = prim.indices->count;
+                item.indexOffset = gpu::scene.bufferViewsOffset[getBufferViewInd(prim.indices->buffer_view)] + prim.indices->offset;
             }
             else {
-                assert(false && "type of material not supported");
+                item.indexType = 0;
+                item.count = prim.attributes->data->count;
+                item.indexOffset = 0;
             }
+            item.firstInstance = item.numInstances = 0;
+            if(gpuInstancesInd >= 0) {
+                const GpuInstances::NodeInstances& nodeInstances = parsedDataGpuInstances.nodes[gpuInstancesInd];
+                item.firstInstance = nodeInstances.firstInstance;
+                item.numInstances = nodeInstances.numInstances;
+            }
+            const u32 materialInd = prim.material ? getMaterialInd(prim.material) : 0xFFFF;
+            keys.push_back({makeKey(shaderInd, materialInd, vaoBeginInd + primInd, nodeInd), (u32)items.size()});
+            items.push_back(item);
         }
     }
-
-    CSpan<cgltf_node*> children(node.children, node.children_count);
-    for(cgltf_node* child : children) {
-        assert(child);
-        drawSceneNodeRecursive(*child, viewProj, modelMat);
-    }
 }
 
-static void drawAxes(const glm::mat4& viewProj)
+// the items that only differ in the node (same mesh primitive and material, without skinning or morphing) can share an instanced draw
+static bool canShareDraw(const DrawItem& a, const DrawItem& b)
 {
-    if(!imgui_state::showAxes)
-        return;
-    auto& shadInfo = gpu::shaderVertColor();
-    glUseProgram(shadInfo.prog);
-
-    const glm::mat4 modelMat = glm::scale(glm::mat4(1), vec3(1000));
-    const glm::mat4 modelViewProj = viewProj * modelMat;
+    return a.shader == b.shader && a.materialInd == b.materialInd && a.vao == b.vao && a.morphOffset < 0 && b.morphOffset < 0;
+}
 
-    glUniformMatrix4fv(shadInfo.locs.modelViewProj, 1, GL_FALSE, &modelViewProj[0][0]);
-    glBindVertexArray(gpu::axesVao);
-    glDrawArrays(GL_LINES, 0, 12);
+static DrawUniforms& pushDrawUniforms()
+{
+    const size_t stride = uboStride(sizeof(DrawUniforms));
+    drawUniforms.resize(drawUniforms.size() + stride);
+    return *(DrawUniforms*)(drawUniforms.end() - stride);
 }
 
-static void drawFloorGrid(const glm::mat4& viewMat, const glm::mat4& viewProj)
+// writes drawUniforms after the ones of the previous frame, without waiting for the GPU to finish reading those
+static void uploadDrawUniforms()
 {
-    if(!imgui_state::showFloorGrid)
-        return;
-    auto& shadInfo = gpu::shaderFloorGrid();
-    glUseProgram(shadInfo.prog);
+    const size_t size = drawUniforms.size();
+    glBindBuffer(GL_UNIFORM_BUFFER, gpu::drawUbo);
+    if(size > gpu::drawUboSize || gpu::drawUboCursor + size > gpu::drawUboSize) {
+        // orphaning: the driver gives us new storage, and the old one is freed when the GPU is done with it
+        gpu::drawUboSize = glm::max(gpu::drawUboSize, 2 * size);
+        glBufferData(GL_UNIFORM_BUFFER, gpu::drawUboSize, nullptr, GL_STREAM_DRAW);
+        gpu::drawUboCursor = 0;
+    }
+    void* dst = glMapBufferRange(GL_UNIFORM_BUFFER, gpu::drawUboCursor, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(dst, drawUniforms.begin(), size);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    drawUniformsOffset = gpu::drawUboCursor;
+    gpu::drawUboCursor += size; // the size is a multiple of the alignment
+}
 
-    // compute the grid scaling
-    float scale;
-    float alpha;
+// groups the sorted items into batches, and uploads the matrices of the instanced ones and the DrawUniforms
+static void makeBatches(const glm::mat4& viewProj)
+{
+    batches.resize(0);
+    instanceMatrices.resize(0);
+    drawUniforms.resize(0);
+    // the first DrawUniforms is for the automatic instancing, the instances have the full model matrix
+    DrawUniforms& identityUnifs = pushDrawUniforms();
+    identityUnifs.modelViewProj = viewProj;
+    identityUnifs.modelMat = glm::mat4(1);
+    identityUnifs.firstJoint = 0;
+    identityUnifs.morphOffset = -1;
+    u32 lastNodeInd = ~0u;
+    i32 lastMorphOffset = -1;
+    const ShaderData* instanceableShader = &gpu::shaderPbrMetallic(0);
+    for(u32 keyInd = 0; keyInd < keys.size(); )
     {
-        scale = 0.1f * FLOOR_GRID_RESOLUTION * orbitCam.distance;
-        int i = 0;
-        while(scale > FLOOR_GRID_SUBDIVS) {
-            scale /= FLOOR_GRID_SUBDIVS;
-            i++;
+        const DrawItem& item = items[keys[keyInd].ind];
+        u32 endKeyInd = keyInd + 1;
+        if(imgui_state::autoInstancing && item.shader == instanceableShader) {
+            while(endKeyInd < keys.size() && canShareDraw(item, items[keys[endKeyInd].ind]))
+                endKeyInd++;
+        }
+        Batch batch = {keyInd, endKeyInd - keyInd, (u32)instanceMatrices.size(), 0};
+        if(batch.numItems >= MIN_INSTANCES) {
+            for(u32 i = keyInd; i < endKeyInd; i++)
+                instanceMatrices.push_back(anims::nodesMatrices[items[keys[i].ind].nodeInd]);
+        }
+        else {
+            // consecutive items of the same node share their DrawUniforms (for EXT_mesh_gpu_instancing it's the parent of the instances)
+            if(item.nodeInd != lastNodeInd || item.morphOffset != lastMorphOffset) {
+                DrawUniforms& unifs = pushDrawUniforms();
+                if(item.firstJoint != ~0u) {
+                    unifs.modelViewProj = viewProj;
+                    unifs.modelMat = glm::mat4(1);
+                    unifs.firstJoint = item.firstJoint;
+                }
+                else {
+                    const glm::mat4& modelMat = anims::nodesMatrices[item.nodeInd];
+                    unifs.modelViewProj = viewProj * modelMat;
+                    unifs.modelMat = modelMat;
+                    unifs.firstJoint = 0;
+                }
+                unifs.morphOffset = item.morphOffset;
+                lastNodeInd = item.nodeInd;
+                lastMorphOffset = item.morphOffset;
+            }
+            batch.drawUniformsInd = drawUniforms.size() / uboStride(sizeof(DrawUniforms)) - 1;
+        }
+        batches.push_back(batch);
+        keyInd = endKeyInd;
+    }
+    if(instanceMatrices.size()) {
+        glBindBuffer(GL_ARRAY_BUFFER, gpu::instancesBo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * instanceMatrices.size(), instanceMatrices.begin(), GL_STREAM_DRAW);
+    }
+    uploadDrawUniforms();
+}
+
+// only the state that differs from the previous item is set
+static void submit(const glm::mat4& viewProj)
+{
+    keysTemp.resize(keys.size());
+    radixSort(keys, keysTemp);
+    makeBatches(viewProj);
+
+    stats.items = items.size();
+    const FrameUniforms frameUnifs = {viewProj};
+    glBindBuffer(GL_UNIFORM_BUFFER, gpu::frameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(frameUnifs), &frameUnifs, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, (u32)EUboBinding::FRAME, gpu::frameUbo);
+    if(jointMatrices.size()) {
+        glBindBuffer(GL_TEXTURE_BUFFER, gpu::jointsBo);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * jointMatrices.size(), jointMatrices.begin(), GL_STREAM_DRAW);
+        glActiveTexture(GL_TEXTURE0 + (u32)ETexUnit::JOINTS);
+        glBindTexture(GL_TEXTURE_BUFFER, gpu::jointsTexture);
+    }
+    if(morphDeltas.size()) {
+        glBindBuffer(GL_TEXTURE_BUFFER, gpu::morphBo);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * morphDeltas.size(), morphDeltas.begin(), GL_STREAM_DRAW);
+        glActiveTexture(GL_TEXTURE0 + (u32)ETexUnit::MORPH);
+        glBindTexture(GL_TEXTURE_BUFFER, gpu::morphTexture);
+    }
+    // other draws (axes, gui...) change the state between frames, so we start from an unknown state
+    const ShaderData* curShader = nullptr;
+    u32 curMaterialInd = ~0u;
+    u32 curDrawUniformsInd = ~0u;
+    u32 curVao = ~0u;
+    u32 curTextures[NUM_TEX_UNITS], curSamplers[NUM_TEX_UNITS];
+    for(int unit = 0; unit < NUM_TEX_UNITS; unit++)
+        curTextures[unit] = curSamplers[unit] = ~0u;
+
+    const size_t drawUniformsStride = uboStride(sizeof(DrawUniforms));
+    const size_t materialsStride = uboStride(sizeof(MaterialUniforms));
+    for(const Batch& batch : batches)
+    {
+        const DrawItem& item = items[keys[batch.firstKey].ind];
+        const bool gpuInstanced = item.numInstances > 0; // makeBatches never puts these in batches of several items
+        const bool instanced = gpuInstanced || batch.numItems >= MIN_INSTANCES;
+        const ShaderData* shader = instanced ? &gpu::shaderPbrMetallicInstanced() : item.shader;
+        const bool shaderChanged = shader != curShader;
+        if(shaderChanged) {
+            glUseProgram(shader->prog);
+            curShader = shader;
+            stats.programChanges++;
+        }
+        // the uniform buffer bindings are not part of the program, so they survive the program changes
+        if(batch.drawUniformsInd != curDrawUniformsInd) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, (u32)EUboBinding::DRAW, gpu::drawUbo,
+                drawUniformsOffset + drawUniformsStride * batch.drawUniformsInd, sizeof(DrawUniforms));
+            curDrawUniformsInd = batch.drawUniformsInd;
+            stats.transformChanges++;
+        }
+        if(item.materialInd != curMaterialInd) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, (u32)EUboBinding::MATERIAL, gpu::scene.materialsUbo,
+                materialsStride * item.materialInd, sizeof(MaterialUniforms));
+            curMaterialInd = item.materialInd;
+            stats.materialChanges++;
+        }
+        for(int unit = 0; unit < NUM_TEX_UNITS; unit++) {
+            if(item.textures[unit] != curTextures[unit]) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, item.textures[unit]);
+                curTextures[unit] = item.textures[unit];
+                stats.textureChanges++;
+            }
+            if(item.samplers[unit] != curSamplers[unit]) {
+                glBindSampler(unit, item.samplers[unit]);
+                curSamplers[unit] = item.samplers[unit];
+                stats.textureChanges++;
+            }
+        }
+        if(item.vao != curVao) {
+            glBindVertexArray(item.vao);
+            curVao = item.vao;
+            stats.vaoChanges++;
+        }
+
+        numDrawCalls++;
+        if(instanced) {
+            // without ARB_base_instance, the way of starting at our first instance is offsetting the attributes
+            glBindBuffer(GL_ARRAY_BUFFER, gpuInstanced ? gpu::scene.gpuInstancesBo : gpu::instancesBo);
+            const u32 firstInstance = gpuInstanced ? item.firstInstance : batch.firstInstance;
+            const u32 numInstances = gpuInstanced ? item.numInstances : batch.numItems;
+            const size_t offset = sizeof(glm::mat4) * firstInstance;
+            for(u32 col = 0; col < 4; col++)
+                glVertexAttribPointer(INSTANCE_MATRIX_ATTRIB + col, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + col * sizeof(glm::vec4)));
+            if(item.indexType)
+                glDrawElementsInstanced(item.primType, item.count, item.indexType, (void*)item.indexOffset, numInstances);
+            else
+                glDrawArraysInstanced(item.primType, 0, item.count, numInstances);
+            stats.instancedDraws++;
+            stats.instances += numInstances;
+        }
+        else {
+            if(item.indexType)
+                glDrawElements(item.primType, item.count, item.indexType, (void*)item.indexOffset);
+            else
+                glDrawArrays(item.primType, 0, item.count);
+        }
+    }
+}
+}
+
+static void drawAxes(const glm::mat4& viewProj)
+{
+    if(!imgui_state::showAxes)
+        return;
+    auto& shadInfo = gpu::shaderVertColor();
+    glUseProgram(shadInfo.prog);
+
+    const glm::mat4 modelMat = glm::scale(glm::mat4(1), vec3(1000));
+    const glm::mat4 modelViewProj = viewProj * modelMat;
+
+    glUniformMatrix4fv(shadInfo.locs.modelViewProj, 1, GL_FALSE, &modelViewProj[0][0]);
+    glBindVertexArray(gpu::axesVao);
+    glDrawArrays(GL_LINES, 0, 12);
+}
+
+static void drawFloorGrid(const glm::mat4& viewMat, const glm::mat4& viewProj)
+{
+    if(!imgui_state::showFloorGrid)
+        return;
+    auto& shadInfo = gpu::shaderFloorGrid();
+    glUseProgram(shadInfo.prog);
+
+    // compute the grid scaling
+    float scale;
+    float alpha;
+    {
+        scale = 0.1f * FLOOR_GRID_RESOLUTION * orbitCam.distance;
+        int i = 0;
+        while(scale > FLOOR_GRID_SUBDIVS) {
+            scale /= FLOOR_GRID_SUBDIVS;
+            i++;
         }
         alpha = scale / FLOOR_GRID_SUBDIVS;
         scale = FLOOR_GRID_SUBDIVS;
@@ -981,35 +1871,68 @@ static void drawOrbitCenterCrosshair(const glm::mat4& viewProj)
     glDrawArrays(GL_LINES, 0, 6);
 }
 
+static void updateLoading();
+
 void update(float dt)
 {
+    updateLoading();
     if(!parsedData)
         return;
 
     anims::update(dt);
+    updateNodesMatrices();
+    updateNodesAabbs();
+    updatePickingTlas();
+}
 
-    anims::nodesMatrices.resize(parsedData->nodes_count);
-    for(const cgltf_node& node : getNodes())
-        if(node.parent == nullptr)
-            calcNodesMatricesRecursive(node);
+static glm::mat4 calcViewMtx()
+{
+    return tg::calcOrbitCameraMtx(orbitCam.center, orbitCam.heading, orbitCam.pitch, orbitCam.distance);
+}
+
+static glm::mat4 calcProjMtx(float aspectRatio)
+{
+    return glm::perspective(camProjInfo.fovY, aspectRatio, camProjInfo.nearDist, camProjInfo.farDist);
+}
+
+// selects the node under the cursor. With "recenter", the orbit camera is also centered at the point that was hit
+static void pickAtCursor(GLFWwindow* window, float x, float y, bool recenter)
+{
+    int w, h;
+    glfwGetWindowSize(window, &w, &h);
+    if(!parsedData || w <= 0 || h <= 0)
+        return;
+    const glm::mat4 invViewProj = glm::inverse(calcProjMtx((float)w / h) * calcViewMtx());
+    const glm::vec2 ndc = {2 * x / w - 1, 1 - 2 * y / h};
+    const vec4 pNear = invViewProj * vec4(ndc, -1, 1);
+    const vec4 pFar = invViewProj * vec4(ndc, +1, 1);
+    const vec3 origin = vec3(pNear) / pNear.w;
+    const Ray ray = {origin, vec3(pFar) / pFar.w - origin};
+
+    const double t0 = glfwGetTime();
+    picking::lastHitValid = raycastScene(picking::lastHit, ray);
+    picking::lastQueryMicroseconds = float(1e6 * (glfwGetTime() - t0));
+    if(!picking::lastHitValid)
+        return;
+    selectedNode = picking::lastHit.node;
+    if(recenter)
+        orbitCam.center = picking::lastHit.point;
 }
 
-void drawScene()
+void drawScene(int w, int h)
 {
+    numDrawCalls = 0;
     glEnable(GL_DEPTH_TEST);
     glClearColor(BG_COLOR.r, BG_COLOR.g, BG_COLOR.b, BG_COLOR.a);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    if(!parsedData)
+    if(!parsedData || w <= 0 || h <= 0)
         return;
 
-    int w, h;
-    glfwGetWindowSize(window, &w, &h);
-    const glm::mat4 viewMat = tg::calcOrbitCameraMtx(orbitCam.center, orbitCam.heading, orbitCam.pitch, orbitCam.distance);
-    const glm::mat4 projMat = glm::perspective(camProjInfo.fovY, (float)w / h, camProjInfo.nearDist, camProjInfo.farDist);
+    const glm::mat4 viewMat = calcViewMtx();
+    const glm::mat4 projMat = calcProjMtx((float)w / h);
     const glm::mat4 viewProj = projMat * viewMat;
-    for(const cgltf_node& node : getNodes())
-        if(node.parent == nullptr)
-            drawSceneNodeRecursive(node, viewProj);
+    draw_list::collect(viewProj);
+    draw_list::submit(viewProj);
 
     drawAxes(viewProj);
 
@@ -1107,26 +2030,37 @@ static void drawGui_scenesTab()
         if(selectedNode->light) {
             ImGui::Text("Light: %ld", getLightInd(selectedNode->light));
         }
-        if(selectedNode->weights) {
-            // NOT TESTED
-            if(ImGui::TreeNode(&selectedNode->weights, "Weights(%ld)", selectedNode->weights_count)) {
-                for(size_t i = 0; i < selectedNode->weights_count; i++)
-                    ImGui::Text("%g", selectedNode->weights[i]);
+        const anims::NodeMorphWeights nodeWeights = anims::nodesMorphWeights[getNodeInd(selectedNode)];
+        if(nodeWeights.count) {
+            // the current weights, the animations overwrite them
+            if(ImGui::TreeNode(&selectedNode->weights, "Morph weights(%u)", nodeWeights.count)) {
+                const cgltf_mesh& mesh = *selectedNode->mesh;
+                for(u32 i = 0; i < nodeWeights.count; i++) {
+                    if(i < mesh.target_names_count)
+                        tl::toStringBuffer(scratchStr(), mesh.target_names[i]);
+                    else
+                        tl::toStringBuffer(scratchStr(), i);
+                    ImGui::SliderFloat(scratchStr(), &anims::morphWeights[nodeWeights.first + i], 0, 1);
+                }
                 ImGui::TreePop();
             }
         }
-        if(selectedNode->has_translation) {
-            const float* p = selectedNode->translation;
-            ImGui::Text("Translation: {%g, %g, %g}", p[0], p[1], p[2]);
-        }
+        // editing the transform only recomputes the matrices of this subtree
+        bool transformEdited = false;
+        if(selectedNode->has_translation)
+            transformEdited |= ImGui::DragFloat3("Translation", selectedNode->translation, 0.01f);
         if(selectedNode->has_rotation) {
-            const float* q = selectedNode->rotation;
-            ImGui::Text("Rotation: {%g, %g, %g, %g}", q[0], q[1], q[2], q[3]);
-        }
-        if(selectedNode->has_scale) {
-            const float* s = selectedNode->scale;
-            ImGui::Text("Scale: {%g, %g, %g}", s[0], s[1], s[2]);
+            if(ImGui::DragFloat4("Rotation", selectedNode->rotation, 0.005f)) {
+                const vec4 q = glm::normalize(glm::make_vec4(selectedNode->rotation));
+                if(!glm::any(glm::isnan(q)))
+                    memcpy(selectedNode->rotation, &q, sizeof(q));
+                transformEdited = true;
+            }
         }
+        if(selectedNode->has_scale)
+            transformEdited |= ImGui::DragFloat3("Scale", selectedNode->scale, 0.01f);
+        if(transformEdited)
+            loadNodeTransform(anims::hierarchy, getNodes(), getNodeInd(selectedNode));
         if(selectedNode->has_matrix) {
             const float* m = selectedNode->matrix;
             ImGui::Text("Matrix: {\n"
@@ -1197,7 +2131,9 @@ static void drawGui_texturesTab()
         ImGui::Text("Name: %s", image.name);
         ImGui::Text("File path: %s", image.uri);
         ImGui::Text("MIME Type: %s", image.mime_type);
-        ImGui::Text("Size: %dx%d", gpu::textureSizes[i].x, gpu::textureSizes[i].y);
+        ImGui::Text("Size: %dx%d", gpu::scene.textureSizes[i].x, gpu::scene.textureSizes[i].y);
+        if(i < load_stats::imageDecodeSeconds.size())
+            ImGui::Text("Decode time: %.2f ms", 1000 * load_stats::imageDecodeSeconds[i]);
         imguiTexture(i, &imgui_state::textureHeights[i]);
         // TODO
         /*if(ImGui::BeginPopupContextItem("right-click"))
@@ -1246,6 +2182,17 @@ static void drawGui_texturesTab()
         ImGui::TreePop();
     }
 
+    if(ImGui::CollapsingHeader("Image decoding times"))
+    {
+        float sumSeconds = 0;
+        for(float t : load_stats::imageDecodeSeconds)
+            sumSeconds += t;
+        ImGui::Text("Wall time: %.2f ms (%u threads)", 1000 * load_stats::imagesDecodeWallSeconds, load_stats::imagesDecodeThreads);
+        ImGui::Text("Sum of per-image times: %.2f ms", 1000 * sumSeconds);
+        for(size_t i = 0; i < load_stats::imageDecodeSeconds.size(); i++)
+            ImGui::Text("%ld) %.2f ms  %s", i, 1000 * load_stats::imageDecodeSeconds[i], images[i].uri ? images[i].uri : "(embedded)");
+    }
+
     tl::CSpan<cgltf_sampler> samplers(parsedData->samplers, parsedData->samplers_count);
     tl::toStringBuffer(scratchStr(), "Samplers (", samplers.size(), ")");
     if(ImGui::CollapsingHeader(scratchStr()))
@@ -1259,6 +2206,10 @@ static void drawGui_texturesTab()
 
 static void drawGui_buffersTab()
 {
+    const auto& res = gpu::scene;
+    ImGui::Text("Uploaded to the GPU: %.1f KB (vertices: %.1f KB, indices: %.1f KB)",
+        (res.vertexBytes + res.indexBytes) / 1024., res.vertexBytes / 1024., res.indexBytes / 1024.);
+    ImGui::Text("Not uploaded (not used as vertices or indices): %.1f KB", res.unusedBufferBytes / 1024.);
     CSpan<cgltf_buffer> buffers (parsedData->buffers, parsedData->buffers_count);
     for(size_t i = 0; i < buffers.size(); i++)
     {
@@ -1294,6 +2245,10 @@ static void drawGui_bufferViewsTab()
             ImGui::Text("Size: %ld bytes", view.size);
             ImGui::Text("Stride: %ld bytes", view.stride);
             ImGui::Text("Buffer: %ld", getBufferInd(view.buffer));
+            if(gpu::scene.bufferViewsBo[i])
+                ImGui::Text("Uploaded at offset %ld of buffer object %u", gpu::scene.bufferViewsOffset[i], gpu::scene.bufferViewsBo[i]);
+            else
+                ImGui::Text("Not uploaded to the GPU");
             ImGui::TreePop();
         }
     }
@@ -1375,6 +2330,48 @@ static ImPlotPoint sampleAnimDataForPlotting(void* data, int i)
 
 static void drawGui_animations()
 {
+    ImGui::Text("World matrices recomputed in the last frame: %u / %u nodes", (u32)anims::updatedNodes.size(), (u32)parsedData->nodes_count);
+    bool rebake = ImGui::Checkbox("Bake to a fixed rate", &anims::bake);
+    ImGui::SameLine();
+    bool recompress = ImGui::Checkbox("Compress", &anims::compress);
+    if(anims::bake || anims::compress) {
+        const bool rateChanged = ImGui::SliderInt("fps", &anims::bakeRate, 10, 120, "%d", ImGuiSliderFlags_AlwaysClamp);
+        rebake |= rateChanged;
+        recompress |= rateChanged;
+    }
+    if(anims::compress)
+        recompress |= ImGui::SliderFloat("key reduction tolerance", &anims::compressTolerance, 0, 0.01f, "%.5f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+    if((rebake || recompress) && anims::playingInd != 0) {
+        if(anims::bake)
+            anims::bakeAnim();
+        if(anims::compress)
+            anims::compressAnim();
+        anims::seek(anims::time);
+    }
+    if(anims::bake && anims::playingInd != 0) {
+        size_t bakedBytes = 0;
+        for(const BakedChannels* baked : {&anims::vec3Baked, &anims::rotationBaked})
+            bakedBytes += sizeof(float) * baked->numComponents * baked->numFrames * baked->stride;
+        ImGui::Text("Baked: %u frames, %.1f KB", tl::max(anims::vec3Baked.numFrames, anims::rotationBaked.numFrames), bakedBytes / 1024.f);
+    }
+    if(anims::compress && anims::playingInd != 0) {
+        const anims::CompressionReport& report = anims::compressionReport;
+        if(!report.ok)
+            ImGui::TextColored({1, 0.5f, 0, 1}, "The animation is too long to be compressed at this rate");
+        else {
+            ImGui::Text("Memory: %.1f KB as float keys -> %.1f KB compressed (%.1fx)",
+                report.rawBytes / 1024.f, report.compressedBytes / 1024.f, float(report.rawBytes) / tl::max<size_t>(1, report.compressedBytes));
+            ImGui::Text("Key reduction: %u frames -> %u keys", report.numFrames, report.numKeys);
+            ImGui::Text("Max positional error: %g", report.maxError);
+            if(ImGui::TreeNode("Max positional error per joint")) {
+                for(u32 nodeInd : report.nodesByError) {
+                    const char* name = parsedData->nodes[nodeInd].name;
+                    ImGui::Text("%u) %s: %g", nodeInd, name ? name : "(null)", report.nodesMaxError[nodeInd]);
+                }
+                ImGui::TreePop();
+            }
+        }
+    }
     CSpan<cgltf_animation> animations(parsedData->animations, parsedData->animations_count);
     for(size_t i = 0; i < animations.size(); i++)
     {
@@ -1401,8 +2398,16 @@ static void drawGui_animations()
             if(ImGui::Button(icons::STOP)) {
                 anims::playingInd = 0;
                 anims::time = 0;
+                resetToRestPose(anims::hierarchy, getNodes());
+                anims::resetMorphWeights();
             }
-            ImGui::Text("time: %g / %g", anims::time, anims::duration);
+            if(anims::playingInd != 0 && size_t(glm::abs(anims::playingInd) - 1) == i) {
+                float t = anims::time;
+                if(ImGui::SliderFloat("time", &t, 0, anims::duration, "%.3f"))
+                    anims::seek(t);
+            }
+            else
+                ImGui::Text("time: %g / %g", anims::time, anims::duration);
 
             if(ImGui::TreeNode((void*)&anim.channels, "channels"))
             {
@@ -1545,10 +2550,195 @@ static void drawGui_options()
     ImGui::Checkbox("Show floor grid", &imgui_state::showFloorGrid);
     ImGui::Checkbox("Show crosshair", &imgui_state::showCrosshair);
     ImGui::SliderFloat("Crosshair scale", &imgui_state::crosshairScale, 0, 0.1f);
+    // the new number of threads is applied when starting to load the next file
+    ImGui::SliderInt("Loader threads", &imgui_state::numLoaderThreads, 1, 2 * (i32)ThreadPool::defaultNumThreads() + 2);
+    ImGui::Checkbox("Memory-map files", &imgui_state::mapFiles);
+    ImGui::SliderInt("Texture upload budget (MB/frame)", &imgui_state::textureUploadBudgetMB, 1, 64);
+    ImGui::Checkbox("Generate mipmaps in the loader threads", &imgui_state::cpuMipmaps);
+    if(imgui_state::cpuMipmaps)
+        ImGui::Combo("Mipmap filter", &imgui_state::mipFilter, "Box\0Kaiser\0");
+    if(ImGui::TreeNode("Picking"))
+    {
+        ImGui::TextWrapped("Click on a mesh to select its node. Double click to also move the orbit center there");
+        if(picking::lastHitValid) {
+            const picking::Hit& hit = picking::lastHit;
+            ImGui::Text("Node: %s", hit.node->name ? hit.node->name : "");
+            if(hit.gpuInstanceInd != ~0u)
+                ImGui::Text("GPU instance: %u", hit.gpuInstanceInd);
+            ImGui::Text("Primitive: %u, triangle: %u", hit.primInd, hit.triInd);
+            ImGui::Text("Distance: %g", hit.distance);
+        }
+        else
+            ImGui::Text("Nothing was hit");
+        ImGui::Text("Query time: %.1f us", picking::lastQueryMicroseconds);
+        size_t numTris = 0, numBvhNodes = 0;
+        for(const MeshBvh& meshBvh : parsedDataMeshBvhs) {
+            numTris += meshBvh.numTris();
+            numBvhNodes += meshBvh.bvh.nodes.size();
+        }
+        ImGui::Text("Mesh BVHs: %zu triangles, %zu nodes", numTris, numBvhNodes);
+        ImGui::Text("Top level BVH: %u instances, %u nodes", (u32)picking::tlasInstances.size(), (u32)picking::tlas.nodes.size());
+        ImGui::TreePop();
+    }
+    if(ImGui::TreeNode("Draw list"))
+    {
+        const draw_list::Stats& stats = draw_list::stats;
+        ImGui::Checkbox("Frustum culling", &imgui_state::frustumCulling);
+        ImGui::Text("Visible nodes: %u (%u culled)", stats.visibleNodes, stats.culledNodes);
+        ImGui::Text("Visible primitives: %u (%u culled)", stats.items, stats.culledPrims);
+        ImGui::Checkbox("Automatic instancing", &imgui_state::autoInstancing);
+        ImGui::Text("Draw calls: %u (%u saved by instancing)", numDrawCalls, stats.items - numDrawCalls);
+        ImGui::Text("Instanced draws: %u (%u instances)", stats.instancedDraws, stats.instances);
+        ImGui::Text("Skin palettes: %u (%u joints)", stats.skinPalettes, stats.joints);
+        ImGui::Text("Morphed primitives: %u (%u active targets, %.1f KB of deltas)", stats.morphedPrims, stats.morphTargets,
+            sizeof(glm::vec4) * draw_list::morphDeltas.size() / 1024.f);
+        ImGui::Text("Program changes: %u", stats.programChanges);
+        ImGui::Text("Transform uploads: %u", stats.transformChanges);
+        ImGui::Text("Material uploads: %u", stats.materialChanges);
+        ImGui::Text("Texture/sampler binds: %u", stats.textureChanges);
+        ImGui::Text("VAO binds: %u", stats.vaoChanges);
+        ImGui::TreePop();
+    }
+    if(ImGui::TreeNode("GL validation"))
+    {
+        int glDebugMode = (int)gl_debug::mode();
+        if(ImGui::Combo("Mode", &glDebugMode, "Off\0Debug messages (KHR_debug)\0Sync check (glGetError after each call)\0"))
+            gl_debug::setMode((gl_debug::EMode)glDebugMode);
+        if(!gl_debug::hasDebugOutput())
+            ImGui::Text("KHR_debug is not available");
+#ifdef GLAD_DEBUG
+        ImGui::Text("GL calls last frame: %u", gl_debug::numCallsLastFrame());
+#else
+        ImGui::Text("This build doesn't have per-call hooks: the sync check is done once per frame");
+#endif
+        ImGui::TreePop();
+    }
+    if(ImGui::TreeNode("Scene cache"))
+    {
+        ImGui::Checkbox("Enabled", &imgui_state::useSceneCache);
+        ImGui::SliderInt("Max size (MB)", &imgui_state::sceneCacheMaxMB, 64, 16*1024);
+        ImGui::Text("Directory: %s", scene_cache::directory().c_str());
+        // listing the directory every frame would be too slow
+        static u64 cacheBytes = scene_cache::totalBytes();
+        ImGui::Text("Size: %.1f MB", cacheBytes / (1024. * 1024.));
+        ImGui::SameLine();
+        if(ImGui::Button("Refresh"))
+            cacheBytes = scene_cache::totalBytes();
+        ImGui::SameLine();
+        if(ImGui::Button("Clear") && !isLoadingGltf()) {
+            scene_cache::clear();
+            cacheBytes = scene_cache::totalBytes();
+        }
+        ImGui::TreePop();
+    }
+}
+
+static void drawGui_loadReport(const LoadReport& report)
+{
+    ImGui::Text("%s | %s | %u loader threads", report.mappedFiles ? "mmap" : "read",
+        report.cacheHit ? "cache hit" : report.cacheStored ? "cold, stored in the cache" : "cold", report.loaderThreads);
+    ImGui::Text("Scene displayed after %.1f ms, textures ready after %.1f ms", 1000 * report.sceneReadySeconds, 1000 * report.totalSeconds);
+    ImGui::Text("Images decoded in %.1f ms (wall time)", 1000 * report.imagesDecodeWallSeconds);
+    ImGui::Text("Memory after parsing and loading the buffers: %+.2f MB resident, %+.2f MB non-file-backed",
+        report.residentBytesDelta / (1024. * 1024.), report.anonymousBytesDelta / (1024. * 1024.));
+    // the stages of the worker threads overlap with each other and with the ones of the main thread, so the times don't add up to the total
+    if(ImGui::BeginTable("stages", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Items");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableSetupColumn("MB/s");
+        ImGui::TableHeadersRow();
+        for(int i = 0; i < (int)ELoadStage::COUNT; i++) {
+            const LoadStageStats& stats = report.stages[i];
+            if(stats.seconds == 0 && stats.bytes == 0 && stats.items == 0)
+                continue; // not executed in this load, like reading the cache when it's disabled
+            const double mb = stats.bytes / (1024. * 1024.);
+            ImGui::TableNextColumn(); ImGui::Text("%s", toStr((ELoadStage)i).c_str());
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", 1000 * stats.seconds);
+            ImGui::TableNextColumn(); ImGui::Text("%u", stats.items);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", mb);
+            ImGui::TableNextColumn();
+            if(stats.bytes && stats.seconds > 0)
+                ImGui::Text("%.1f", mb / stats.seconds);
+        }
+        ImGui::EndTable();
+    }
+}
+
+static void drawGui_loadTab()
+{
+    if(load_stats::history.size() == 0) {
+        ImGui::Text("Still loading");
+        return;
+    }
+    const LoadReport& last = load_stats::history.back();
+    ImGui::Text("%s", last.path.c_str());
+    drawGui_loadReport(last);
+    static char jsonPath[512] = "load_report.json";
+    ImGui::InputText("##jsonPath", jsonPath, sizeof(jsonPath));
+    ImGui::SameLine();
+    if(ImGui::Button("Save JSON")) {
+        if(!writeLoadReportJson(last, jsonPath))
+            fprintf(stderr, "error writing the load report to %s\n", jsonPath);
+    }
+
+    if(load_stats::history.size() > 1 && ImGui::CollapsingHeader("Recent loads"))
+    {
+        for(size_t i = load_stats::history.size() - 1; i-- > 0; ) {
+            const LoadReport& r = load_stats::history[i];
+            const float parseMs = 1000 * float(r[ELoadStage::PARSE].seconds + r[ELoadStage::LOAD_BUFFERS].seconds);
+            if(ImGui::TreeNode((void*)&r, "%s | %s | %s | parse: %.1f ms | total: %.1f ms",
+                r.mappedFiles ? "mmap" : "read", r.cacheHit ? "cache hit" : "cold", r.path.c_str(), parseMs, 1000 * r.totalSeconds))
+            {
+                drawGui_loadReport(r);
+                ImGui::TreePop();
+            }
+        }
+    }
+}
+
+static void drawGui_loadingProgress()
+{
+    using namespace loading;
+    const EStage curStage = stage;
+    if(curStage == EStage::NONE)
+        return;
+    ImGui::Begin("Loading##0", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    ImGui::Text("%s", path.c_str());
+    float progress = 0;
+    switch(curStage) {
+    case EStage::PARSING:
+        ImGui::Text("Parsing");
+        break;
+    case EStage::DECODING_IMAGES:
+        ImGui::Text("Decoding images: %u / %ld", numDecodedImages.load(), images.size());
+        progress = images.size() ? float(numDecodedImages) / images.size() : 1.f;
+        break;
+    case EStage::UPLOADING_BUFFERS:
+        ImGui::Text("Uploading buffers");
+        progress = 1;
+        break;
+    case EStage::CREATING_VAOS:
+        ImGui::Text("Creating vertex arrays");
+        progress = 1;
+        break;
+    case EStage::UPLOADING_TEXTURES:
+        ImGui::Text("Decoded images: %u / %ld", numDecodedImages.load(), images.size());
+        ImGui::Text("Uploaded textures: %u / %ld", numUploadedTextures, images.size());
+        progress = images.size() ? float(numUploadedTextures) / images.size() : 1.f;
+        break;
+    default:
+        break;
+    }
+    ImGui::ProgressBar(progress, {300, 0});
+    ImGui::End();
 }
 
 void drawGui()
 {
+    drawGui_loadingProgress();
     if(!parsedData) {
         ImGui::Begin("drag & drop a glTF file##0");
         ImGui::End();
@@ -1607,6 +2797,11 @@ void drawGui()
             ImGui::EndTabItem();
         }
 
+        if(ImGui::BeginTabItem("Load")) {
+            drawGui_loadTab();
+            ImGui::EndTabItem();
+        }
+
         if(ImGui::BeginTabItem("Options")) {
             drawGui_options();
             ImGui::EndTabItem();
@@ -1630,118 +2825,327 @@ static void uriToPath(tl::Span<char> path, CStr gltfFilePath, CStr uri)
     path[dirLen + uri.size()] = '\0';
 }
 
-struct LoadedImage { u8* data; int w, h; };
-static tl::Vector<LoadedImage> loadImages(CStr gltfFilePath)
+static void decodeImage(LoadedImage& loadedImg, const cgltf_image& img, CStr gltfFilePath)
 {
-    Span<cgltf_image> images(parsedData->images, parsedData->images_count);
-    tl::Vector<LoadedImage> loadedImages(images.size());
-    for(int i = 0; i < images.size(); i++)
-    {
-        cgltf_image& img = images[i];
-        u8* (&imgData) = loadedImages[i].data;
-        int& w = loadedImages[i].w;
-        int& h = loadedImages[i].h;
-        int nc;
-        if(img.uri) {
-            uriToPath(scratchStr(), gltfFilePath, img.uri);
-            imgData = stbi_load(scratchStr(), &w, &h, &nc, 4);
-        }
-        else {
-            const auto* bufferView = img.buffer_view;
-            const auto* data = (u8*)bufferView->buffer->data + bufferView->offset;
-            const size_t size = bufferView->size;
-            imgData = stbi_load_from_memory(data, size, &w, &h, &nc, 4);
-        }
+    int nc;
+    if(img.uri) {
+        char path[4*1024]; // can't use the scratch buffer because we run in a worker thread
+        uriToPath(path, gltfFilePath, img.uri);
+        loadedImg.data = stbi_load(path, &loadedImg.w, &loadedImg.h, &nc, 4);
+    }
+    else {
+        const auto* bufferView = img.buffer_view;
+        const auto* data = (u8*)bufferView->buffer->data + bufferView->offset;
+        const size_t size = bufferView->size;
+        loadedImg.data = stbi_load_from_memory(data, size, &loadedImg.w, &loadedImg.h, &nc, 4);
     }
-    return loadedImages;
 }
 
 static void freeImages(Span<LoadedImage> loadedImages)
 {
-    for(const LoadedImage& img : loadedImages)
+    for(LoadedImage& img : loadedImages) {
         stbi_image_free(img.data);
+        free(img.mips);
+        img.data = nullptr;
+        img.mips = nullptr;
+    }
 }
 
-static void loadTextures(Span<LoadedImage> loadedImages)
+static void generateMipChain(LoadedImage& img, bool srgb, tg::EMipFilter filter)
 {
-    CSpan<cgltf_texture> textures(parsedData->textures, parsedData->textures_count);
-    gpu::textures.resize(textures.size());
-    glGenTextures(textures.size(), gpu::textures.begin());
-    for(size_t i = 0; i < textures.size(); i++)
+    const size_t numPixels = tg::calcMipChainNumPixels(img.w, img.h);
+    if(numPixels == 0)
+        return;
+    img.mips = (u8*)malloc(4 * numPixels);
+    tg::generateMipChain((tg::Color4u8*)img.mips, tg::CImg4u8(img.w, img.h, (const tg::Color4u8*)img.data), srgb, filter);
+}
+
+static bool isMipmapMinFilter(int minFilter)
+{
+    return minFilter == GL_NEAREST_MIPMAP_NEAREST ||
+        minFilter == GL_LINEAR_MIPMAP_NEAREST ||
+        minFilter == GL_NEAREST_MIPMAP_LINEAR ||
+        minFilter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+// glTF leaves filters undefined when they are not specified (cgltf gives us 0), we choose the best quality
+static int samplerMinFilter(const cgltf_sampler* sampler) {
+    return sampler && sampler->min_filter ? sampler->min_filter : GL_LINEAR_MIPMAP_LINEAR;
+}
+static int samplerMagFilter(const cgltf_sampler* sampler) {
+    return sampler && sampler->mag_filter ? sampler->mag_filter : GL_LINEAR;
+}
+
+static void findImagesNeedingMipmaps(tl::Vector<bool>& needMipmaps, const cgltf_data& data)
+{
+    needMipmaps.resize(0);
+    needMipmaps.resize(data.images_count, false);
+    for(const cgltf_texture& texture : CSpan<cgltf_texture>(data.textures, data.textures_count))
+        if(texture.image && isMipmapMinFilter(samplerMinFilter(texture.sampler)))
+            needMipmaps[texture.image - data.images] = true;
+}
+
+// the images used as base color are in sRGB, the rest of them (normal maps, metallic-roughness...) contain linear data
+static void findSrgbImages(tl::Vector<bool>& srgb, const cgltf_data& data)
+{
+    srgb.resize(0);
+    srgb.resize(data.images_count, false);
+    for(const cgltf_material& material : CSpan<cgltf_material>(data.materials, data.materials_count)) {
+        const cgltf_texture* tex = material.has_pbr_metallic_roughness ? material.pbr_metallic_roughness.base_color_texture.texture : nullptr;
+        if(tex && tex->image)
+            srgb[tex->image - data.images] = true;
+    }
+}
+
+// the materials don't change, so they are uploaded once. The draws only need to bind the range of their material
+static void createMaterialsUbo(gpu::SceneResources& res, const cgltf_data& data)
+{
+    CSpan<cgltf_material> materials(data.materials, data.materials_count);
+    const size_t stride = uboStride(sizeof(MaterialUniforms));
+    tl::Vector<u8> bytes;
+    bytes.resize(stride * (materials.size() + 1));
+    for(size_t i = 0; i <= materials.size(); i++) {
+        const cgltf_material& material = i < materials.size() ? materials[i] : s_defaultMaterial;
+        MaterialUniforms& unifs = *(MaterialUniforms*)&bytes[stride * i];
+        unifs.color = material.has_pbr_metallic_roughness ? glm::make_vec4(material.pbr_metallic_roughness.base_color_factor) : vec4(1);
+    }
+    glGenBuffers(1, &res.materialsUbo);
+    res.bos.push_back(res.materialsUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, res.materialsUbo);
+    glBufferData(GL_UNIFORM_BUFFER, bytes.size(), bytes.begin(), GL_STATIC_DRAW);
+}
+
+// GL sampler objects are created for each distinct sampler state, and textures sharing the same image share the GL texture
+static void createSamplers(gpu::SceneResources& res, const cgltf_data& data)
+{
+    struct SamplerState { int minFilter, magFilter, wrapS, wrapT; };
+    tl::Vector<SamplerState> states;
+    auto findOrCreate = [&](const cgltf_sampler* sampler) -> u32
     {
-        cgltf_image* img = textures[i].image;
-        assert(img);
-        const int imgInd = getImageInd(img);
-        const u8* imgData = loadedImages[imgInd].data;
-        const int w = loadedImages[imgInd].w;
-        const int h = loadedImages[imgInd].h;
-        glBindTexture(GL_TEXTURE_2D, gpu::textures[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, imgData);
-        gpu::textureSizes[i] = {w, h};
-        imgui_state::textureHeights[i] = DEFAULT_IMGUI_IMG_HEIGHT;
-        const auto* sampler = textures[i].sampler;
-        if(sampler) {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler->min_filter);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler->mag_filter);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler->wrap_s);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler->wrap_t);
-            if(sampler->min_filter == GL_NEAREST_MIPMAP_NEAREST ||
-                sampler->min_filter == GL_LINEAR_MIPMAP_NEAREST ||
-                sampler->min_filter == GL_NEAREST_MIPMAP_LINEAR ||
-                sampler->min_filter == GL_LINEAR_MIPMAP_LINEAR
-            ) glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        else { // there is no sampler, glTF specs some defaults when there is no sampler
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-    }
-}
-
-static void loadBufferObjects()
+        const SamplerState state = {
+            samplerMinFilter(sampler),
+            samplerMagFilter(sampler),
+            sampler ? sampler->wrap_s : GL_REPEAT,
+            sampler ? sampler->wrap_t : GL_REPEAT,
+        };
+        for(size_t i = 0; i < states.size(); i++)
+            if(memcmp(&states[i], &state, sizeof(state)) == 0)
+                return res.samplers[i];
+        u32 glSampler;
+        glGenSamplers(1, &glSampler);
+        glSamplerParameteri(glSampler, GL_TEXTURE_MIN_FILTER, state.minFilter);
+        glSamplerParameteri(glSampler, GL_TEXTURE_MAG_FILTER, state.magFilter);
+        glSamplerParameteri(glSampler, GL_TEXTURE_WRAP_S, state.wrapS);
+        glSamplerParameteri(glSampler, GL_TEXTURE_WRAP_T, state.wrapT);
+        states.push_back(state);
+        res.samplers.push_back(glSampler);
+        return glSampler;
+    };
+
+    res.texturesSampler.resize(data.textures_count);
+    for(size_t i = 0; i < data.textures_count; i++)
+        res.texturesSampler[i] = findOrCreate(data.textures[i].sampler);
+
+    findImagesNeedingMipmaps(res.imagesNeedMipmaps, data);
+}
+
+// allocates the storage for all the mip levels, the pixels are uploaded afterwards
+static void allocTexture(gpu::SceneResources& res, size_t imgInd, int w, int h)
 {
-    CSpan<cgltf_buffer> buffers (parsedData->buffers, parsedData->buffers_count);
-    gpu::bos.resize(buffers.size());
-    glGenBuffers(gpu::bos.size(), gpu::bos.begin());
-    for(size_t i = 0; i < buffers.size(); i++)
+    const bool mipmaps = res.imagesNeedMipmaps[imgInd];
+    const int numLevels = mipmaps ? tg::calcNumMipLevels(w, h) : 1;
+    glBindTexture(GL_TEXTURE_2D, res.textures[imgInd]);
+    if(gpu::texStorage2D) {
+        gpu::texStorage2D(GL_TEXTURE_2D, numLevels, GL_RGBA8, w, h);
+    }
+    else {
+        for(int level = 0; level < numLevels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, tg::calcMipLevelSize(w, level), tg::calcMipLevelSize(h, level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    res.textureSizes[imgInd] = {w, h};
+    // the sampler objects override this when drawing the scene, but imgui uses the state of the texture
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+}
+
+// uploads the decoded images, in order, through the pixel buffer. At most budgetBytes are copied per call, so big textures take several frames
+// the images are not freed if they still have to be written to the cache, or if they point inside a cache file
+// if the mip chain was generated by the workers, the levels are uploaded one after the other. Otherwise we fall back to glGenerateMipmap
+// returns true when all the images have been uploaded
+static bool streamTextures(gpu::SceneResources& res, Span<LoadedImage> images, size_t budgetBytes, bool freeUploadedImages)
+{
+    using loading::imagesDecoded;
+    using loading::numUploadedTextures;
+    using loading::numUploadedLevels;
+    using loading::numUploadedRows;
+    const u32 numImages = images.size();
+    if(numUploadedTextures < numImages && !imagesDecoded[numUploadedTextures])
+        return false; // nothing to upload this frame
+
+    struct RowsCopy { u32 imgInd; int level, y, numRows; size_t offset; bool last; };
+    static tl::Vector<RowsCopy> copies;
+    copies.resize(0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gpu::uploadPbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, budgetBytes, nullptr, GL_STREAM_DRAW); // orphan the previous storage, the driver might still be reading from it
+    u8* pboData = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, budgetBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    size_t offset = 0;
+    while(numUploadedTextures < numImages && imagesDecoded[numUploadedTextures])
     {
-        auto& buffer = buffers[i];
-        glBindBuffer(GL_COPY_WRITE_BUFFER, gpu::bos[i]);
-        glBufferData(GL_COPY_WRITE_BUFFER, buffer.size, buffer.data, GL_STATIC_DRAW);
+        const u32 imgInd = numUploadedTextures;
+        const LoadedImage& img = images[imgInd];
+        if(img.data == nullptr) { // the image couldn't be decoded, we will keep drawing with the fallback
+            numUploadedTextures++;
+            continue;
+        }
+
+        // find where the level starts: the levels are stored consecutively after the level 0
+        const int level = numUploadedLevels;
+        const u8* levelData = img.data;
+        if(level > 0) {
+            levelData = img.mips;
+            for(int l = 1; l < level; l++)
+                levelData += 4 * size_t(tg::calcMipLevelSize(img.w, l)) * tg::calcMipLevelSize(img.h, l);
+        }
+        const int levelW = tg::calcMipLevelSize(img.w, level);
+        const int levelH = tg::calcMipLevelSize(img.h, level);
+        const int numLevels = img.mips ? tg::calcNumMipLevels(img.w, img.h) : 1;
+
+        const size_t rowBytes = 4 * levelW;
+        const int numRows = glm::min(levelH - (int)numUploadedRows, int((budgetBytes - offset) / rowBytes));
+        if(numRows <= 0)
+            break;
+        // allocate when the first rows are copied, not before checking the budget: a texture that didn't fit would be allocated again next frame
+        if(numUploadedLevels == 0 && numUploadedRows == 0)
+            allocTexture(res, imgInd, img.w, img.h);
+        const int y = numUploadedRows;
+        const bool last = y + numRows == levelH && level + 1 == numLevels;
+        memcpy(pboData + offset, levelData + y * rowBytes, numRows * rowBytes);
+        copies.push_back({imgInd, level, y, numRows, offset, last});
+        offset += numRows * rowBytes;
+        numUploadedRows += numRows;
+        if((int)numUploadedRows == levelH) {
+            numUploadedRows = 0;
+            numUploadedLevels++;
+            if((int)numUploadedLevels == numLevels) {
+                numUploadedLevels = 0;
+                numUploadedTextures++;
+            }
+        }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    LoadStageStats& stats = loading::report[ELoadStage::UPLOAD_TEXTURES];
+    stats.bytes += offset;
+
+    for(const RowsCopy& copy : copies) {
+        LoadedImage& img = images[copy.imgInd];
+        glBindTexture(GL_TEXTURE_2D, res.textures[copy.imgInd]);
+        glTexSubImage2D(GL_TEXTURE_2D, copy.level, 0, copy.y, tg::calcMipLevelSize(img.w, copy.level), copy.numRows,
+            GL_RGBA, GL_UNSIGNED_BYTE, (void*)copy.offset);
+        if(copy.last) {
+            if(res.imagesNeedMipmaps[copy.imgInd] && img.mips == nullptr)
+                glGenerateMipmap(GL_TEXTURE_2D);
+            res.texturesReady[copy.imgInd] = true;
+            stats.items++;
+            if(freeUploadedImages)
+                freeImages({&img, 1});
+        }
     }
+    // other texture uploads (like the ones from imgui) must not read from the pixel buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return numUploadedTextures == numImages;
 }
 
-static void createVaos()
+// only the bufferViews that are referenced as vertex attributes or indices are uploaded
+// other data, like the embedded images of GLBs, animations or inverse bind matrices, stays in CPU memory
+static void loadBufferObjects(gpu::SceneResources& res, const cgltf_data& data)
 {
-    CSpan<cgltf_mesh> meshes (parsedData->meshes, parsedData->meshes_count);
-    gpu::meshPrimsVaos.resize(meshes.size()+1);
-    gpu::meshPrimsVaos[0] = 0;
+    enum EUsage : u8 { UNUSED, VERTICES, INDICES };
+    CSpan<cgltf_buffer_view> views(data.buffer_views, data.buffer_views_count);
+    tl::Vector<EUsage> viewsUsage(views.size(), UNUSED);
+    for(const cgltf_mesh& mesh : CSpan<cgltf_mesh>(data.meshes, data.meshes_count))
+    for(const cgltf_primitive& prim : CSpan<cgltf_primitive>(mesh.primitives, mesh.primitives_count))
+    {
+        if(prim.indices)
+            viewsUsage[prim.indices->buffer_view - data.buffer_views] = INDICES;
+        for(const cgltf_attribute& attrib : CSpan<cgltf_attribute>(prim.attributes, prim.attributes_count)) {
+            EUsage& usage = viewsUsage[attrib.data->buffer_view - data.buffer_views];
+            if(usage == UNUSED)
+                usage = VERTICES;
+        }
+    }
+
+    // compute where each bufferView goes in the packed buffers
+    constexpr size_t ALIGNMENT = 16;
+    size_t packedSizes[3] = {0, 0, 0};
+    res.bufferViewsOffset.resize(views.size());
+    for(size_t i = 0; i < views.size(); i++) {
+        size_t& packedSize = packedSizes[viewsUsage[i]];
+        res.bufferViewsOffset[i] = packedSize;
+        packedSize += (views[i].size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    u32 bos[3] = {0, 0, 0};
+    glGenBuffers(2, bos + 1);
+    res.bos.push_back(bos[VERTICES]);
+    res.bos.push_back(bos[INDICES]);
+    for(u32 usage : {VERTICES, INDICES}) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, bos[usage]);
+        glBufferData(GL_COPY_WRITE_BUFFER, packedSizes[usage], nullptr, GL_STATIC_DRAW);
+    }
+    res.bufferViewsBo.resize(views.size());
+    for(size_t i = 0; i < views.size(); i++) {
+        res.bufferViewsBo[i] = bos[viewsUsage[i]];
+        if(viewsUsage[i] == UNUSED)
+            continue;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, bos[viewsUsage[i]]);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, res.bufferViewsOffset[i], views[i].size, (const u8*)views[i].buffer->data + views[i].offset);
+    }
+
+    size_t totalBufferBytes = 0;
+    for(const cgltf_buffer& buffer : CSpan<cgltf_buffer>(data.buffers, data.buffers_count))
+        totalBufferBytes += buffer.size;
+    res.vertexBytes = packedSizes[VERTICES];
+    res.indexBytes = packedSizes[INDICES];
+    res.unusedBufferBytes = totalBufferBytes - tl::min(totalBufferBytes, res.vertexBytes + res.indexBytes);
+}
+
+static void createVaos(gpu::SceneResources& res, const cgltf_data& data)
+{
+    const GpuInstances& gpuInstances = loading::gpuInstances;
+    if(gpuInstances.matrices.size()) {
+        glGenBuffers(1, &res.gpuInstancesBo);
+        res.bos.push_back(res.gpuInstancesBo);
+        glBindBuffer(GL_ARRAY_BUFFER, res.gpuInstancesBo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * gpuInstances.matrices.size(), gpuInstances.matrices.begin(), GL_STATIC_DRAW);
+    }
+
+    CSpan<cgltf_mesh> meshes (data.meshes, data.meshes_count);
+    res.meshPrimsVaos.resize(meshes.size()+1);
+    res.meshPrimsVaos[0] = 0;
     u32 rangeInd = 0;
     for(size_t meshInd = 0; meshInd < meshes.size(); meshInd++)
     {
         auto& mesh = meshes[meshInd];
         CSpan<cgltf_primitive> prims(mesh.primitives, mesh.primitives_count);
         rangeInd += prims.size();
-        gpu::meshPrimsVaos[meshInd+1] = rangeInd;
+        res.meshPrimsVaos[meshInd+1] = rangeInd;
     }
-    gpu::vaos.resize(rangeInd);
-    glGenVertexArrays(rangeInd, gpu::vaos.begin());
+    res.vaos.resize(rangeInd);
+    glGenVertexArrays(rangeInd, res.vaos.begin());
 
     for(size_t meshInd = 0; meshInd < meshes.size(); meshInd++)
     {
         auto& mesh = meshes[meshInd];
-        const u32 vaoBeginInd = gpu::meshPrimsVaos[meshInd];
+        const u32 vaoBeginInd = res.meshPrimsVaos[meshInd];
         CSpan<cgltf_primitive> prims(mesh.primitives, mesh.primitives_count);
         for(size_t primInd = 0; primInd < prims.size(); primInd++)
         {
             auto& prim = prims[primInd];
-            const u32 vao = gpu::vaos[vaoBeginInd + primInd];
+            const u32 vao = res.vaos[vaoBeginInd + primInd];
             glBindVertexArray(vao);
             if(prim.indices) {
-                const u32 ebo = gpu::bos[getBufferInd(prim.indices->buffer_view->buffer)];
+                const u32 ebo = res.bufferViewsBo[prim.indices->buffer_view - data.buffer_views];
                 glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
             }
             CSpan<cgltf_attribute> attribs(prim.attributes, prim.attributes_count);
@@ -1758,8 +3162,9 @@ static void createVaos()
                 const cgltf_accessor* accessor = attrib.data;
                 const GLint numComponents = cgltfTypeNumComponents(accessor->type);
                 const GLenum componentType = cgltfComponentTypeToGl(accessor->component_type);
-                const size_t offset = accessor->offset + accessor->buffer_view->offset;
-                const u32 vbo = gpu::bos[getBufferInd(accessor->buffer_view->buffer)];
+                const size_t viewInd = accessor->buffer_view - data.buffer_views;
+                const size_t offset = accessor->offset + res.bufferViewsOffset[viewInd];
+                const u32 vbo = res.bufferViewsBo[viewInd];
                 glBindBuffer(GL_ARRAY_BUFFER, vbo);
                 if(componentType == GL_INT || componentType == GL_UNSIGNED_INT ||
                     componentType == GL_SHORT || componentType == GL_UNSIGNED_SHORT ||
@@ -1776,60 +3181,32 @@ static void createVaos()
             assert((availableAttribsMask & (1U << (u32)EAttrib::POSITION)) &&
                    (availableAttribsMask & (1U << (u32)EAttrib::NORMAL)));
 
-            { // setup tangents and cotangents buffer
-                const cgltf_accessor& normalAttribData = *attribs[attribIdToInd[(u32)EAttrib::NORMAL]].data;
-                assert(normalAttribData.type == cgltf_type_vec3 && normalAttribData.component_type == cgltf_component_type_r_32f);
-                const size_t numVerts = normalAttribData.count;
+            { // tangents and cotangents, computed by the loader threads
+                const TangentFrames& frames = loading::tangentFrames;
+                const size_t numVerts = attribs[attribIdToInd[(u32)EAttrib::NORMAL]].data->count;
                 const bool gottaGenerateTangets = (availableAttribsMask & (1U << (u32)EAttrib::TANGENT)) == 0;
-                const size_t tangentsNumBytes = sizeof(glm::vec3) * numVerts;
-                const size_t bufSize = tangentsNumBytes * (gottaGenerateTangets ? 2 : 1);
-                scratch.growIfNeeded(bufSize);
+                const u64 begin = frames.primsOffset[vaoBeginInd + primInd];
+                const u64 end = frames.primsOffset[vaoBeginInd + primInd + 1];
                 u32 vbo;
                 glGenBuffers(1, &vbo);
-                gpu::bos.push_back(vbo);
+                res.bos.push_back(vbo);
                 glBindBuffer(GL_ARRAY_BUFFER, vbo);
-                auto normals = (const u8*)normalAttribData.buffer_view->buffer->data + normalAttribData.offset;
-                const size_t normalsStride = normalAttribData.stride ? normalAttribData.stride : sizeof(glm::vec3);
-                glm::vec3* tangents;
-                if(gottaGenerateTangets)
-                {
-                    // generate tangents, if there aren't any
-                    auto normalPtr = normals;
-                    tangents = scratch.ptr<glm::vec3>();
-                    for(size_t i = 0; i < numVerts; i++) {
-                        const glm::vec3& n = *reinterpret_cast<const glm::vec3*>(normalPtr);
-                        // find some vector perpendicular to n
-                        glm::vec3 x {1, 0, 0};
-                        if(abs(dot(x, n)) > 0.99f)
-                            x = {0, 1, 0};
-                        tangents[i] = cross(n, x);
-                        normalPtr += normalsStride;
-                    }
+                glBufferData(GL_ARRAY_BUFFER, end - begin, frames.data + begin, GL_STATIC_DRAW);
+                if(gottaGenerateTangets) {
                     glEnableVertexAttribArray((u32)EAttrib::TANGENT);
                     glVertexAttribPointer((u32)EAttrib::TANGENT, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
                 }
-                else {
-                    const cgltf_accessor& tangentAttribData = *attribs[attribIdToInd[(u32)EAttrib::TANGENT]].data;
-                    tangents = (glm::vec3*)tangentAttribData.buffer_view->buffer->data;
-                    assert(numVerts == tangentAttribData.count);
-                    assert(tangentAttribData.type == cgltf_type_vec3 && tangentAttribData.component_type == cgltf_component_type_r_32f);
-                }
-
-                { // generate cotangents
-                    auto normalPtr = normals;
-                    glm::vec3* cotangents = scratch.ptr<glm::vec3>() + (gottaGenerateTangets ? numVerts : 0);
-                    for(size_t i = 0; i < numVerts; i++) {
-                        const glm::vec3 n = *reinterpret_cast<const glm::vec3*>(normalPtr);
-                        cotangents[i] = cross(n, tangents[i]);
-                        normalPtr += normalsStride;
-                    }
-
-                    glEnableVertexAttribArray((u32)EAttrib::COTANGENT);
-                    glVertexAttribPointer((u32)EAttrib::COTANGENT, 3, GL_FLOAT, GL_FALSE,
-                        0, (void*)(gottaGenerateTangets ? tangentsNumBytes : 0));
-                }
+                glEnableVertexAttribArray((u32)EAttrib::COTANGENT);
+                glVertexAttribPointer((u32)EAttrib::COTANGENT, 3, GL_FLOAT, GL_FALSE,
+                    0, (void*)(gottaGenerateTangets ? sizeof(glm::vec3) * numVerts : 0));
+            }
 
-                glBufferData(GL_ARRAY_BUFFER, bufSize, scratch.ptr<u8>(), GL_STATIC_DRAW);
+            // the offset is set before each instanced draw
+            glBindBuffer(GL_ARRAY_BUFFER, gpu::instancesBo);
+            for(u32 col = 0; col < 4; col++) {
+                glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIB + col);
+                glVertexAttribPointer(INSTANCE_MATRIX_ATTRIB + col, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(col * sizeof(glm::vec4)));
+                glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIB + col, 1);
             }
 
             if(availableAttribsMask & (u32)EAttrib::COLOR) {
@@ -1844,57 +3221,218 @@ static void createVaos()
 static void loadMaterials()
 {
     CSpan<cgltf_material> materials (parsedData->materials, parsedData->materials_count);
+    imgui_state::materialTexturesHeights.resize(materials.size());
     for(size_t i = 0; i < materials.size(); i++)
     {
         imgui_state::materialTexturesHeights[i] = {128.f, 128.f};
     }
 }
 
-static Aabb computeMeshAabb(const cgltf_mesh& mesh, const glm::mat4& modelMtx)
+static const cgltf_accessor* findAttribute(const cgltf_primitive& prim, cgltf_attribute_type type)
 {
-    Aabb box = Aabb::UNDEF();
-    tl::CSpan<cgltf_primitive> prims(mesh.primitives, mesh.primitives_count);
-    for(const auto& prim : prims)
-    {
-        tl::CSpan<cgltf_attribute> attribs(prim.attributes, prim.attributes_count);
-        for(const auto& attrib : attribs)
-        {
-            if(attrib.type != cgltf_attribute_type_position)
-                continue;
-            const cgltf_accessor* accessor = attrib.data;
-            const GLint numComponents = cgltfTypeNumComponents(accessor->type);
-            const GLenum componentType = cgltfComponentTypeToGl(accessor->component_type);
-            assert(numComponents == 3 && componentType == GL_FLOAT);
-
-            const size_t stride = accessor->stride ? accessor->stride : 3 * sizeof(float);
-            size_t offset = accessor->offset + accessor->buffer_view->offset;
+    for(const cgltf_attribute& attrib : CSpan<cgltf_attribute>(prim.attributes, prim.attributes_count))
+        if(attrib.type == type)
+            return attrib.data;
+    return nullptr;
+}
 
-            if(accessor->has_min) {
-                box.pMin = glm::min(box.pMin, glm::make_vec3(accessor->min));
+// the data of each primitive is: the tangents (only if the primitive doesn't have them, in that case we make up some perpendicular to the normals) followed by the cotangents
+static void computeTangentFrames(TangentFrames& frames, const cgltf_data& data)
+{
+    CSpan<cgltf_mesh> meshes(data.meshes, data.meshes_count);
+    frames.primsOffset.resize(0);
+    u64 size = 0;
+    for(const cgltf_mesh& mesh : meshes)
+    for(const cgltf_primitive& prim : CSpan<cgltf_primitive>(mesh.primitives, mesh.primitives_count)) {
+        frames.primsOffset.push_back(size);
+        if(const cgltf_accessor* normals = findAttribute(prim, cgltf_attribute_type_normal))
+            size += sizeof(vec3) * normals->count * (findAttribute(prim, cgltf_attribute_type_tangent) ? 1 : 2);
+    }
+    frames.primsOffset.push_back(size);
+    frames.storage.resize(size);
+    frames.data = frames.storage.begin();
+
+    size_t primInd = 0;
+    for(const cgltf_mesh& mesh : meshes)
+    for(const cgltf_primitive& prim : CSpan<cgltf_primitive>(mesh.primitives, mesh.primitives_count)) {
+        vec3* out = (vec3*)(frames.storage.begin() + frames.primsOffset[primInd++]);
+        const cgltf_accessor* normals = findAttribute(prim, cgltf_attribute_type_normal);
+        if(normals == nullptr)
+            continue;
+        assert(normals->type == cgltf_type_vec3 && normals->component_type == cgltf_component_type_r_32f);
+        const cgltf_accessor* tangents = findAttribute(prim, cgltf_attribute_type_tangent);
+        const size_t numVerts = normals->count;
+        vec3* cotangents = tangents ? out : out + numVerts;
+        for(size_t i = 0; i < numVerts; i++) {
+            const vec3 n = *(const vec3*)cgltfAccessAccessor(*normals, i);
+            vec3 t;
+            float handedness = 1;
+            if(tangents) {
+                assert(tangents->component_type == cgltf_component_type_r_32f);
+                const float* tangent = (const float*)cgltfAccessAccessor(*tangents, i);
+                t = {tangent[0], tangent[1], tangent[2]};
+                if(tangents->type == cgltf_type_vec4)
+                    handedness = tangent[3];
             }
             else {
-                size_t o = offset;
-                for(int i = 0; i < accessor->count; i++) {
-                    auto pos = (vec3*)(accessor->buffer_view->buffer + o);
-                    box.pMin = glm::min(box.pMin, *pos);
-                    o += stride;
-                }
+                // find some vector perpendicular to n
+                vec3 x {1, 0, 0};
+                if(abs(dot(x, n)) > 0.99f)
+                    x = {0, 1, 0};
+                t = out[i] = cross(n, x);
             }
+            cotangents[i] = handedness * cross(n, t);
+        }
+    }
+}
 
-            if(accessor->has_max) {
+// the AABBs of the meshes in local space
+static void computeMeshAabbs(tl::Vector<Aabb>& aabbs, const cgltf_data& data)
+{
+    aabbs.resize(data.meshes_count);
+    for(size_t meshInd = 0; meshInd < data.meshes_count; meshInd++)
+    {
+        const cgltf_mesh& mesh = data.meshes[meshInd];
+        Aabb box = Aabb::UNDEF();
+        for(const cgltf_primitive& prim : CSpan<cgltf_primitive>(mesh.primitives, mesh.primitives_count))
+        {
+            const cgltf_accessor* accessor = findAttribute(prim, cgltf_attribute_type_position);
+            if(accessor == nullptr)
+                continue;
+            assert(accessor->type == cgltf_type_vec3 && accessor->component_type == cgltf_component_type_r_32f);
+            if(accessor->has_min && accessor->has_max) {
+                box.pMin = glm::min(box.pMin, glm::make_vec3(accessor->min));
                 box.pMax = glm::max(box.pMax, glm::make_vec3(accessor->max));
             }
             else {
-                size_t o = offset;
-                for(int i = 0; i < accessor->count; i++) {
-                    auto pos = (vec3*)(accessor->buffer_view->buffer + o);
-                    box.pMax = glm::max(box.pMax, *pos);
-                    o += stride;
+                for(size_t i = 0; i < accessor->count; i++) {
+                    const vec3 pos = *(const vec3*)cgltfAccessAccessor(*accessor, i);
+                    box.pMin = glm::min(box.pMin, pos);
+                    box.pMax = glm::max(box.pMax, pos);
                 }
             }
         }
+        aabbs[meshInd] = box;
+    }
+}
+
+static void buildMeshBvh(MeshBvh& meshBvh, const cgltf_mesh& mesh)
+{
+    meshBvh.triVerts.resize(0);
+    meshBvh.primsFirstTri.resize(mesh.primitives_count);
+    for(u32 primInd = 0; primInd < mesh.primitives_count; primInd++)
+    {
+        const cgltf_primitive& prim = mesh.primitives[primInd];
+        meshBvh.primsFirstTri[primInd] = meshBvh.numTris();
+        const cgltf_accessor* positions = findAttribute(prim, cgltf_attribute_type_position);
+        if(positions == nullptr)
+            continue;
+        assert(positions->type == cgltf_type_vec3 && positions->component_type == cgltf_component_type_r_32f);
+        const size_t numVerts = prim.indices ? prim.indices->count : positions->count;
+        auto addTriangle = [&](size_t a, size_t b, size_t c) {
+            for(size_t i : {a, b, c}) {
+                const size_t vertInd = prim.indices ? cgltf_accessor_read_index(prim.indices, i) : i;
+                meshBvh.triVerts.push_back(*(const vec3*)cgltfAccessAccessor(*positions, vertInd));
+            }
+        };
+        switch(prim.type) {
+        case cgltf_primitive_type_triangles:
+            for(size_t i = 0; i + 2 < numVerts; i += 3)
+                addTriangle(i, i + 1, i + 2);
+            break;
+        case cgltf_primitive_type_triangle_strip:
+            for(size_t i = 0; i + 2 < numVerts; i++)
+                addTriangle(i, i + 1, i + 2);
+            break;
+        case cgltf_primitive_type_triangle_fan:
+            for(size_t i = 1; i + 1 < numVerts; i++)
+                addTriangle(0, i, i + 1);
+            break;
+        default: // points and lines can't be picked
+            break;
+        }
+    }
+
+    const u32 numTris = meshBvh.numTris();
+    tl::Vector<Aabb> triBoxes;
+    triBoxes.resize(numTris);
+    for(u32 i = 0; i < numTris; i++) {
+        const vec3* v = &meshBvh.triVerts[3 * i];
+        triBoxes[i] = Aabb(glm::min(v[0], glm::min(v[1], v[2])), glm::max(v[0], glm::max(v[1], v[2])));
+    }
+    buildBvh(meshBvh.bvh, triBoxes, &threadPool);
+}
+
+// one job per mesh, and the big meshes also build their subtrees in parallel
+static void computeMeshBvhs(std::vector<MeshBvh>& bvhs, const cgltf_data& data, LoadStageStats& stats)
+{
+    bvhs.resize(data.meshes_count);
+    JobCounter counter;
+    for(size_t meshInd = 0; meshInd < data.meshes_count; meshInd++)
+        threadPool.push([&bvhs, &data, meshInd] { buildMeshBvh(bvhs[meshInd], data.meshes[meshInd]); }, &counter);
+    threadPool.wait(counter);
+    for(const MeshBvh& meshBvh : bvhs) {
+        stats.items += meshBvh.numTris();
+        stats.bytes += sizeof(vec3) * meshBvh.triVerts.size() + sizeof(u32) * meshBvh.primsFirstTri.size() +
+            sizeof(BvhNode) * meshBvh.bvh.nodes.size() + sizeof(u32) * meshBvh.bvh.primInds.size();
+    }
+}
+
+static void computeGpuInstances(GpuInstances& instances, const cgltf_data& data, CSpan<Aabb> meshAabbs)
+{
+    instances.nodesInstances.resize(data.nodes_count);
+    instances.nodes.resize(0);
+    instances.matrices.resize(0);
+    for(size_t nodeInd = 0; nodeInd < data.nodes_count; nodeInd++)
+    {
+        const cgltf_node& node = data.nodes[nodeInd];
+        instances.nodesInstances[nodeInd] = -1;
+        if(!node.has_mesh_gpu_instancing || node.mesh == nullptr)
+            continue;
+        const cgltf_accessor* translations = nullptr;
+        const cgltf_accessor* rotations = nullptr;
+        const cgltf_accessor* scales = nullptr;
+        size_t numInstances = ~size_t(0);
+        const cgltf_mesh_gpu_instancing& ext = node.mesh_gpu_instancing;
+        for(const cgltf_attribute& attrib : CSpan<cgltf_attribute>(ext.attributes, ext.attributes_count)) {
+            if(strcmp(attrib.name, "TRANSLATION") == 0)
+                translations = attrib.data;
+            else if(strcmp(attrib.name, "ROTATION") == 0)
+                rotations = attrib.data;
+            else if(strcmp(attrib.name, "SCALE") == 0)
+                scales = attrib.data;
+            else
+                continue; // custom attributes
+            numInstances = glm::min(numInstances, attrib.data->count);
+        }
+        if(numInstances == ~size_t(0))
+            continue;
+
+        GpuInstances::NodeInstances nodeInstances = {(u32)instances.matrices.size(), (u32)numInstances, Aabb::UNDEF()};
+        const Aabb& meshBox = meshAabbs[size_t(node.mesh - data.meshes)];
+        instances.matrices.resize(nodeInstances.firstInstance + numInstances);
+        for(size_t i = 0; i < numInstances; i++) {
+            vec3 translation(0), scale(1);
+            float rotation[4] = {0, 0, 0, 1};
+            // cgltf_accessor_read_float takes care of the normalized integer rotations
+            if(translations)
+                cgltf_accessor_read_float(translations, i, &translation[0], 3);
+            if(rotations)
+                cgltf_accessor_read_float(rotations, i, rotation, 4);
+            if(scales)
+                cgltf_accessor_read_float(scales, i, &scale[0], 3);
+            const glm::quat q(rotation[3], rotation[0], rotation[1], rotation[2]);
+            glm::mat4& mtx = instances.matrices[nodeInstances.firstInstance + i];
+            mtx = glm::toMat4(q);
+            mtx[0] *= scale.x;
+            mtx[1] *= scale.y;
+            mtx[2] *= scale.z;
+            mtx[3] = vec4(translation, 1);
+            nodeInstances.localBox = makeUnion(nodeInstances.localBox, transformAabb(meshBox, mtx));
+        }
+        instances.nodesInstances[nodeInd] = instances.nodes.size();
+        instances.nodes.push_back(nodeInstances);
     }
-    return box;
 }
 
 static Aabb computeNodeAabb(const cgltf_node& node, glm::mat4 modelMtx = glm::mat4(1))
@@ -1902,7 +3440,7 @@ static Aabb computeNodeAabb(const cgltf_node& node, glm::mat4 modelMtx = glm::ma
     Aabb box = Aabb::UNDEF();
     modelMtx *= glm::make_mat4(node.matrix);
     if(node.mesh)
-        box = computeMeshAabb(*node.mesh, modelMtx);
+        box = transformAabb(getNodeMeshLocalAabb(node), modelMtx);
 
     tl::CSpan<cgltf_node*> children(node.children, node.children_count);
     for(auto child : children)
@@ -1944,40 +3482,571 @@ static void setupOrbitCamera()
     }
 }
 
-bool loadGltf(const char* path)
+static void freeGltfData(cgltf_data*& data, tl::Vector<MappedFile>& mappedFiles)
 {
+    if(data && mappedFiles.size()) {
+        // cgltf must not try to free the buffers that point to mapped memory
+        for(cgltf_buffer& buffer : Span<cgltf_buffer>(data->buffers, data->buffers_count)) {
+            for(const MappedFile& file : mappedFiles)
+                if(buffer.data == file.data)
+                    buffer.data = nullptr;
+        }
+    }
+    cgltf_free(data);
+    data = nullptr;
+    for(MappedFile& file : mappedFiles)
+        unmapFile(file);
+    mappedFiles.resize(0);
+}
+
+// the glTF file and the external .bin files are memory mapped instead of being read into heap allocations
+// the buffers of the GLB BIN chunk and the external .bin files point directly to the mapped memory
+static cgltf_result parseGltfMapped(const cgltf_options& options, CStr path, cgltf_data*& data, tl::Vector<MappedFile>& mappedFiles, LoadReport& report)
+{
+    MappedFile file;
+    cgltf_result result;
+    {
+        LoadStageTimer timer(report, ELoadStage::PARSE);
+        if(!mapFile(file, path.c_str()))
+            return cgltf_result_file_not_found;
+        mappedFiles.push_back(file);
+        result = cgltf_parse(&options, file.data, file.size, &data);
+        if(result != cgltf_result_success)
+            return result;
+    }
+
+    LoadStageTimer timer(report, ELoadStage::LOAD_BUFFERS);
+    char bufferPath[4*1024];
+    for(cgltf_buffer& buffer : Span<cgltf_buffer>(data->buffers, data->buffers_count))
+    {
+        if(buffer.uri == nullptr || strncmp(buffer.uri, "data:", 5) == 0 || strstr(buffer.uri, "://"))
+            continue; // cgltf_load_buffers will take care of these
+        uriToPath(bufferPath, path, buffer.uri);
+        if(!mapFile(file, bufferPath))
+            return cgltf_result_file_not_found;
+        mappedFiles.push_back(file);
+        if(file.size < buffer.size)
+            return cgltf_result_data_too_short;
+        buffer.data = (void*)file.data;
+    }
+    return cgltf_load_buffers(&options, data, path.c_str());
+}
+
+// frees the CPU side data that was only needed for uploading
+static void releaseLoadingData()
+{
+    using namespace loading;
+    if(cacheFile.data)
+        unmapFile(cacheFile); // the images were pointing inside the cache file
+    else
+        freeImages(images);
+    images.resize(0);
+    tl::Vector<u8> emptyStorage;
+    tl::swap(tangentFrames.storage, emptyStorage);
+    tangentFrames.data = nullptr;
+}
+
+static void discardLoading()
+{
+    using namespace loading;
+    assert(jobs.done());
+    freeSceneGpuResources(gpuRes);
+    releaseLoadingData();
+    meshBvhs.resize(0);
+    gpuInstances.matrices.resize(0);
+    morphTargets.deltas.resize(0);
+    morphTargets.vertInds.resize(0);
+    freeGltfData(data, mappedFiles);
+    stage = EStage::NONE;
+}
+
+// called when the geometry is ready, the new scene is displayed while its textures are being uploaded
+static void swapLoadedScene()
+{
+    using namespace loading;
+    if(parsedData) {
+        freeSceneGpuResources(gpu::scene);
+        freeGltfData(parsedData, parsedDataMappedFiles);
+    }
+    tl::swap(gpu::scene, gpuRes);
+    tl::swap(parsedDataMappedFiles, mappedFiles);
+    parsedDataMeshBvhs.swap(meshBvhs);
+    meshBvhs.resize(0);
+    { // the instances of the old scene are freed with "old"
+        GpuInstances old;
+        tl::swap(old.nodesInstances, parsedDataGpuInstances.nodesInstances);
+        tl::swap(old.nodes, parsedDataGpuInstances.nodes);
+        tl::swap(old.matrices, parsedDataGpuInstances.matrices);
+        tl::swap(parsedDataGpuInstances.nodesInstances, gpuInstances.nodesInstances);
+        tl::swap(parsedDataGpuInstances.nodes, gpuInstances.nodes);
+        tl::swap(parsedDataGpuInstances.matrices, gpuInstances.matrices);
+    }
+    { // same for the morph targets
+        MorphTargets old;
+        tl::swap(old, parsedDataMorphTargets);
+        tl::swap(parsedDataMorphTargets, morphTargets);
+    }
+    parsedData = data;
+    data = nullptr;
     openedFilePath = path;
-    cgltf_data* newParsedData = parsedData;
-    cgltf_options options = {};
-    cgltf_result result = cgltf_parse_file(&options, path, &newParsedData);
-    if(result == cgltf_result_success)
+    // copied instead of swapped because a worker might be writing them to the cache
+    parsedDataMeshAabbs.resize(meshAabbs.size());
+    memcpy(parsedDataMeshAabbs.begin(), meshAabbs.begin(), sizeof(Aabb) * meshAabbs.size());
+
+    // reset the state that points to the old scene
+    selectedNode = nullptr;
+    selectedCamera = -1;
+    picking::tlasNeedsBuild = true;
+    picking::lastHitValid = false;
+    anims::playingInd = 0;
+    anims::time = 0;
+    buildNodeHierarchy(anims::hierarchy, getNodes());
+    anims::buildMorphWeights();
+
+    imgui_state::selectedSceneInd = -1;
+    for(u32 i = 0; i < parsedData->scenes_count; i++)
+        if(parsedData->scene == &parsedData->scenes[i]) {
+            imgui_state::selectedSceneInd = i;
+            break;
+        }
+    if(imgui_state::selectedSceneInd == -1 && parsedData->scenes_count)
+        imgui_state::selectedSceneInd = 0;
+
+    imgui_state::textureHeights.resize(parsedData->images_count);
+    for(float& height : imgui_state::textureHeights)
+        height = DEFAULT_IMGUI_IMG_HEIGHT;
+    load_stats::imageDecodeSeconds.resize(0);
+
     {
-        if(parsedData) {
-            freeSceneGpuResources();
-            cgltf_free(parsedData);
-        }
-        parsedData = newParsedData;
-        cgltf_load_buffers(&options, parsedData, path);
-        imgui_state::selectedSceneInd = -1;
-        for(u32 i = 0; i < parsedData->scenes_count; i++)
-            if(parsedData->scene == &parsedData->scenes[i]) {
-                imgui_state::selectedSceneInd = i;
-                break;
-            }
-        if(imgui_state::selectedSceneInd && parsedData->scenes_count)
-            imgui_state::selectedSceneInd = 0;
-
-        auto loadedImages = loadImages(path);
-        loadTextures(loadedImages);
-        freeImages(loadedImages);
-        loadBufferObjects();
-        createVaos();
+        LoadStageTimer timer(report, ELoadStage::LOAD_MATERIALS);
         loadMaterials();
+        report[ELoadStage::LOAD_MATERIALS].items = parsedData->materials_count;
+    }
+    {
+        LoadStageTimer timer(report, ELoadStage::SETUP_CAMERA);
         setupOrbitCamera();
-        return true;
+        report[ELoadStage::SETUP_CAMERA].items = parsedData->nodes_count;
+    }
+    report.sceneReadySeconds = float(glfwGetTime() - startTime);
+    tl::println("Scene ready to be displayed after ", 1000 * report.sceneReadySeconds, "ms, uploading textures");
+}
+
+static void finishLoading()
+{
+    using namespace loading;
+    // the workers measured each image separately. The pixels might have been freed already, but the sizes are still there
+    if(!cacheHit) {
+        LoadStageStats& decodeStats = report[ELoadStage::DECODE_IMAGES];
+        LoadStageStats& mipsStats = report[ELoadStage::GENERATE_MIPMAPS];
+        for(size_t i = 0; i < images.size(); i++) {
+            decodeStats.seconds += imageDecodeSeconds[i] - imageMipsSeconds[i];
+            mipsStats.seconds += imageMipsSeconds[i];
+            if(images[i].w == 0)
+                continue;
+            decodeStats.items++;
+            decodeStats.bytes += 4 * u64(images[i].w) * images[i].h;
+            if(cpuMipmaps && imagesNeedMipmaps[i]) {
+                mipsStats.items++;
+                mipsStats.bytes += 4 * u64(tg::calcMipChainNumPixels(images[i].w, images[i].h));
+            }
+        }
+    }
+    releaseLoadingData();
+    tl::swap(load_stats::imageDecodeSeconds, imageDecodeSeconds);
+    load_stats::imagesDecodeWallSeconds = imagesDecodeWallSeconds;
+    load_stats::imagesDecodeThreads = threadPool.numThreads();
+    load_stats::totalSeconds = float(glfwGetTime() - startTime);
+    report.imagesDecodeWallSeconds = imagesDecodeWallSeconds;
+    report.totalSeconds = load_stats::totalSeconds;
+    if(load_stats::history.size() == load_stats::MAX_HISTORY)
+        load_stats::history.erase(load_stats::history.begin());
+    tl::println("Buffer objects: ", (gpu::scene.vertexBytes + gpu::scene.indexBytes) / 1024, "KB uploaded, ",
+        gpu::scene.unusedBufferBytes / 1024, "KB of buffer data was not needed in the GPU");
+    const float parseMs = 1000 * float(report[ELoadStage::PARSE].seconds + report[ELoadStage::LOAD_BUFFERS].seconds);
+    tl::println(report.mappedFiles ? "[mmap] " : "[read] ", "parsing and loading buffers: ", parseMs, "ms, resident memory: ",
+        report.residentBytesDelta / 1024, "KB (non-file-backed: ", report.anonymousBytesDelta / 1024, "KB)");
+    if(useCache) {
+        tl::println(report.cacheHit ? "[cache hit] " : report.cacheStored ? "[cold, stored in the cache] " : "[cold, not stored in the cache] ",
+            "hashing the source files: ", 1000 * report[ELoadStage::HASH_FILES].seconds, "ms");
+    }
+    if(load_stats::reportPath.size()) {
+        if(writeLoadReportJson(report, load_stats::reportPath.c_str()))
+            tl::println("Load report written to ", load_stats::reportPath);
+        else
+            fprintf(stderr, "error writing the load report to %s\n", load_stats::reportPath.c_str());
+    }
+    load_stats::history.push_back(tl::move(report));
+    stage = EStage::NONE;
+    tl::println("Loaded ", path, " in ", 1000 * load_stats::totalSeconds, "ms (", parsedData->images_count,
+        " images decoded in ", 1000 * load_stats::imagesDecodeWallSeconds, "ms using ", load_stats::imagesDecodeThreads, " threads)");
+}
+
+// hash of the contents of all the files that the scene is made of, and of the settings that change what we store in the cache
+// "stats" gets the number of files and bytes that were hashed
+static u64 computeCacheKey(const cgltf_data& data, CStr gltfPath, bool cpuMipmaps, tg::EMipFilter mipFilter, LoadStageStats& stats)
+{
+    tl::Vector<u64> hashes;
+    hashes.push_back(cpuMipmaps ? 1 + (u64)mipFilter : 0);
+    auto hashFile = [&hashes, &stats](const char* path)
+    {
+        MappedFile file;
+        if(mapFile(file, path)) {
+            hashes.push_back(tl::hashBytes(file.data, file.size));
+            stats.bytes += file.size;
+            stats.items++;
+            unmapFile(file);
+        }
+        else
+            hashes.push_back(0);
+    };
+    hashFile(gltfPath.c_str());
+    // the data of the embedded buffers is inside the file that we already hashed
+    for(const cgltf_buffer& buffer : CSpan<cgltf_buffer>(data.buffers, data.buffers_count))
+        if(buffer.uri && strncmp(buffer.uri, "data:", 5) != 0) {
+            hashes.push_back(buffer.data ? tl::hashBytes(buffer.data, buffer.size) : 0);
+            stats.bytes += buffer.data ? buffer.size : 0;
+            stats.items++;
+        }
+    char path[4*1024];
+    for(const cgltf_image& image : CSpan<cgltf_image>(data.images, data.images_count))
+        if(image.uri) {
+            uriToPath(path, gltfPath, image.uri);
+            hashFile(path);
+        }
+    return tl::hashBytes(hashes.begin(), sizeof(u64) * hashes.size());
+}
+
+// runs in a worker after all the images have been decoded
+static void storeSceneInCache()
+{
+    using namespace loading;
+    LoadStageTimer timer(report, ELoadStage::WRITE_CACHE);
+    LoadStageStats& stats = report[ELoadStage::WRITE_CACHE];
+    const u64 tangentsBytes = tangentFrames.primsOffset.back();
+    stats.bytes = tangentsBytes + sizeof(Aabb) * meshAabbs.size();
+    tl::Vector<scene_cache::ImageToStore> imagesToStore;
+    imagesToStore.resize(images.size());
+    for(size_t i = 0; i < images.size(); i++) {
+        const LoadedImage& img = images[i];
+        imagesToStore[i] = {img.data, img.mips, img.w, img.h, img.mips ? (u32)tg::calcNumMipLevels(img.w, img.h) : 1};
+        if(img.data) {
+            stats.items++;
+            stats.bytes += 4 * (u64(img.w) * img.h + (img.mips ? tg::calcMipChainNumPixels(img.w, img.h) : 0));
+        }
+    }
+    report.cacheStored = scene_cache::store(cacheKey, imagesToStore, tangentFrames.primsOffset,
+        {tangentFrames.data, tangentsBytes}, meshAabbs);
+}
+
+// on a hit, the images and the tangent frames point inside the mapped cache file, so there is nothing to decode or compute
+static bool loadSceneFromCache()
+{
+    using namespace loading;
+    size_t numPrims = 0;
+    for(const cgltf_mesh& mesh : CSpan<cgltf_mesh>(data->meshes, data->meshes_count))
+        numPrims += mesh.primitives_count;
+    scene_cache::SceneData cached;
+    if(!scene_cache::load(cached, cacheFile, cacheKey, data->images_count, numPrims, data->meshes_count))
+        return false;
+
+    for(size_t i = 0; i < images.size(); i++) {
+        const scene_cache::ImageDesc& desc = cached.images[i];
+        LoadedImage& img = images[i];
+        img = {};
+        if(desc.w == 0)
+            continue;
+        img.data = (u8*)cached.base + desc.offset;
+        img.w = desc.w;
+        img.h = desc.h;
+        img.mips = desc.numLevels > 1 ? img.data + 4 * size_t(desc.w) * desc.h : nullptr;
+    }
+    tangentFrames.data = cached.tangentsData;
+    tangentFrames.primsOffset.resize(cached.primsTangentsOffset.size());
+    memcpy(tangentFrames.primsOffset.begin(), cached.primsTangentsOffset.begin(), sizeof(u64) * cached.primsTangentsOffset.size());
+    meshAabbs.resize(cached.meshAabbs.size());
+    memcpy(meshAabbs.begin(), cached.meshAabbs.begin(), sizeof(Aabb) * cached.meshAabbs.size());
+    return true;
+}
+
+// needs the mesh AABBs
+static void loadGpuInstances()
+{
+    using namespace loading;
+    LoadStageTimer timer(report, ELoadStage::GPU_INSTANCES);
+    computeGpuInstances(gpuInstances, *data, meshAabbs);
+    report[ELoadStage::GPU_INSTANCES].items = gpuInstances.matrices.size();
+    report[ELoadStage::GPU_INSTANCES].bytes = sizeof(glm::mat4) * gpuInstances.matrices.size();
+}
+
+// this is the part of the loading that runs in worker threads: parsing and decoding images
+static void loadGltfCpuJob()
+{
+    using namespace loading;
+    size_t fileBackedBytesBefore;
+    const size_t residentBytesBefore = getResidentMemoryBytes(&fileBackedBytesBefore);
+    cgltf_options options = {};
+    cgltf_result result;
+    if(mapFiles) {
+        result = parseGltfMapped(options, path, data, mappedFiles, report);
+    }
+    else {
+        {
+            LoadStageTimer timer(report, ELoadStage::PARSE);
+            result = cgltf_parse_file(&options, path.c_str(), &data);
+        }
+        if(result == cgltf_result_success) {
+            LoadStageTimer timer(report, ELoadStage::LOAD_BUFFERS);
+            result = cgltf_load_buffers(&options, data, path.c_str());
+        }
+    }
+    if(result != cgltf_result_success) {
+        parseFailed = true;
+        return;
+    }
+    size_t fileBackedBytesAfter;
+    const size_t residentBytesAfter = getResidentMemoryBytes(&fileBackedBytesAfter);
+    report.residentBytesDelta = i64(residentBytesAfter) - i64(residentBytesBefore);
+    report.anonymousBytesDelta = report.residentBytesDelta - (i64(fileBackedBytesAfter) - i64(fileBackedBytesBefore));
+    report[ELoadStage::PARSE].bytes = data->json_size + data->bin_size;
+    report[ELoadStage::LOAD_BUFFERS].items = data->buffers_count;
+    for(const cgltf_buffer& buffer : CSpan<cgltf_buffer>(data->buffers, data->buffers_count))
+        report[ELoadStage::LOAD_BUFFERS].bytes += buffer.size;
+    {
+        LoadStageTimer timer(report, ELoadStage::MESH_BVHS);
+        computeMeshBvhs(meshBvhs, *data, report[ELoadStage::MESH_BVHS]);
+    }
+    {
+        LoadStageTimer timer(report, ELoadStage::MORPH_TARGETS);
+        computeMorphTargets(morphTargets, *data);
+        report[ELoadStage::MORPH_TARGETS].items = morphTargets.attribs.size() / MorphTargets::NUM_ATTRIBS;
+        report[ELoadStage::MORPH_TARGETS].bytes = morphTargets.memorySize();
+    }
+
+    CSpan<cgltf_image> cgltfImages(data->images, data->images_count);
+    images.resize(cgltfImages.size());
+    imageDecodeSeconds.resize(cgltfImages.size());
+    imageMipsSeconds.resize(cgltfImages.size());
+    imagesDecoded = std::vector<std::atomic<bool>>(cgltfImages.size());
+    numDecodedImages = 0;
+    decodeStartTime = glfwGetTime();
+
+    if(useCache) {
+        {
+            LoadStageTimer timer(report, ELoadStage::HASH_FILES);
+            cacheKey = computeCacheKey(*data, path, cpuMipmaps, mipFilter, report[ELoadStage::HASH_FILES]);
+        }
+        {
+            LoadStageTimer timer(report, ELoadStage::READ_CACHE);
+            cacheHit = loadSceneFromCache();
+        }
+        report.cacheHit = cacheHit;
+        if(cacheHit) {
+            report[ELoadStage::READ_CACHE].bytes = cacheFile.size;
+            report[ELoadStage::READ_CACHE].items = cgltfImages.size();
+            for(size_t i = 0; i < cgltfImages.size(); i++) {
+                imageDecodeSeconds[i] = 0;
+                imageMipsSeconds[i] = 0;
+                imagesDecoded[i] = true;
+            }
+            numDecodedImages = cgltfImages.size();
+            loadGpuInstances();
+            stage = EStage::DECODING_IMAGES;
+            return;
+        }
+    }
+
+    {
+        LoadStageTimer timer(report, ELoadStage::TANGENT_FRAMES);
+        computeTangentFrames(tangentFrames, *data);
+        report[ELoadStage::TANGENT_FRAMES].bytes = tangentFrames.primsOffset.back();
+        report[ELoadStage::TANGENT_FRAMES].items = tangentFrames.primsOffset.size() - 1;
+    }
+    {
+        LoadStageTimer timer(report, ELoadStage::MESH_AABBS);
+        computeMeshAabbs(meshAabbs, *data);
+        report[ELoadStage::MESH_AABBS].items = meshAabbs.size();
+    }
+    loadGpuInstances();
+    findImagesNeedingMipmaps(imagesNeedMipmaps, *data);
+    findSrgbImages(imagesSrgb, *data);
+    stage = EStage::DECODING_IMAGES;
+    if(useCache && cgltfImages.size() == 0)
+        threadPool.push(storeSceneInCache, &jobs);
+    for(size_t i = 0; i < cgltfImages.size(); i++)
+    {
+        threadPool.push([i, cgltfImages] {
+            const double t0 = glfwGetTime();
+            decodeImage(images[i], cgltfImages[i], path);
+            const double tDecoded = glfwGetTime();
+            if(cpuMipmaps && imagesNeedMipmaps[i] && images[i].data)
+                generateMipChain(images[i], imagesSrgb[i], mipFilter);
+            const double t1 = glfwGetTime();
+            imageDecodeSeconds[i] = float(t1 - t0);
+            imageMipsSeconds[i] = float(t1 - tDecoded);
+            imagesDecoded[i] = true;
+            if(numDecodedImages.fetch_add(1) + 1 == cgltfImages.size()) {
+                imagesDecodeWallSeconds = float(t1 - decodeStartTime);
+                if(useCache)
+                    threadPool.push(storeSceneInCache, &jobs);
+            }
+        }, &jobs);
+    }
+}
+
+static void startLoadingGltf(CStr path)
+{
+    using namespace loading;
+    assert(stage == EStage::NONE && jobs.done());
+    loading::path = path;
+    pendingPath = "";
+    data = nullptr;
+    parseFailed = false;
+    numDecodedImages = 0;
+    numUploadedTextures = 0;
+    numUploadedLevels = 0;
+    numUploadedRows = 0;
+    imagesDecodeWallSeconds = 0;
+    cpuMipmaps = imgui_state::cpuMipmaps;
+    mipFilter = (tg::EMipFilter)imgui_state::mipFilter;
+    mapFiles = imgui_state::mapFiles;
+    useCache = imgui_state::useSceneCache;
+    cacheHit = false;
+    report = {};
+    report.path = path;
+    report.mappedFiles = mapFiles;
+    report.loaderThreads = imgui_state::numLoaderThreads;
+    scene_cache::setMaxTotalBytes(u64(imgui_state::sceneCacheMaxMB) << 20);
+    startTime = glfwGetTime();
+    threadPool.setNumThreads(imgui_state::numLoaderThreads);
+    stage = EStage::PARSING;
+    threadPool.push(loadGltfCpuJob, &jobs);
+}
+
+void loadGltf(const char* path)
+{
+    using namespace loading;
+    if(stage == EStage::NONE)
+        startLoadingGltf(path);
+    else
+        pendingPath = path; // we will start loading this one as soon as the workers are done with the current one
+}
+
+bool isLoadingGltf()
+{
+    return loading::stage != loading::EStage::NONE;
+}
+
+void setLoadReportPath(const char* path)
+{
+    load_stats::reportPath = path ? path : "";
+}
+
+const LoadReport* getLastLoadReport()
+{
+    return load_stats::history.size() ? &load_stats::history.back() : nullptr;
+}
+
+u32 getNumDrawCalls()
+{
+    return numDrawCalls;
+}
+
+CullingStats getCullingStats()
+{
+    const draw_list::Stats& stats = draw_list::stats;
+    return {stats.visibleNodes, stats.culledNodes, stats.items, stats.culledPrims};
+}
+
+void setOrbitCameraPath(float t)
+{
+    // a full turn around the scene, going up and down once. The center and the distance are the ones chosen by setupOrbitCamera
+    const float a = 2 * glm::pi<float>() * t;
+    orbitCam.heading = glm::radians(30.f) + a;
+    orbitCam.pitch = -glm::radians(30.f) + glm::radians(15.f) * sinf(a);
+}
+
+bool playAnimation(int animInd)
+{
+    if(!parsedData || animInd < 0 || animInd >= (int)parsedData->animations_count)
+        return false;
+    anims::playingInd = animInd + 1;
+    anims::time = 0;
+    anims::initAnim();
+    return true;
+}
+
+static void updateLoading()
+{
+    using namespace loading;
+    if(stage == EStage::NONE)
+        return;
+
+    if(pendingPath.size() && jobs.done()) {
+        // another file has been dropped while we were loading this one, we only care about the most recent one
+        discardLoading();
+        startLoadingGltf(Str(pendingPath));
+        return;
+    }
+
+    switch(stage)
+    {
+    case EStage::PARSING:
+        if(!jobs.done())
+            return;
+        // if the parsing had succeeded, the worker would have moved to the DECODING_IMAGES stage
+        assert(parseFailed);
+        fprintf(stderr, "error loading %s\n", path.c_str());
+        discardLoading();
+        return;
+
+    case EStage::DECODING_IMAGES:
+    {
+        // we don't need to wait for the images, the geometry is uploaded while they are being decoded
+        LoadStageTimer timer(report, ELoadStage::UPLOAD_BUFFERS);
+        loadBufferObjects(gpuRes, *data);
+        LoadStageStats& stats = report[ELoadStage::UPLOAD_BUFFERS];
+        stats.bytes = gpuRes.vertexBytes + gpuRes.indexBytes;
+        for(u32 bo : gpuRes.bufferViewsBo)
+            stats.items += bo ? 1 : 0; // the bufferViews that are not needed in the GPU don't get a buffer object
+        stage = EStage::CREATING_VAOS;
+        break;
+    }
+
+    case EStage::CREATING_VAOS:
+    {
+        {
+            LoadStageTimer timer(report, ELoadStage::CREATE_VAOS);
+            createVaos(gpuRes, *data);
+            report[ELoadStage::CREATE_VAOS].items = gpuRes.vaos.size();
+            report[ELoadStage::CREATE_VAOS].bytes = tangentFrames.primsOffset.back(); // the tangent frames are uploaded here
+        }
+        createSamplers(gpuRes, *data);
+        createMaterialsUbo(gpuRes, *data);
+        gpuRes.textures.resize(data->images_count);
+        gpuRes.textureSizes.resize(data->images_count);
+        gpuRes.texturesReady.resize(data->images_count, false);
+        glGenTextures(gpuRes.textures.size(), gpuRes.textures.begin());
+        swapLoadedScene();
+        stage = EStage::UPLOADING_TEXTURES;
+        break;
+    }
+
+    case EStage::UPLOADING_TEXTURES:
+    {
+        bool uploaded;
+        {
+            LoadStageTimer timer(report, ELoadStage::UPLOAD_TEXTURES);
+            uploaded = streamTextures(gpu::scene, images, size_t(imgui_state::textureUploadBudgetMB) << 20, !useCache);
+        }
+        // we wait for the jobs because the last decoding job might not have returned yet, or the scene might be being written to the cache
+        if(uploaded && jobs.done())
+            finishLoading();
+        break;
+    }
+
+    default:
+        assert(false);
     }
-    fprintf(stderr, "error loading\n");
-    return false;
 }
 
 void onFileDroped(GLFWwindow* window, int count, const char** paths)
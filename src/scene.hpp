@@ -1,6 +1,7 @@
 #pragma once
 
 #include <tl/int_types.hpp>
+#include "load_report.hpp"
 
 struct GLFWwindow;
 
@@ -15,10 +16,28 @@ void createAxesMesh();
 void createFloorGridMesh();
 void createCrosshairMesh();
 void createBasicTextures();
+void initTextureUploads();
+void createInstancesBuffer();
+void createUniformBuffers();
+void createJointsTexture();
+void createMorphTexture();
 
 void update(float dt);
-void drawScene();
+void drawScene(int w, int h); // into the currently bound framebuffer, the viewport must be already set
 void drawGui();
 
-bool loadGltf(const char* path);
+void loadGltf(const char* path); // the file is loaded in the background, the current scene is replaced when the new one is ready
+bool isLoadingGltf();
+void setLoadReportPath(const char* path); // after each load, a JSON report with the timings of the stages is written to this file
+const LoadReport* getLastLoadReport(); // null if no scene has been loaded yet
 void onFileDroped(GLFWwindow* window, int count, const char** paths);
+
+// used by the benchmark mode
+u32 getNumDrawCalls(); // of the scene, in the last call to drawScene
+struct CullingStats {
+    u32 visibleNodes, culledNodes; // only counting the nodes with a mesh
+    u32 visiblePrims, culledPrims;
+};
+CullingStats getCullingStats(); // of the last call to drawScene
+void setOrbitCameraPath(float t); // places the orbit camera along a path that loops around the scene, t goes from 0 to 1
+bool playAnimation(int animInd); // returns false if the scene doesn't have that animation
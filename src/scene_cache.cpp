@@ -0,0 +1,276 @@
+#include "scene_cache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace scene_cache
+{
+
+static const char MAGIC[4] = {'G', 'V', 'S', 'C'};
+static constexpr u32 FORMAT_VERSION = 1; // increment when the layout changes, so the old files are ignored
+static constexpr u64 ALIGNMENT = 16;
+
+struct Header {
+    char magic[4];
+    u32 version;
+    u64 key;
+    u64 fileSize;
+    u32 numImages, numPrims, numMeshes, _pad;
+    u64 imagesOffset; // ImageDesc[numImages]
+    u64 primsTangentsOffsetOffset; // u64[numPrims+1]
+    u64 tangentsDataOffset;
+    u64 meshAabbsOffset; // Aabb[numMeshes]
+};
+
+static u64 s_maxTotalBytes = u64(2) << 30;
+
+static u64 alignUp(u64 x) {
+    return (x + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+// the level 0 plus levels 1 to numLevels-1
+static u64 calcImageBytes(i32 w, i32 h, u32 numLevels)
+{
+    u64 size = 0;
+    for(u32 level = 0; level < numLevels; level++)
+        size += 4 * u64(std::max(1, w >> level)) * std::max(1, h >> level);
+    return size;
+}
+
+static const fs::path& cacheDir()
+{
+    static const fs::path dir = []
+    {
+        if(const char* env = getenv("GLTF_VIEWER_CACHE_DIR"))
+            return fs::path(env);
+    #ifdef _WIN32
+        if(const char* localAppData = getenv("LOCALAPPDATA"))
+            return fs::path(localAppData) / "gltf_viewer" / "cache";
+    #else
+        if(const char* xdgCache = getenv("XDG_CACHE_HOME"))
+            return fs::path(xdgCache) / "gltf_viewer";
+        if(const char* home = getenv("HOME"))
+            return fs::path(home) / ".cache" / "gltf_viewer";
+    #endif
+        std::error_code ec;
+        return fs::temp_directory_path(ec) / "gltf_viewer_cache";
+    }();
+    return dir;
+}
+
+static fs::path entryPath(u64 key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.scene", (unsigned long long)key);
+    return cacheDir() / name;
+}
+
+CStr directory()
+{
+    static const std::string dir = cacheDir().string();
+    return dir.c_str();
+}
+
+u64 maxTotalBytes()
+{
+    return s_maxTotalBytes;
+}
+
+void setMaxTotalBytes(u64 bytes)
+{
+    s_maxTotalBytes = bytes;
+}
+
+struct EntryInfo { fs::path path; u64 size; fs::file_time_type lastUse; };
+
+static u64 listEntries(std::vector<EntryInfo>* entries)
+{
+    u64 total = 0;
+    std::error_code ec;
+    for(const fs::directory_entry& entry : fs::directory_iterator(cacheDir(), ec)) {
+        if(entry.path().extension() != ".scene")
+            continue;
+        const u64 size = entry.file_size(ec);
+        if(ec)
+            continue;
+        total += size;
+        if(entries)
+            entries->push_back({entry.path(), size, entry.last_write_time(ec)});
+    }
+    return total;
+}
+
+u64 totalBytes()
+{
+    return listEntries(nullptr);
+}
+
+void clear()
+{
+    std::vector<EntryInfo> entries;
+    listEntries(&entries);
+    std::error_code ec;
+    for(const EntryInfo& entry : entries)
+        fs::remove(entry.path, ec);
+}
+
+// deletes the least recently used entries until "neededBytes" more can be added
+static void makeRoom(u64 neededBytes)
+{
+    std::vector<EntryInfo> entries;
+    u64 total = listEntries(&entries);
+    std::sort(entries.begin(), entries.end(), [](const EntryInfo& a, const EntryInfo& b) { return a.lastUse < b.lastUse; });
+    std::error_code ec;
+    for(const EntryInfo& entry : entries) {
+        if(total + neededBytes <= s_maxTotalBytes)
+            break;
+        if(fs::remove(entry.path, ec))
+            total -= entry.size;
+    }
+}
+
+bool load(SceneData& data, MappedFile& file, u64 key, u32 numImages, u32 numPrims, u32 numMeshes)
+{
+    const fs::path path = entryPath(key);
+    if(!mapFile(file, path.string().c_str()))
+        return false;
+    auto invalid = [&]
+    {
+        unmapFile(file);
+        // probably written by an older version, or truncated. It will be overwritten with a good one
+        std::error_code ec;
+        fs::remove(path, ec);
+        return false;
+    };
+    if(file.size < sizeof(Header))
+        return invalid();
+    Header header;
+    memcpy(&header, file.data, sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != FORMAT_VERSION || header.key != key ||
+        header.fileSize != file.size || header.numImages != numImages || header.numPrims != numPrims || header.numMeshes != numMeshes)
+    {
+        return invalid();
+    }
+    auto inside = [&](u64 offset, u64 size) { return offset <= file.size && size <= file.size - offset; };
+    if(!inside(header.imagesOffset, sizeof(ImageDesc) * numImages) ||
+        !inside(header.primsTangentsOffsetOffset, sizeof(u64) * (numPrims + 1)) ||
+        !inside(header.meshAabbsOffset, sizeof(Aabb) * numMeshes))
+    {
+        return invalid();
+    }
+
+    data.base = file.data;
+    data.images = {(const ImageDesc*)(file.data + header.imagesOffset), numImages};
+    data.primsTangentsOffset = {(const u64*)(file.data + header.primsTangentsOffsetOffset), numPrims + 1};
+    data.tangentsData = file.data + header.tangentsDataOffset;
+    data.meshAabbs = {(const Aabb*)(file.data + header.meshAabbsOffset), numMeshes};
+    if(!inside(header.tangentsDataOffset, data.primsTangentsOffset[numPrims]))
+        return invalid();
+    // the tangents of each primitive are between its offset and the next one, so the offsets can't decrease
+    for(u32 i = 0; i < numPrims; i++) {
+        if(data.primsTangentsOffset[i] > data.primsTangentsOffset[i+1])
+            return invalid();
+    }
+    for(const ImageDesc& img : data.images) {
+        if(img.w && (img.numLevels == 0 || img.numLevels > 32 || !inside(img.offset, calcImageBytes(img.w, img.h, img.numLevels))))
+            return invalid();
+    }
+
+    // the modification time tells which entries have been used recently
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+bool store(u64 key, tl::CSpan<ImageToStore> images, tl::CSpan<u64> primsTangentsOffset, tl::CSpan<u8> tangentsData, tl::CSpan<Aabb> meshAabbs)
+{
+    assert(primsTangentsOffset.size() >= 1);
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.key = key;
+    header.numImages = images.size();
+    header.numPrims = primsTangentsOffset.size() - 1;
+    header.numMeshes = meshAabbs.size();
+
+    // compute the layout
+    u64 offset = alignUp(sizeof(Header));
+    header.imagesOffset = offset;
+    offset = alignUp(offset + sizeof(ImageDesc) * images.size());
+    header.primsTangentsOffsetOffset = offset;
+    offset = alignUp(offset + sizeof(u64) * primsTangentsOffset.size());
+    header.tangentsDataOffset = offset;
+    offset = alignUp(offset + tangentsData.size());
+    header.meshAabbsOffset = offset;
+    offset = alignUp(offset + sizeof(Aabb) * meshAabbs.size());
+    std::vector<ImageDesc> descs(images.size());
+    for(size_t i = 0; i < images.size(); i++) {
+        const ImageToStore& img = images[i];
+        ImageDesc& desc = descs[i];
+        desc = {};
+        if(img.data == nullptr)
+            continue;
+        desc.w = img.w;
+        desc.h = img.h;
+        desc.numLevels = img.mips ? img.numLevels : 1;
+        desc.offset = offset;
+        offset = alignUp(offset + calcImageBytes(img.w, img.h, desc.numLevels));
+    }
+    header.fileSize = offset;
+    if(header.fileSize > s_maxTotalBytes)
+        return false;
+
+    std::error_code ec;
+    fs::create_directories(cacheDir(), ec);
+    makeRoom(header.fileSize);
+
+    // we write to a temporary file first, so other instances never see an entry that is half written
+    const fs::path path = entryPath(key);
+    fs::path tempPath = path;
+    tempPath += ".tmp";
+    FILE* file = fopen(tempPath.string().c_str(), "wb");
+    if(!file)
+        return false;
+    bool ok = true;
+    u64 written = 0;
+    auto write = [&](u64 at, const void* p, u64 size)
+    {
+        static const u8 zeros[ALIGNMENT] = {};
+        assert(at >= written && at - written < ALIGNMENT);
+        if(at > written)
+            ok = ok && fwrite(zeros, 1, at - written, file) == at - written;
+        if(size) // p can be null for empty arrays
+            ok = ok && fwrite(p, 1, size, file) == size;
+        written = at + size;
+    };
+    write(0, &header, sizeof(header));
+    write(header.imagesOffset, descs.data(), sizeof(ImageDesc) * descs.size());
+    write(header.primsTangentsOffsetOffset, primsTangentsOffset.begin(), sizeof(u64) * primsTangentsOffset.size());
+    write(header.tangentsDataOffset, tangentsData.begin(), tangentsData.size());
+    write(header.meshAabbsOffset, meshAabbs.begin(), sizeof(Aabb) * meshAabbs.size());
+    for(size_t i = 0; i < images.size(); i++) {
+        if(descs[i].w == 0)
+            continue;
+        const u64 level0Bytes = 4 * u64(images[i].w) * images[i].h;
+        write(descs[i].offset, images[i].data, level0Bytes);
+        if(descs[i].numLevels > 1)
+            write(written, images[i].mips, calcImageBytes(descs[i].w, descs[i].h, descs[i].numLevels) - level0Bytes);
+    }
+    write(header.fileSize, nullptr, 0); // padding at the end
+    ok = fclose(file) == 0 && ok;
+    if(ok)
+        fs::rename(tempPath, path, ec);
+    if(!ok || ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#include <tl/span.hpp>
+#include <tl/str.hpp>
+#include "utils.hpp"
+
+// on-disk cache of the data that is expensive to compute when loading a scene: decoded images with their mip chains, tangent frames, and AABBs of the meshes
+// each scene is stored in a single file that we can memory-map and upload from directly
+// the files are named after a hash of the contents of the source files, so modifying any of them invalidates the entry
+namespace scene_cache
+{
+
+struct ImageDesc {
+    i32 w, h; // 0 if the image couldn't be decoded
+    u32 numLevels; // 1 if the mip chain is not stored
+    u32 _pad;
+    u64 offset; // the level 0 is followed by the rest of the levels (RGBA8, without padding)
+};
+
+// views of the data of a scene inside its mapped cache file
+struct SceneData {
+    const u8* base; // the offsets of the images are relative to this
+    tl::CSpan<ImageDesc> images;
+    tl::CSpan<u64> primsTangentsOffset; // one per primitive plus one at the end, relative to tangentsData
+    const u8* tangentsData;
+    tl::CSpan<Aabb> meshAabbs;
+};
+
+struct ImageToStore {
+    const u8* data; // null if the image couldn't be decoded
+    const u8* mips; // levels 1 to numLevels-1
+    i32 w, h;
+    u32 numLevels;
+};
+
+CStr directory();
+u64 maxTotalBytes();
+void setMaxTotalBytes(u64 bytes); // the least recently used files are deleted to stay under this limit
+u64 totalBytes(); // size of all the files in the cache
+void clear();
+
+// returns false if there is no valid entry for that key. On success, "file" must be unmapped when we are done with "data"
+bool load(SceneData& data, MappedFile& file, u64 key, u32 numImages, u32 numPrims, u32 numMeshes);
+// returns false if the entry can't be written or it's bigger than the limit
+bool store(u64 key, tl::CSpan<ImageToStore> images, tl::CSpan<u64> primsTangentsOffset, tl::CSpan<u8> tangentsData, tl::CSpan<Aabb> meshAabbs);
+
+}
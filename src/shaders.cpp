@@ -13,12 +13,41 @@ namespace src
 {
 static ConstStr version = "#version 330 core\n\n";
 
-static ConstStr basicVertShader =
+// must match FrameUniforms, DrawUniforms and MaterialUniforms
+static ConstStr pbrUniformBlocks =
 R"GLSL(
-uniform mat3 u_modelMat3;
-uniform mat4 u_modelViewProj;
-uniform vec4 u_color;
+layout(std140) uniform FrameBlock {
+    mat4 u_viewProj;
+};
+layout(std140) uniform DrawBlock {
+    mat4 u_modelViewProj;
+    mat4 u_modelMat;
+    int u_firstJoint; // of the palette of the skin, inside u_jointsTexture
+    int u_morphOffset; // of the deltas of the primitive inside u_morphTexture, -1 if it's not morphed
+};
+layout(std140) uniform MaterialBlock {
+    vec4 u_color;
+};
+)GLSL";
+
+// the morph targets are blended in the CPU, the texture buffer has the sum of the weighted deltas: 2 texels per vertex, position and normal
+// the vertex attributes start at the first element of the accessors, so gl_VertexID is the index of the vertex in the primitive
+static ConstStr morphTargets =
+R"GLSL(
+uniform samplerBuffer u_morphTexture;
 
+void applyMorphTargets(inout vec3 pos, inout vec3 normal)
+{
+    if(u_morphOffset < 0)
+        return;
+    int texel = u_morphOffset + 2 * gl_VertexID;
+    pos += texelFetch(u_morphTexture, texel).xyz;
+    normal += texelFetch(u_morphTexture, texel + 1).xyz;
+}
+)GLSL";
+
+static ConstStr basicVertShader =
+R"GLSL(
 layout(location = 0) in vec3 a_pos;
 layout(location = 1) in vec3 a_normal;
 layout(location = 2) in vec3 a_tangent;
@@ -36,10 +65,14 @@ out vec4 v_color;
 
 void main()
 {
-    gl_Position = u_modelViewProj * vec4(a_pos, 1.0);
-    v_normal = u_modelMat3 * a_normal;
-    v_tangent = u_modelMat3 * a_tangent;
-    v_bitangent = u_modelMat3 * a_bitangent;
+    vec3 pos = a_pos;
+    vec3 normal = a_normal;
+    applyMorphTargets(pos, normal);
+    gl_Position = u_modelViewProj * vec4(pos, 1.0);
+    mat3 modelMat3 = mat3(u_modelMat);
+    v_normal = modelMat3 * normal;
+    v_tangent = modelMat3 * a_tangent;
+    v_bitangent = modelMat3 * a_bitangent;
     v_texCoord0 = a_texCoord0;
     v_texCoord1 = a_texCoord1;
     v_color = u_color * a_color;
@@ -47,13 +80,10 @@ void main()
 
 )GLSL";
 
+// the joint matrices are in a texture buffer, 4 texels (columns) each. They already take the vertices to world space
 static ConstStr skinningVertShader =
 R"GLSL(
-uniform mat3 u_modelMat3;
-uniform mat4 u_modelViewProj;
-uniform vec4 u_color;
-#define MAX_BONES %d
-uniform mat4 u_jointMatrices[MAX_BONES];
+uniform samplerBuffer u_jointsTexture;
 
 layout(location = 0) in vec3 a_pos;
 layout(location = 1) in vec3 a_normal;
@@ -72,16 +102,29 @@ out vec2 v_texCoord0;
 out vec2 v_texCoord1;
 out vec4 v_color;
 
+mat4 jointMatrix(uint jointInd)
+{
+    int texel = 4 * (u_firstJoint + int(jointInd));
+    return mat4(
+        texelFetch(u_jointsTexture, texel),
+        texelFetch(u_jointsTexture, texel + 1),
+        texelFetch(u_jointsTexture, texel + 2),
+        texelFetch(u_jointsTexture, texel + 3));
+}
+
 void main()
 {
     mat4 skinMtx =
-        a_jointWeights[0] * u_jointMatrices[a_jointInds[0]] +
-        a_jointWeights[1] * u_jointMatrices[a_jointInds[1]] +
-        a_jointWeights[2] * u_jointMatrices[a_jointInds[2]] +
-        a_jointWeights[3] * u_jointMatrices[a_jointInds[3]];
-    gl_Position = u_modelViewProj * skinMtx * vec4(a_pos, 1.0);
-    mat3 modelSkin3 = u_modelMat3 * mat3(skinMtx);
-    v_normal = modelSkin3 * a_normal;
+        a_jointWeights[0] * jointMatrix(a_jointInds[0]) +
+        a_jointWeights[1] * jointMatrix(a_jointInds[1]) +
+        a_jointWeights[2] * jointMatrix(a_jointInds[2]) +
+        a_jointWeights[3] * jointMatrix(a_jointInds[3]);
+    vec3 pos = a_pos;
+    vec3 normal = a_normal;
+    applyMorphTargets(pos, normal);
+    gl_Position = u_modelViewProj * skinMtx * vec4(pos, 1.0);
+    mat3 modelSkin3 = mat3(u_modelMat) * mat3(skinMtx);
+    v_normal = modelSkin3 * normal;
     v_tangent = modelSkin3 * a_tangent;
     v_bitangent = modelSkin3 * a_bitangent;
     v_texCoord0 = a_texCoord0;
@@ -91,6 +134,44 @@ void main()
 
 )GLSL";
 
+// the model matrix of each instance comes in the attributes INSTANCE_MATRIX_ATTRIB to INSTANCE_MATRIX_ATTRIB+3
+// u_modelMat is the parent of the instances: identity, except for the nodes with EXT_mesh_gpu_instancing
+static ConstStr instancedVertShader =
+R"GLSL(
+layout(location = 0) in vec3 a_pos;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in vec3 a_tangent;
+layout(location = 3) in vec3 a_bitangent;
+layout(location = 4) in vec2 a_texCoord0;
+layout(location = 5) in vec2 a_texCoord1;
+layout(location = 6) in vec4 a_color;
+layout(location = %d) in mat4 a_modelMat;
+
+out vec3 v_normal;
+out vec3 v_tangent;
+out vec3 v_bitangent;
+out vec2 v_texCoord0;
+out vec2 v_texCoord1;
+out vec4 v_color;
+
+void main()
+{
+    vec3 pos = a_pos;
+    vec3 normal = a_normal;
+    applyMorphTargets(pos, normal);
+    mat4 modelMat = u_modelMat * a_modelMat;
+    gl_Position = u_viewProj * modelMat * vec4(pos, 1.0);
+    mat3 modelMat3 = mat3(modelMat);
+    v_normal = modelMat3 * normal;
+    v_tangent = modelMat3 * a_tangent;
+    v_bitangent = modelMat3 * a_bitangent;
+    v_texCoord0 = a_texCoord0;
+    v_texCoord1 = a_texCoord1;
+    v_color = u_color * a_color;
+}
+
+)GLSL";
+
 static ConstStr pbrMetallic =
 R"GLSL(
 layout(location = 0) out vec4 o_color;
@@ -204,7 +285,7 @@ void uploadShaderSources(u32 shader, const Ts&... xs)
 
 namespace sd
 {
-    static ShaderData pbrMetallic[2]; // without/with skinning
+    static ShaderData pbrMetallic[3]; // without skinning, with skinning, instanced
     static ShaderData_VertColor vertColor;
     static ShaderData_FloorGrid floorGrid;
 }
@@ -214,34 +295,36 @@ static char infoLog[infoLogSize];
 
 void findAllUnifLocations(ShaderData& data)
 {
-   data.unifLocs.modelMat3 = glGetUniformLocation(data.prog, "u_modelMat3");
-   data.unifLocs.modelViewProj = glGetUniformLocation(data.prog, "u_modelViewProj");
-   data.unifLocs.color = glGetUniformLocation(data.prog, "u_color");
    data.unifLocs.colorTexture = glGetUniformLocation(data.prog, "u_colorTexture");
    data.unifLocs.normalTexture = glGetUniformLocation(data.prog, "u_normalTexture");
+   data.unifLocs.morphTexture = glGetUniformLocation(data.prog, "u_morphTexture");
 }
 
 bool buildShaders()
 {
-    u32 vertShader[2];
-    for(int skinning = 0; skinning < 2; skinning++) {
-        vertShader[skinning] = glCreateShader(GL_VERTEX_SHADER);
-        if(skinning) {
-            snprintf(scratchStr().begin(), scratchStr().size(), src::skinningVertShader, MAX_NUM_JOINTS);
-            uploadShaderSources(vertShader[skinning], src::version, scratchStr().begin());
+    // 0: basic, 1: skinning, 2: instanced
+    u32 vertShader[3];
+    for(int variant = 0; variant < 3; variant++) {
+        vertShader[variant] = glCreateShader(GL_VERTEX_SHADER);
+        if(variant == 1) {
+            uploadShaderSources(vertShader[variant], src::version, src::pbrUniformBlocks, src::morphTargets, src::skinningVertShader);
+        }
+        else if(variant == 2) {
+            snprintf(scratchStr().begin(), scratchStr().size(), src::instancedVertShader, (int)INSTANCE_MATRIX_ATTRIB);
+            uploadShaderSources(vertShader[variant], src::version, src::pbrUniformBlocks, src::morphTargets, scratchStr().begin());
         }
         else {
-            uploadShaderSources(vertShader[skinning], src::version, src::basicVertShader);
+            uploadShaderSources(vertShader[variant], src::version, src::pbrUniformBlocks, src::morphTargets, src::basicVertShader);
         }
-        glCompileShader(vertShader[skinning]);
-        if(const char* errs = tg::getShaderCompileErrors(vertShader[skinning], infoLog)) {
+        glCompileShader(vertShader[variant]);
+        if(const char* errs = tg::getShaderCompileErrors(vertShader[variant], infoLog)) {
             tl::printError(errs);
             return false;
         }
     }
 
     // metallic
-    for(int skinning = 0; skinning < 2; skinning++) {
+    for(int variant = 0; variant < 3; variant++) {
         const u32 fragShader = glCreateShader(GL_FRAGMENT_SHADER);
         uploadShaderSources(fragShader, src::version, src::pbrMetallic);
         glCompileShader(fragShader);
@@ -250,9 +333,9 @@ bool buildShaders()
             return false;
         }
 
-        auto& data = sd::pbrMetallic[skinning];
+        auto& data = sd::pbrMetallic[variant];
         data.prog = glCreateProgram();
-        glAttachShader(data.prog, vertShader[skinning]);
+        glAttachShader(data.prog, vertShader[variant]);
         glAttachShader(data.prog, fragShader);
         glLinkProgram(data.prog);
         if(const char* errs = tg::getShaderLinkErrors(data.prog, infoLog)) {
@@ -262,13 +345,27 @@ bool buildShaders()
             return false;
         }
         findAllUnifLocations(data);
-        data.unifLocs.jointMatrices = skinning ? glGetUniformLocation(data.prog, "u_jointMatrices") : -1;
-        glDetachShader(data.prog, vertShader[skinning]);
+        data.unifLocs.jointsTexture = variant == 1 ? glGetUniformLocation(data.prog, "u_jointsTexture") : -1;
+        // GLSL 3.30 can't set the bindings in the shader. The blocks not used by a variant are optimized out, and have no index
+        const struct { const char* name; EUboBinding binding; } blocks[] = {
+            {"FrameBlock", EUboBinding::FRAME},
+            {"DrawBlock", EUboBinding::DRAW},
+            {"MaterialBlock", EUboBinding::MATERIAL},
+        };
+        for(const auto& block : blocks) {
+            const u32 blockInd = glGetUniformBlockIndex(data.prog, block.name);
+            if(blockInd != GL_INVALID_INDEX)
+                glUniformBlockBinding(data.prog, blockInd, (u32)block.binding);
+        }
+        glDetachShader(data.prog, vertShader[variant]);
         glDetachShader(data.prog, fragShader);
         glDeleteShader(fragShader);
         glUseProgram(data.prog);
         glUniform1i(data.unifLocs.colorTexture, int(ETexUnit::ALBEDO));
         glUniform1i(data.unifLocs.normalTexture, int(ETexUnit::NORMAL));
+        glUniform1i(data.unifLocs.morphTexture, int(ETexUnit::MORPH));
+        if(variant == 1)
+            glUniform1i(data.unifLocs.jointsTexture, int(ETexUnit::JOINTS));
     }
 
     { // shader vert color
@@ -348,8 +445,8 @@ bool buildShaders()
         data.locs.distToFloor = glGetUniformLocation(data.prog, "u_distToFloor");
     }
 
-    for(int skinning = 0; skinning < 2; skinning++)
-        glDeleteShader(vertShader[skinning]);
+    for(int variant = 0; variant < 3; variant++)
+        glDeleteShader(vertShader[variant]);
     return true;
 }
 
@@ -358,6 +455,11 @@ const ShaderData& shaderPbrMetallic(int skinning)
     return sd::pbrMetallic[skinning];
 }
 
+const ShaderData& shaderPbrMetallicInstanced()
+{
+    return sd::pbrMetallic[2];
+}
+
 const ShaderData& shaderPbrGloss()
 {
     assert(false && "not implemented");
@@ -1,14 +1,29 @@
 #pragma once
 
 #include <tl/int_types.hpp>
+#include <glm/mat4x4.hpp>
+
+// the transforms and the material of the pbr shaders are in uniform blocks, bound to the EUboBinding points
+// these structs have the std140 layout of the blocks
+struct FrameUniforms {
+    glm::mat4 viewProj;
+};
+struct DrawUniforms {
+    glm::mat4 modelViewProj;
+    glm::mat4 modelMat; // in the instanced shader, it's applied after the matrix of each instance
+    i32 firstJoint; // only for the skinning shader
+    i32 morphOffset; // first texel of the blended morph target deltas, -1 without morphing
+    i32 _padding[2];
+};
+struct MaterialUniforms {
+    glm::vec4 color;
+};
 
 struct UniformLocations {
-    i32 modelViewProj,
-        modelMat3,
-        color,
-        colorTexture,
+    i32 colorTexture,
         normalTexture,
-        jointMatrices;
+        jointsTexture,
+        morphTexture;
 };
 
 struct ShaderData {
@@ -39,6 +54,7 @@ namespace gpu
 bool buildShaders();
 
 const ShaderData& shaderPbrMetallic(int skinning);
+const ShaderData& shaderPbrMetallicInstanced(); // without skinning
 const ShaderData& shaderPbrGloss();
 const ShaderData_VertColor& shaderVertColor();
 const ShaderData_FloorGrid& shaderFloorGrid();
@@ -0,0 +1,128 @@
+#include "thread_pool.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <assert.h>
+
+ThreadPool threadPool;
+
+struct ThreadPool::Impl {
+    struct QueuedJob { Job job; JobCounter* counter; };
+    std::mutex mutex;
+    std::condition_variable jobAvailableCv;
+    std::condition_variable jobFinishedCv;
+    std::deque<QueuedJob> queue;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+ThreadPool::ThreadPool()
+    : _impl(new Impl)
+    , _numThreads(0)
+{}
+
+ThreadPool::~ThreadPool()
+{
+    stopThreads();
+    delete _impl;
+}
+
+u32 ThreadPool::defaultNumThreads()
+{
+    // leave one core for the main thread
+    const u32 numCores = std::thread::hardware_concurrency();
+    return numCores > 1 ? numCores - 1 : 1;
+}
+
+void ThreadPool::setNumThreads(u32 numThreads)
+{
+    if(numThreads == 0)
+        numThreads = defaultNumThreads();
+    if(numThreads == _numThreads)
+        return;
+    stopThreads();
+    startThreads(numThreads);
+}
+
+void ThreadPool::push(Job job, JobCounter* counter)
+{
+    if(_numThreads == 0)
+        startThreads(defaultNumThreads());
+    if(counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_impl->mutex);
+        _impl->queue.push_back({std::move(job), counter});
+    }
+    _impl->jobAvailableCv.notify_one();
+}
+
+void ThreadPool::wait(JobCounter& counter)
+{
+    while(!counter.done())
+    {
+        if(runOneJob())
+            continue;
+        std::unique_lock<std::mutex> lock(_impl->mutex);
+        _impl->jobFinishedCv.wait(lock, [&] { return counter.done() || !_impl->queue.empty(); });
+    }
+}
+
+bool ThreadPool::runOneJob()
+{
+    Impl::QueuedJob qj;
+    {
+        std::lock_guard<std::mutex> lock(_impl->mutex);
+        if(_impl->queue.empty())
+            return false;
+        qj = std::move(_impl->queue.front());
+        _impl->queue.pop_front();
+    }
+    qj.job();
+    if(qj.counter) {
+        // take the lock so a thread that is about to sleep in wait() can't miss the notification
+        std::lock_guard<std::mutex> lock(_impl->mutex);
+        qj.counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+    _impl->jobFinishedCv.notify_all();
+    return true;
+}
+
+void ThreadPool::workerLoop()
+{
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_impl->mutex);
+            _impl->jobAvailableCv.wait(lock, [&] { return _impl->stopping || !_impl->queue.empty(); });
+            if(_impl->queue.empty()) // we only stop when there is no work left
+                return;
+        }
+        runOneJob();
+    }
+}
+
+void ThreadPool::startThreads(u32 numThreads)
+{
+    assert(_impl->threads.empty());
+    _impl->stopping = false;
+    _numThreads = numThreads;
+    for(u32 i = 0; i < numThreads; i++)
+        _impl->threads.emplace_back([this] { workerLoop(); });
+}
+
+void ThreadPool::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(_impl->mutex);
+        _impl->stopping = true;
+    }
+    _impl->jobAvailableCv.notify_all();
+    for(std::thread& thread : _impl->threads)
+        thread.join();
+    _impl->threads.clear();
+    _numThreads = 0;
+}
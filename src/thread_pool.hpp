@@ -0,0 +1,38 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#include <atomic>
+#include <functional>
+
+// counts the jobs that are still pending, so we can wait for a group of jobs to finish
+struct JobCounter {
+    std::atomic<i32> pending {0};
+    bool done()const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+class ThreadPool {
+public:
+    typedef std::function<void()> Job;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    u32 numThreads()const { return _numThreads; }
+    void setNumThreads(u32 numThreads); // waits for the pending jobs to finish. 0 means "choose based on the number of cores"
+    static u32 defaultNumThreads();
+
+    void push(Job job, JobCounter* counter = nullptr); // the counter is optional
+    void wait(JobCounter& counter); // the calling thread also runs queued jobs while waiting
+
+private:
+    bool runOneJob(); // returns false if there was no job in the queue
+    void workerLoop();
+    void startThreads(u32 numThreads);
+    void stopThreads();
+
+    struct Impl;
+    Impl* _impl;
+    u32 _numThreads;
+};
+
+extern ThreadPool threadPool;
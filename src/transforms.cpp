@@ -0,0 +1,245 @@
+#include "transforms.hpp"
+
+#include <assert.h>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define TRANSFORMS_SSE
+    #include <xmmintrin.h>
+#endif
+
+static constexpr u32 PADDING = 3; // the SIMD loops process 4 nodes at a time, starting at any position
+
+static u32 getNodeInd(tl::CSpan<cgltf_node> nodes, const cgltf_node* node)
+{
+    return u32(node - nodes.begin());
+}
+
+static void loadTrs(NodeHierarchy& h, u32 pos, const cgltf_node& node)
+{
+    const float* t = node.has_translation ? node.translation : nullptr;
+    const float* r = node.has_rotation ? node.rotation : nullptr;
+    const float* s = node.has_scale ? node.scale : nullptr;
+    h.tx[pos] = t ? t[0] : 0; h.ty[pos] = t ? t[1] : 0; h.tz[pos] = t ? t[2] : 0;
+    h.rx[pos] = r ? r[0] : 0; h.ry[pos] = r ? r[1] : 0; h.rz[pos] = r ? r[2] : 0; h.rw[pos] = r ? r[3] : 1;
+    h.sx[pos] = s ? s[0] : 1; h.sy[pos] = s ? s[1] : 1; h.sz[pos] = s ? s[2] : 1;
+    if(h.matrixInds[pos] != ~0u)
+        h.matrices[h.matrixInds[pos]] = glm::make_mat4(node.matrix);
+}
+
+void NodeHierarchy::setTranslation(u32 nodeInd, const glm::vec3& t)
+{
+    const u32 pos = posOfNode[nodeInd];
+    tx[pos] = t.x; ty[pos] = t.y; tz[pos] = t.z;
+    dirty.push_back(pos);
+}
+
+void NodeHierarchy::setRotation(u32 nodeInd, const glm::quat& q)
+{
+    const u32 pos = posOfNode[nodeInd];
+    rx[pos] = q.x; ry[pos] = q.y; rz[pos] = q.z; rw[pos] = q.w;
+    dirty.push_back(pos);
+}
+
+void NodeHierarchy::setScale(u32 nodeInd, const glm::vec3& s)
+{
+    const u32 pos = posOfNode[nodeInd];
+    sx[pos] = s.x; sy[pos] = s.y; sz[pos] = s.z;
+    dirty.push_back(pos);
+}
+
+void buildNodeHierarchy(NodeHierarchy& h, tl::CSpan<cgltf_node> nodes)
+{
+    const u32 n = nodes.size();
+    h.nodeAtPos.resize(0);
+    h.nodeAtPos.reserve(n);
+    h.posOfNode.resize(n);
+    h.parents.resize(n);
+    h.subtreeSizes.resize(n);
+
+    // iterative depth-first traversal. The children are pushed in reverse, so they are visited in their order
+    tl::Vector<u32> stack;
+    for(u32 rootInd = 0; rootInd < n; rootInd++) {
+        if(nodes[rootInd].parent)
+            continue;
+        stack.push_back(rootInd);
+        while(stack.size()) {
+            const u32 nodeInd = stack.back();
+            stack.pop_back();
+            const cgltf_node& node = nodes[nodeInd];
+            const u32 pos = h.nodeAtPos.size();
+            h.nodeAtPos.push_back(nodeInd);
+            h.posOfNode[nodeInd] = pos;
+            h.parents[pos] = node.parent ? h.posOfNode[getNodeInd(nodes, node.parent)] : ~0u;
+            for(size_t i = node.children_count; i-- > 0; )
+                stack.push_back(getNodeInd(nodes, node.children[i]));
+        }
+    }
+    assert(h.nodeAtPos.size() == n && "the node hierarchy has cycles");
+
+    // the children are after their parent, so going backwards the subtrees are complete when we reach their root
+    for(u32 pos = 0; pos < n; pos++)
+        h.subtreeSizes[pos] = 1;
+    for(u32 pos = n; pos-- > 0; )
+        if(h.parents[pos] != ~0u)
+            h.subtreeSizes[h.parents[pos]] += h.subtreeSizes[pos];
+
+    for(tl::Vector<float>* v : {&h.tx, &h.ty, &h.tz, &h.rx, &h.ry, &h.rz, &h.rw, &h.sx, &h.sy, &h.sz})
+        v->resize(n + PADDING);
+    for(u32 pos = n; pos < n + PADDING; pos++) {
+        h.tx[pos] = h.ty[pos] = h.tz[pos] = 0;
+        h.rx[pos] = h.ry[pos] = h.rz[pos] = 0;
+        h.rw[pos] = 1;
+        h.sx[pos] = h.sy[pos] = h.sz[pos] = 1;
+    }
+    h.matrixInds.resize(n);
+    h.matrices.resize(0);
+    for(u32 pos = 0; pos < n; pos++) {
+        h.matrixInds[pos] = ~0u;
+        if(nodes[h.nodeAtPos[pos]].has_matrix) {
+            h.matrixInds[pos] = h.matrices.size();
+            h.matrices.push_back(glm::mat4(1));
+        }
+    }
+    h.locals.resize(n + PADDING);
+    h.worlds.resize(n);
+    resetToRestPose(h, nodes);
+}
+
+void loadNodeTransform(NodeHierarchy& h, tl::CSpan<cgltf_node> nodes, u32 nodeInd)
+{
+    const u32 pos = h.posOfNode[nodeInd];
+    loadTrs(h, pos, nodes[nodeInd]);
+    h.dirty.push_back(pos);
+}
+
+void resetToRestPose(NodeHierarchy& h, tl::CSpan<cgltf_node> nodes)
+{
+    for(u32 pos = 0; pos < h.size(); pos++)
+        loadTrs(h, pos, nodes[h.nodeAtPos[pos]]);
+    h.dirty.resize(0);
+    h.allDirty = true;
+}
+
+// local = T * R * S, for the positions [first, last), 4 at a time
+static void composeLocals(NodeHierarchy& h, u32 first, u32 last)
+{
+#if defined(TRANSFORMS_SSE)
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 two = _mm_set1_ps(2);
+    const __m128 zero = _mm_setzero_ps();
+    for(u32 pos = first; pos < last; pos += 4) {
+        const __m128 x = _mm_loadu_ps(&h.rx[pos]);
+        const __m128 y = _mm_loadu_ps(&h.ry[pos]);
+        const __m128 z = _mm_loadu_ps(&h.rz[pos]);
+        const __m128 w = _mm_loadu_ps(&h.rw[pos]);
+        const __m128 sx = _mm_loadu_ps(&h.sx[pos]);
+        const __m128 sy = _mm_loadu_ps(&h.sy[pos]);
+        const __m128 sz = _mm_loadu_ps(&h.sz[pos]);
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+        // the columns of the rotation matrix, scaled. Each register has one component for the 4 nodes
+        __m128 cols[4][4] = {
+            {
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+                zero,
+            },
+            {
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+                zero,
+            },
+            {
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+                zero,
+            },
+            {_mm_loadu_ps(&h.tx[pos]), _mm_loadu_ps(&h.ty[pos]), _mm_loadu_ps(&h.tz[pos]), one},
+        };
+        // after the transpose, each register is the column of one node
+        for(int c = 0; c < 4; c++) {
+            _MM_TRANSPOSE4_PS(cols[c][0], cols[c][1], cols[c][2], cols[c][3]);
+            for(int i = 0; i < 4; i++)
+                _mm_storeu_ps(&h.locals[pos + i][c][0], cols[c][i]);
+        }
+    }
+#else
+    for(u32 pos = first; pos < last; pos++) {
+        const float x = h.rx[pos], y = h.ry[pos], z = h.rz[pos], w = h.rw[pos];
+        const float sx = h.sx[pos], sy = h.sy[pos], sz = h.sz[pos];
+        glm::mat4& m = h.locals[pos];
+        m[0] = glm::vec4(1 - 2 * (y*y + z*z), 2 * (x*y + w*z), 2 * (x*z - w*y), 0) * sx;
+        m[1] = glm::vec4(2 * (x*y - w*z), 1 - 2 * (x*x + z*z), 2 * (y*z + w*x), 0) * sy;
+        m[2] = glm::vec4(2 * (x*z + w*y), 2 * (y*z - w*x), 1 - 2 * (x*x + y*y), 0) * sz;
+        m[3] = glm::vec4(h.tx[pos], h.ty[pos], h.tz[pos], 1);
+    }
+#endif
+}
+
+static void mulMat4(glm::mat4& out, const glm::mat4& a, const glm::mat4& b)
+{
+#if defined(TRANSFORMS_SSE)
+    const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for(int c = 0; c < 4; c++) {
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[c][0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[c][1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[c][2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[c][3])));
+        _mm_storeu_ps(&out[c][0], r);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+// the parent of "first" must be up to date
+static void updateRange(NodeHierarchy& h, u32 first, u32 last, tl::Span<glm::mat4> worldByNode, tl::Vector<u32>& updatedNodes)
+{
+    composeLocals(h, first, last);
+    for(u32 pos = first; pos < last; pos++) {
+        glm::mat4& local = h.locals[pos];
+        if(h.matrixInds[pos] != ~0u) {
+            const glm::mat4 trs = local;
+            mulMat4(local, h.matrices[h.matrixInds[pos]], trs);
+        }
+        const u32 parent = h.parents[pos];
+        if(parent == ~0u)
+            h.worlds[pos] = local;
+        else
+            mulMat4(h.worlds[pos], h.worlds[parent], local);
+        const u32 nodeInd = h.nodeAtPos[pos];
+        worldByNode[nodeInd] = h.worlds[pos];
+        updatedNodes.push_back(nodeInd);
+    }
+}
+
+void updateNodeHierarchy(NodeHierarchy& h, tl::Span<glm::mat4> worldByNode, tl::Vector<u32>& updatedNodes)
+{
+    assert(worldByNode.size() == h.size());
+    updatedNodes.resize(0);
+    if(h.allDirty) {
+        updateRange(h, 0, h.size(), worldByNode, updatedNodes);
+        h.allDirty = false;
+    }
+    else if(h.dirty.size()) {
+        // the subtrees are contiguous, so sorting the dirty nodes we get the ranges to update. The ones inside a previous range are skipped
+        std::sort(h.dirty.begin(), h.dirty.end());
+        u32 rangeEnd = 0;
+        for(u32 pos : h.dirty) {
+            if(pos < rangeEnd)
+                continue;
+            rangeEnd = pos + h.subtreeSizes[pos];
+            updateRange(h, pos, rangeEnd, worldByNode, updatedNodes);
+        }
+    }
+    h.dirty.resize(0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+#include <tl/span.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "utils.hpp"
+
+// the transforms of the nodes of a scene in flat arrays, in depth-first order: the parents come before their children, and the subtree of each node is contiguous
+// the arrays are indexed by position in that order, which is not the order of the nodes in the gltf
+struct NodeHierarchy {
+    tl::Vector<u32> nodeAtPos; // the gltf node at each position
+    tl::Vector<u32> posOfNode; // the position of each gltf node
+    tl::Vector<u32> parents; // position of the parent, ~0u for the roots
+    tl::Vector<u32> subtreeSizes; // counting the node itself
+    // local TRS in SoA layout, padded to a multiple of 4 so the SIMD loops don't need special code for the last nodes
+    tl::Vector<float> tx, ty, tz;
+    tl::Vector<float> rx, ry, rz, rw;
+    tl::Vector<float> sx, sy, sz;
+    tl::Vector<u32> matrixInds; // inside matrices for the nodes that have a "matrix" (it's applied before the TRS), ~0u for the others
+    tl::Vector<glm::mat4> matrices;
+    tl::Vector<glm::mat4> locals, worlds;
+    tl::Vector<u32> dirty; // positions whose local transform changed since the last update. It can have repetitions
+    bool allDirty = true;
+
+    size_t size()const { return nodeAtPos.size(); }
+    // these mark the node as dirty
+    void setTranslation(u32 nodeInd, const glm::vec3& t);
+    void setRotation(u32 nodeInd, const glm::quat& q);
+    void setScale(u32 nodeInd, const glm::vec3& s);
+};
+
+// builds the hierarchy without recursion, so very deep hierarchies are fine. The TRS are initialized from the nodes
+void buildNodeHierarchy(NodeHierarchy& h, tl::CSpan<cgltf_node> nodes);
+
+// copies the TRS of the node from the gltf, for example after editing it
+void loadNodeTransform(NodeHierarchy& h, tl::CSpan<cgltf_node> nodes, u32 nodeInd);
+
+// all the nodes go back to the TRS of the gltf, and will be updated
+void resetToRestPose(NodeHierarchy& h, tl::CSpan<cgltf_node> nodes);
+
+// recomputes the local and world matrices of the dirty nodes and their subtrees. When nothing is dirty it does nothing
+// worldByNode receives the world matrices indexed by gltf node, and updatedNodes the gltf nodes that were recomputed
+void updateNodeHierarchy(NodeHierarchy& h, tl::Span<glm::mat4> worldByNode, tl::Vector<u32>& updatedNodes);
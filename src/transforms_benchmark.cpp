@@ -0,0 +1,134 @@
+#include "benchmark.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "transforms.hpp"
+
+namespace
+{
+// a random hierarchy of cgltf nodes with random TRS, so both paths read the same data
+struct SyntheticNodes {
+    tl::Vector<cgltf_node> nodes;
+    tl::Vector<cgltf_node*> children; // the children arrays of the nodes point here
+};
+}
+
+// each node hangs from a random previous node, which gives a depth of O(log n) like in typical scenes
+// with "chain", each node is the child of the previous one
+static void makeSyntheticNodes(SyntheticNodes& s, u32 n, bool chain)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1, 1);
+    s.nodes.resize(n);
+    memset(s.nodes.begin(), 0, sizeof(cgltf_node) * n);
+    tl::Vector<u32> parents;
+    parents.resize(n);
+    for(u32 i = 0; i < n; i++) {
+        parents[i] = i == 0 || (!chain && rng() % 100 == 0) ? ~0u : chain ? i - 1 : rng() % i;
+        if(parents[i] != ~0u)
+            s.nodes[parents[i]].children_count++;
+    }
+    s.children.resize(n);
+    size_t offset = 0;
+    for(cgltf_node& node : s.nodes) {
+        node.children = s.children.begin() + offset;
+        offset += node.children_count;
+        node.children_count = 0;
+    }
+    for(u32 i = 0; i < n; i++) {
+        cgltf_node& node = s.nodes[i];
+        if(parents[i] != ~0u) {
+            cgltf_node& parent = s.nodes[parents[i]];
+            node.parent = &parent;
+            parent.children[parent.children_count++] = &node;
+        }
+        node.has_translation = node.has_rotation = node.has_scale = true;
+        for(int c = 0; c < 3; c++)
+            node.translation[c] = dist(rng);
+        const glm::quat q = glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+        node.rotation[0] = q.x; node.rotation[1] = q.y; node.rotation[2] = q.z; node.rotation[3] = q.w;
+        // close to 1, so the matrices don't explode with the depth of the chain
+        for(int c = 0; c < 3; c++)
+            node.scale[c] = 1 + 0.01f * dist(rng);
+    }
+}
+
+// the way the viewer computed the matrices before NodeHierarchy
+static void calcMatricesRecursive(tl::Span<glm::mat4> matrices, const cgltf_node* nodes, const cgltf_node& node, const glm::mat4& parentMat)
+{
+    glm::mat4& mtx = matrices[size_t(&node - nodes)];
+    mtx = parentMat;
+    if(node.has_matrix)
+        mtx *= glm::make_mat4(node.matrix);
+    if(node.has_translation)
+        mtx *= glm::translate(glm::mat4(1), {node.translation[0], node.translation[1], node.translation[2]});
+    if(node.has_rotation)
+        mtx *= glm::toMat4(glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]));
+    if(node.has_scale)
+        mtx *= glm::scale(glm::mat4(1), glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+    for(size_t i = 0; i < node.children_count; i++)
+        calcMatricesRecursive(matrices, nodes, *node.children[i], mtx);
+}
+
+static float maxRelativeError(tl::CSpan<glm::mat4> a, tl::CSpan<glm::mat4> b)
+{
+    float maxErr = 0;
+    for(size_t i = 0; i < a.size(); i++)
+        for(int c = 0; c < 4; c++)
+            for(int r = 0; r < 4; r++)
+                maxErr = std::max(maxErr, fabsf(a[i][c][r] - b[i][c][r]) / std::max(1.f, fabsf(b[i][c][r])));
+    return maxErr;
+}
+
+int runTransformsBenchmark()
+{
+    printf("%10s %16s %12s %9s %20s %10s\n", "nodes", "recursive (ms)", "flat (ms)", "speedup", "flat 1% dirty (ms)", "max error");
+    const u32 sizes[] = {10'000, 100'000, 1'000'000};
+    SyntheticNodes s;
+    NodeHierarchy h;
+    tl::Vector<glm::mat4> reference, flat;
+    tl::Vector<u32> updatedNodes;
+    for(u32 n : sizes) {
+        makeSyntheticNodes(s, n, false);
+        const u32 numRuns = std::max(3u, 2'000'000 / n);
+        reference.resize(n);
+        const double recursiveMs = measureMs(numRuns, [&] {
+            for(const cgltf_node& node : s.nodes)
+                if(node.parent == nullptr)
+                    calcMatricesRecursive(reference, s.nodes.begin(), node, glm::mat4(1));
+        });
+
+        buildNodeHierarchy(h, s.nodes);
+        flat.resize(n);
+        const double flatMs = measureMs(numRuns, [&] {
+            h.allDirty = true;
+            updateNodeHierarchy(h, flat, updatedNodes);
+        });
+        const float maxErr = maxRelativeError(flat, reference);
+
+        // like an animation that moves some nodes: only their subtrees are updated
+        std::mt19937 rng(5678);
+        const double partialMs = measureMs(numRuns, [&] {
+            for(u32 i = 0; i < n / 100; i++)
+                loadNodeTransform(h, s.nodes, rng() % n);
+            updateNodeHierarchy(h, flat, updatedNodes);
+        });
+        printf("%10u %16.3f %12.3f %8.2fx %20.3f %10g\n", n, recursiveMs, flatMs, recursiveMs / flatMs, partialMs, maxErr);
+    }
+
+    // the recursion would overflow the stack with this one, so only the flat path is measured
+    const u32 chainLength = 1'000'000;
+    makeSyntheticNodes(s, chainLength, true);
+    buildNodeHierarchy(h, s.nodes);
+    flat.resize(chainLength);
+    const double chainMs = measureMs(3, [&] {
+        h.allDirty = true;
+        updateNodeHierarchy(h, flat, updatedNodes);
+    });
+    printf("chain of %u nodes (flat only): %.3f ms\n", chainLength, chainMs);
+    return 0;
+}
@@ -6,6 +6,17 @@
 #include <tl/basic.hpp>
 #include <glad/glad.h>
 #include <glm/gtx/euler_angles.hpp>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
 
 ScratchBuffer scratch;
 
@@ -26,6 +37,74 @@ void ScratchBuffer::growIfNeeded(size_t size)
     }
 }
 
+bool mapFile(MappedFile& file, const char* path)
+{
+    file = {};
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(f == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    HANDLE m = nullptr;
+    if(GetFileSizeEx(f, &size) && size.QuadPart > 0)
+        m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(f);
+    if(m == nullptr)
+        return false;
+    void* p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(m); // the view keeps the mapping alive
+    if(p == nullptr)
+        return false;
+    file.data = (const u8*)p;
+    file.size = (size_t)size.QuadPart;
+#else
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if(p == MAP_FAILED)
+        return false;
+    file.data = (const u8*)p;
+    file.size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+    if(file.data == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+    file = {};
+}
+
+size_t getResidentMemoryBytes(size_t* fileBackedBytes)
+{
+    size_t resident = 0, shared = 0;
+#ifdef __linux__
+    if(FILE* f = fopen("/proc/self/statm", "r")) {
+        unsigned long totalPages, residentPages, sharedPages;
+        if(fscanf(f, "%lu %lu %lu", &totalPages, &residentPages, &sharedPages) == 3) {
+            const size_t pageSize = sysconf(_SC_PAGESIZE);
+            resident = residentPages * pageSize;
+            shared = sharedPages * pageSize;
+        }
+        fclose(f);
+    }
+#endif
+    if(fileBackedBytes)
+        *fileBackedBytes = shared;
+    return resident;
+}
+
 CStr toStr(EAttrib type)
 {
     switch (type) {
@@ -63,6 +142,35 @@ Aabb makeUnion(const Aabb& a, const Aabb& b)
     return c;
 }
 
+void radixSort(tl::Span<SortKey> keys, tl::Span<SortKey> temp)
+{
+    assert(temp.size() == keys.size());
+    const size_t n = keys.size();
+    u32 counts[8][256] = {};
+    for(const SortKey& k : keys)
+        for(int b = 0; b < 8; b++)
+            counts[b][(k.key >> (8*b)) & 0xFF]++;
+
+    SortKey* src = keys.begin();
+    SortKey* dst = temp.begin();
+    for(int b = 0; b < 8; b++) {
+        u32* c = counts[b];
+        if(n == 0 || c[(src[0].key >> (8*b)) & 0xFF] == n)
+            continue; // all the keys have the same byte, this pass wouldn't change anything
+        u32 offset = 0;
+        for(int i = 0; i < 256; i++) {
+            const u32 count = c[i];
+            c[i] = offset;
+            offset += count;
+        }
+        for(size_t i = 0; i < n; i++)
+            dst[c[(src[i].key >> (8*b)) & 0xFF]++] = src[i];
+        tl::swap(src, dst);
+    }
+    if(src != keys.begin())
+        memcpy(keys.begin(), src, sizeof(SortKey) * n);
+}
+
 bool Splitter(bool split_vertically, float thickness, float* size1, float* size2, float min_size1, float min_size2, float splitter_long_axis_size)
 {
     using namespace ImGui;
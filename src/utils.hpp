@@ -10,8 +10,6 @@
 constexpr float PI = glm::pi<float>();
 typedef const char* const ConstStr;
 
-constexpr int MAX_NUM_JOINTS = 64;
-
 class ScratchBuffer {
 public:
     ScratchBuffer();
@@ -34,6 +32,16 @@ extern ScratchBuffer scratch;
 static inline tl::Span<char> scratchStr() { return scratch.asArray<char>(); }
 static inline tl::Span<u8> scratchU8() { return scratch.asArray<u8>(); }
 
+// read-only memory mapping of a whole file
+struct MappedFile {
+    const u8* data = nullptr;
+    size_t size = 0;
+};
+bool mapFile(MappedFile& file, const char* path);
+void unmapFile(MappedFile& file);
+
+size_t getResidentMemoryBytes(size_t* fileBackedBytes = nullptr); // returns 0 if not supported in this platform
+
 enum class EAttrib : u8 {
     POSITION = 0,
     NORMAL,
@@ -49,10 +57,23 @@ enum class EAttrib : u8 {
 CStr toStr(EAttrib type);
 EAttrib strToEAttrib(CStr str);
 
+// the model matrix of instanced draws takes 4 attribute locations (one per column), after the vertex attributes
+constexpr u32 INSTANCE_MATRIX_ATTRIB = (u32)EAttrib::COUNT;
+
 enum class ETexUnit : u8 {
     ALBEDO,
     NORMAL,
     PHYSICS,
+    JOINTS, // texture buffer with the joint matrices of the skinned meshes
+    MORPH, // texture buffer with the blended morph target deltas
+    COUNT
+};
+
+// binding points of the uniform buffers of the pbr shaders
+enum class EUboBinding : u8 {
+    FRAME, // FrameUniforms
+    DRAW, // DrawUniforms
+    MATERIAL, // MaterialUniforms
     COUNT
 };
 
@@ -69,6 +90,14 @@ struct Aabb {
 
 Aabb makeUnion(const Aabb& a, const Aabb& b);
 
+// a sort key and the index of the element it belongs to
+struct SortKey {
+    u64 key;
+    u32 ind;
+};
+// stable LSD radix sort, 8 bits per pass. The passes where all the keys have the same byte are skipped. "temp" must have the same size as "keys"
+void radixSort(tl::Span<SortKey> keys, tl::Span<SortKey> temp);
+
 struct CameraProjectionInfo {
     float fovY;
     float nearDist, farDist;
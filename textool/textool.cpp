@@ -16,6 +16,7 @@
 
 static char s_buffer[4*1024];
 
+#ifdef GLAD_DEBUG
 static const char* getGlErrStr(GLenum const err)
 {
     switch (err) {
@@ -46,6 +47,7 @@ static void glErrorCallback(const char *name, void *funcptr, int len_args, ...)
         assert(false);
     }
 }
+#endif
 
 static GLFWwindow* initGlfwGL()
 {
@@ -71,7 +73,9 @@ static GLFWwindow* initGlfwGL()
         fprintf(stderr, "Failed to initialize OpenGL loader!\n");
         return nullptr;
     }
+#ifdef GLAD_DEBUG
     glad_set_post_callback(glErrorCallback);
+#endif
     return window;
 }
 